@@ -1,34 +1,1550 @@
-bool check_borders (int x , int y , int width , int height){
+
+#ifndef DIM
+#define DIM 3
+#endif
+
+#define RADIUS (DIM / 2)
+
+#ifndef FIXED_POINT_SHIFT
+#define FIXED_POINT_SHIFT 8
+#endif
+
+// Border policies, must match the BorderMode enum of gaussian_blur_processor.h
+#define BORDER_COPY 0
+#define BORDER_CLAMP 1
+#define BORDER_MIRROR 2
+#define BORDER_WRAP 3
+#define BORDER_CONSTANT 4
+
+int remap_coordinate(int i, int n, int border_mode){
     /*
-    Return true if pixels belongs to border, false otherwise
+    Bring a coordinate lying outside [0, n) back into the image following the
+    border policy. Returns -1 when the constant value has to be used instead.
     */
-    return (x == 0 || y == 0 || x == width - 1 || y == height - 1);
+    if (i >= 0 && i < n) return i;
+
+    switch (border_mode){
+        case BORDER_CLAMP:
+            return clamp(i, 0, n - 1);
+        case BORDER_MIRROR:
+            // Symmetric reflection, the edge pixel is repeated (-1 -> 0)
+            i = (i < 0) ? -i - 1 : 2 * n - i - 1;
+            return clamp(i, 0, n - 1);
+        case BORDER_WRAP:
+            return ((i % n) + n) % n;
+        default:
+            return -1;
+    }
 }
 
-__kernel void gaussian_blur(global uchar* image,
+__kernel void gaussian_blur(global const uchar* image,
                             global uchar* output_image,
-                            global float* gaussian_kernel,
-                            global int* image_dim){
-                                
-    const int height = image_dim[0];
+                            global const float* gaussian_kernel,
+                            global const int* image_dim,
+                            int x_end,
+                            int y_end){
+    /*
+    Interior pass: launched with a global offset over the pixels whose whole
+    neighbourhood lies inside the uploaded slice, so no border test is needed.
+    The global size is padded to a multiple of the work-group size, the
+    work-items past (x_end, y_end) have nothing to do.
+    image_dim = {slice height, width, halo rows above the slice, uploaded rows}
+    */
     const int width = image_dim[1];
+    const int halo_top = image_dim[2];
 
     int x = get_global_id(0);
     int y = get_global_id(1);
+    if (x >= x_end || y >= y_end) return;
+
+    float sum = 0.0f;
 
-    if (check_borders(x , y , width , height)){
-        output_image[y * width + x] = image[y * width + x];
+    for (int j = -RADIUS ; j <= RADIUS ; j++){
+        global const uchar* row = image + (y + halo_top + j) * width + x;
+        for (int i = -RADIUS ; i <= RADIUS ; i++){
+            sum += gaussian_kernel[(j + RADIUS) * DIM + (i + RADIUS)] * row[i];
+        }
+    }
+    output_image[y * width + x] = (uchar)sum;
+}
+
+__kernel void gaussian_blur_fixed(global const uchar* image,
+                                  global uchar* output_image,
+                                  global const ushort* fixed_kernel,
+                                  global const int* image_dim,
+                                  int x_end,
+                                  int y_end){
+    /*
+    Fixed-point twin of gaussian_blur: the weights are integers summing to
+    2^FIXED_POINT_SHIFT and the products are accumulated in 16 bits, then
+    rounded by shifting. 255 * 2^8 + 2^7 still fits in a ushort, the host only
+    selects this kernel when that holds.
+    */
+    const int width = image_dim[1];
+    const int halo_top = image_dim[2];
+
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= x_end || y >= y_end) return;
+
+    ushort sum = 1 << (FIXED_POINT_SHIFT - 1);
+
+    for (int j = -RADIUS ; j <= RADIUS ; j++){
+        global const uchar* row = image + (y + halo_top + j) * width + x;
+        for (int i = -RADIUS ; i <= RADIUS ; i++){
+            sum += fixed_kernel[(j + RADIUS) * DIM + (i + RADIUS)] * (ushort)row[i];
+        }
+    }
+    output_image[y * width + x] = (uchar)(sum >> FIXED_POINT_SHIFT);
+}
+
+__kernel void gaussian_blur_border(global const uchar* image,
+                                   global uchar* output_image,
+                                   global const float* gaussian_kernel,
+                                   global const int* image_dim,
+                                   int top_rows,
+                                   int bottom_start,
+                                   int border_mode,
+                                   uchar constant_value){
+    /*
+    Border pass: one work-item per pixel of the frame left over by the interior
+    pass, i.e. the rows [0, top_rows) and [bottom_start, height) plus the RADIUS
+    first and last columns of the rows in between. The border mode is the same for the
+    whole launch so the switch does not diverge.
+    */
+    const int width = image_dim[1];
+    const int halo_top = image_dim[2];
+
+    int id = get_global_id(0);
+    int x, y;
+
+    if (id < top_rows * width){
+        y = id / width;
+        x = id % width;
+    } else {
+        id -= top_rows * width;
+        int middle = (bottom_start - top_rows) * 2 * RADIUS;
+        if (id < middle){
+            y = top_rows + id / (2 * RADIUS);
+            int column = id % (2 * RADIUS);
+            x = (column < RADIUS) ? column : width - 2 * RADIUS + column;
+        } else {
+            id -= middle;
+            y = bottom_start + id / width;
+            x = id % width;
+        }
+    }
+
+    if (border_mode == BORDER_COPY){
+        output_image[y * width + x] = image[(y + halo_top) * width + x];
         return;
     }
 
+    // Rows outside the image are provided by the halo uploaded by the host,
+    // only the columns have to be remapped here.
     float sum = 0.0f;
 
-    for (int i = -1 ; i <=1 ; i++){
-        for (int j = -1 ; j <= 1 ; j++){
-            int nx = x + i;
-            int ny = y + j;
-            sum += gaussian_kernel[(i+1)*3 + (j+1)] * image[ny * width +nx];
+    for (int j = -RADIUS ; j <= RADIUS ; j++){
+        global const uchar* row = image + (y + halo_top + j) * width;
+        for (int i = -RADIUS ; i <= RADIUS ; i++){
+            int nx = remap_coordinate(x + i, width, border_mode);
+            uchar value = (nx < 0) ? constant_value : row[nx];
+            sum += gaussian_kernel[(j + RADIUS) * DIM + (i + RADIUS)] * value;
         }
+    }
     output_image[y * width + x] = (uchar)sum;
+}
+
+// Only compiled for devices with images, the program must build everywhere
+#ifdef __IMAGE_SUPPORT__
+__kernel void gaussian_blur_image(read_only image2d_t image,
+                                  sampler_t sampler,
+                                  global uchar* output_image,
+                                  global const float* gaussian_kernel,
+                                  global const int* image_dim){
+    /*
+    Sampler variant: the slice (halo included) is an image2d_t read with
+    normalized coordinates, the addressing mode of the sampler implements the
+    border policy on the columns and the halo provides the rows. Neighbours go
+    through the texture cache where the device has one.
+    */
+    const int height = image_dim[0];
+    const int width = image_dim[1];
+    const int halo_top = image_dim[2];
+    const int input_rows = image_dim[3];
+
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    float sum = 0.0f;
+
+    for (int j = -RADIUS ; j <= RADIUS ; j++){
+        float v = (y + halo_top + j + 0.5f) / input_rows;
+        for (int i = -RADIUS ; i <= RADIUS ; i++){
+            float u = (x + i + 0.5f) / width;
+            uint value = read_imageui(image, sampler, (float2)(u, v)).x;
+            sum += gaussian_kernel[(j + RADIUS) * DIM + (i + RADIUS)] * value;
+        }
+    }
+    output_image[y * width + x] = (uchar)sum;
+}
+#endif
+
+/*
+Coarsened variants: each work-item blurs N horizontally adjacent interior
+pixels starting at x = RADIUS + N * get_global_id(0). Every row of the
+neighbourhood is fetched with two vector loads, the N + 2 * RADIUS columns are
+kept in private memory and the shifted windows are read from there (needs
+N >= 2 * RADIUS). The second load may read up to N bytes past the last row,
+the host pads the input buffer accordingly. The work-items past vector_count
+vectors or y_end rows come from the padding of the global size.
+*/
+#define GAUSSIAN_BLUR_VEC(N)                                                            \
+__kernel void gaussian_blur_vec##N(global const uchar* image,                           \
+                                   global uchar* output_image,                          \
+                                   global const float* gaussian_kernel,                 \
+                                   global const int* image_dim,                         \
+                                   int vector_count,                                    \
+                                   int y_end){                                          \
+    const int width = image_dim[1];                                                     \
+    const int halo_top = image_dim[2];                                                  \
+                                                                                        \
+    int x = RADIUS + get_global_id(0) * N;                                              \
+    int y = get_global_id(1);                                                           \
+    if (get_global_id(0) >= vector_count || y >= y_end) return;                         \
+                                                                                        \
+    float##N sum = (float##N)(0.0f);                                                    \
+    uchar line[2 * N];                                                                  \
+                                                                                        \
+    for (int j = -RADIUS ; j <= RADIUS ; j++){                                          \
+        global const uchar* row = image + (y + halo_top + j) * width + x - RADIUS;      \
+        vstore##N(vload##N(0, row), 0, line);                                           \
+        vstore##N(vload##N(1, row), 1, line);                                           \
+        for (int i = 0 ; i < DIM ; i++){                                                \
+            float##N values = convert_float##N(vload##N(0, line + i));                  \
+            sum += gaussian_kernel[(j + RADIUS) * DIM + i] * values;                    \
+        }                                                                               \
+    }                                                                                   \
+    vstore##N(convert_uchar##N(sum), 0, output_image + y * width + x);                  \
+}
+
+GAUSSIAN_BLUR_VEC(4)
+GAUSSIAN_BLUR_VEC(8)
+GAUSSIAN_BLUR_VEC(16)
+
+/*
+Recursive (IIR) Gaussian of Young and van Vliet: a causal then an
+anticausal third order recursion per line, whose cost does not depend on
+sigma. coefficients = (B, b1 / b0, b2 / b0, b3 / b0).
+The lines are processed one per work-item along the columns of a row-major
+float buffer, so neighbouring work-items access neighbouring addresses. The
+horizontal pass runs on the transposed image.
+*/
+#define TRANSPOSE_TILE 16
+
+#define TRANSPOSE(NAME, IN_TYPE)                                                        \
+__kernel __attribute__((reqd_work_group_size(TRANSPOSE_TILE, TRANSPOSE_TILE, 1)))       \
+void NAME(global const IN_TYPE* input, global float* output, int width, int height){    \
+    local float tile[TRANSPOSE_TILE][TRANSPOSE_TILE + 1];                               \
+                                                                                        \
+    int x = get_global_id(0);                                                           \
+    int y = get_global_id(1);                                                           \
+    int lx = get_local_id(0);                                                           \
+    int ly = get_local_id(1);                                                           \
+                                                                                        \
+    if (x < width && y < height) tile[ly][lx] = input[y * width + x];                   \
+    barrier(CLK_LOCAL_MEM_FENCE);                                                       \
+                                                                                        \
+    int ox = get_group_id(1) * TRANSPOSE_TILE + lx;                                     \
+    int oy = get_group_id(0) * TRANSPOSE_TILE + ly;                                     \
+    if (ox < height && oy < width) output[oy * height + ox] = tile[lx][ly];             \
+}
+
+TRANSPOSE(transpose_uchar_float, uchar)
+TRANSPOSE(transpose_float, float)
+
+__kernel void iir_gaussian_columns(global float* data,
+                                   global uchar* output,
+                                   int columns,
+                                   int length,
+                                   int pad,
+                                   int out_start,
+                                   int out_rows,
+                                   float4 coefficients,
+                                   int use_constant,
+                                   float constant_value){
+    /*
+    Filter the column get_global_id(0) of a length x columns buffer in place.
+    The line is extended by its edge value (clamp), or by constant_value for
+    the constant border mode: the causal pass starts from the steady state of
+    the first value and goes on over pad extra rows of the buffer, so that the
+    anticausal pass can start from the steady state of the last one. When
+    out_rows > 0 the anticausal pass writes the rows [out_start, out_start +
+    out_rows) to output as bytes instead of storing back to data.
+    */
+    int c = get_global_id(0);
+    if (c >= columns) return;
+
+    const float B = coefficients.x;
+    const float a1 = coefficients.y;
+    const float a2 = coefficients.z;
+    const float a3 = coefficients.w;
+    global float* line = data + c;
+
+    float first = use_constant ? constant_value : line[0];
+    float last = use_constant ? constant_value : line[(length - 1) * columns];
+
+    float w1 = first, w2 = first, w3 = first;
+    for (int n = 0 ; n < length + pad ; n++){
+        float value = (n < length) ? line[n * columns] : last;
+        float w = B * value + a1 * w1 + a2 * w2 + a3 * w3;
+        line[n * columns] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+
+    float y1 = last, y2 = last, y3 = last;
+    for (int n = length + pad - 1 ; n >= 0 ; n--){
+        float y = B * line[n * columns] + a1 * y1 + a2 * y2 + a3 * y3;
+        y3 = y2; y2 = y1; y1 = y;
+
+        if (out_rows > 0){
+            int r = n - out_start;
+            if (r >= 0 && r < out_rows) output[r * columns + c] = convert_uchar_sat_rte(y);
+        } else {
+            line[n * columns] = y;
+        }
+    }
+}
+
+/*
+Iterated box filter: three running-sum passes whose radii are chosen so that
+their composition approximates a Gaussian (see GaussianBlurProcessor::boxRadii).
+Like the IIR engine, one work-item walks one column of a row-major float
+buffer and the horizontal passes run on the transposed image.
+*/
+float box_value(global const float* line, int columns, int length, int i, int border_mode, float constant_value){
+    int n = remap_coordinate(i, length, border_mode);
+    return (n < 0) ? constant_value : line[n * columns];
+}
+
+__kernel void box_columns(global const float* input,
+                          global float* output,
+                          global uchar* byte_output,
+                          int columns,
+                          int length,
+                          int radius,
+                          int out_start,
+                          int out_rows,
+                          int border_mode,
+                          float constant_value){
+    /*
+    Mean over 2 * radius + 1 rows of the column get_global_id(0), from input
+    to output. The sum is updated with one addition and one subtraction per
+    row, the samples outside the column follow the border policy. When
+    out_rows > 0 the rows [out_start, out_start + out_rows) are written to
+    byte_output instead.
+    */
+    int c = get_global_id(0);
+    if (c >= columns) return;
+
+    global const float* line = input + c;
+    const float scale = 1.0f / (2 * radius + 1);
+
+    float sum = 0.0f;
+    for (int i = -radius - 1 ; i < radius ; i++){
+        sum += box_value(line, columns, length, i, border_mode, constant_value);
+    }
+
+    for (int n = 0 ; n < length ; n++){
+        sum += box_value(line, columns, length, n + radius, border_mode, constant_value)
+             - box_value(line, columns, length, n - radius - 1, border_mode, constant_value);
+        float mean = sum * scale;
+
+        if (out_rows > 0){
+            int r = n - out_start;
+            if (r >= 0 && r < out_rows) byte_output[r * columns + c] = convert_uchar_sat_rte(mean);
+        } else {
+            output[n * columns + c] = mean;
+        }
+    }
+}
+
+__kernel void convolve_direct(global const uchar* image,
+                              global uchar* output_image,
+                              global const float* weights,
+                              int width,
+                              int rows,
+                              int halo_top,
+                              int radius_x,
+                              int radius_y,
+                              int border_mode,
+                              uchar constant_value){
+    /*
+    Direct convolution by an arbitrary (2 * radius_x + 1) x (2 * radius_y + 1)
+    user kernel, same orientation as gaussian_blur. The halo uploaded by the
+    host provides the rows, the columns are remapped here.
+    */
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= rows) return;
+
+    const int kernel_width = 2 * radius_x + 1;
+    float sum = 0.0f;
+
+    for (int j = -radius_y ; j <= radius_y ; j++){
+        global const uchar* row = image + (y + halo_top + j) * width;
+        global const float* weight_row = weights + (j + radius_y) * kernel_width + radius_x;
+        for (int i = -radius_x ; i <= radius_x ; i++){
+            int nx = remap_coordinate(x + i, width, border_mode);
+            uchar value = (nx < 0) ? constant_value : row[nx];
+            sum += weight_row[i] * value;
+        }
+    }
+    output_image[y * width + x] = convert_uchar_sat_rte(sum);
+}
+
+/*
+Frequency-domain convolution by overlap-add on tile_size x tile_size tiles
+(a power of two). The slice, extended by radius_x columns on each side
+following the border policy, is cut into blocks of block_x x block_y pixels
+with block = tile_size - kernel size + 1. Each block is zero padded to a
+tile, transformed, multiplied by the spectrum of the kernel and transformed
+back, so its circular convolution does not wrap. A pixel of the result gets
+contributions from at most two tiles along each axis, which fft_gather adds
+up: no atomics are needed.
+Tiles are stored as float2 (re, im), row-major, tile t at t * tile_size^2.
+The transforms are iterative radix-2 decimation in time: the inputs are
+written in bit-reversed order, one launch of fft_stage per butterfly stage
+and direction.
+*/
+uint bit_reverse(uint value, int bits){
+    uint result = 0;
+    for (int b = 0 ; b < bits ; b++){
+        result = (result << 1) | (value & 1);
+        value >>= 1;
+    }
+    return result;
+}
+
+__kernel void fft_load_tiles(global const uchar* image,
+                             global float2* tiles,
+                             int width,
+                             int input_rows,
+                             int tile_size,
+                             int log2_tile,
+                             int block_x,
+                             int block_y,
+                             int tiles_x,
+                             int radius_x,
+                             int border_mode,
+                             uchar constant_value){
+    int i = get_global_id(0);
+    int j = get_global_id(1);
+    int t = get_global_id(2);
+
+    int ex = (t % tiles_x) * block_x + i;
+    int ey = (t / tiles_x) * block_y + j;
+
+    float value = 0.0f;
+    if (i < block_x && j < block_y && ex < width + 2 * radius_x && ey < input_rows){
+        int x = remap_coordinate(ex - radius_x, width, border_mode);
+        value = (x < 0) ? constant_value : image[ey * width + x];
+    }
+
+    int ri = bit_reverse(i, log2_tile);
+    int rj = bit_reverse(j, log2_tile);
+    tiles[(t * tile_size + rj) * tile_size + ri] = (float2)(value, 0.0f);
+}
+
+__kernel void fft_stage(global float2* tiles,
+                        int tile_size,
+                        int half_span,
+                        int columns,
+                        float direction){
+    /*
+    One butterfly stage on spans of 2 * half_span points, along the rows or
+    the columns of every tile. Work-item (k, l, t) computes butterfly k of
+    line l of tile t. direction is -1 for the forward transform, +1 for the
+    inverse one.
+    */
+    int k = get_global_id(0);
+    int l = get_global_id(1);
+    int t = get_global_id(2);
+
+    int pos = k % half_span;
+    int i0 = (k / half_span) * 2 * half_span + pos;
+    int i1 = i0 + half_span;
+
+    global float2* tile = tiles + t * tile_size * tile_size;
+    int stride = columns ? tile_size : 1;
+    int base = columns ? l : l * tile_size;
+
+    float c;
+    float s = sincos(direction * M_PI_F * pos / half_span, &c);
+
+    float2 a = tile[base + i0 * stride];
+    float2 b = tile[base + i1 * stride];
+    float2 wb = (float2)(c * b.x - s * b.y, c * b.y + s * b.x);
+    tile[base + i0 * stride] = a + wb;
+    tile[base + i1 * stride] = a - wb;
+}
+
+__kernel void fft_multiply(global const float2* tiles,
+                           global const float2* spectrum,
+                           global float2* products,
+                           int tile_size,
+                           int log2_tile,
+                           float scale){
+    /*
+    Pointwise product with the kernel spectrum, scaled by 1 / tile_size^2 and
+    stored in bit-reversed order, ready for the inverse transform.
+    */
+    int i = get_global_id(0);
+    int j = get_global_id(1);
+    int t = get_global_id(2);
+
+    float2 a = tiles[(t * tile_size + j) * tile_size + i];
+    float2 b = spectrum[j * tile_size + i];
+    float2 p = (float2)(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x) * scale;
+
+    int ri = bit_reverse(i, log2_tile);
+    int rj = bit_reverse(j, log2_tile);
+    products[(t * tile_size + rj) * tile_size + ri] = p;
+}
+
+__kernel void fft_gather(global const float2* tiles,
+                         global uchar* output_image,
+                         int width,
+                         int rows,
+                         int halo_top,
+                         int tile_size,
+                         int block_x,
+                         int block_y,
+                         int tiles_x,
+                         int tiles_y,
+                         int radius_x,
+                         int radius_y){
+    /*
+    Overlap-add: sample p of the tile of block b holds the contribution of
+    that block to the extended coordinate b * block - radius + p.
+    */
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= rows) return;
+
+    int ex = x + 2 * radius_x;
+    int ey = y + halo_top + radius_y;
+    float sum = 0.0f;
+
+    for (int by = ey / block_y ; by >= ey / block_y - 1 ; by--){
+        int py = ey - by * block_y;
+        if (by < 0 || by >= tiles_y || py >= tile_size) continue;
+        for (int bx = ex / block_x ; bx >= ex / block_x - 1 ; bx--){
+            int px = ex - bx * block_x;
+            if (bx < 0 || bx >= tiles_x || px >= tile_size) continue;
+            sum += tiles[((by * tiles_x + bx) * tile_size + py) * tile_size + px].x;
+        }
+    }
+    output_image[y * width + x] = convert_uchar_sat_rte(sum);
+}
+
+__kernel void fir_columns(global const float* input,
+                          global float* output,
+                          global uchar* byte_output,
+                          global const float* weights,
+                          int radius,
+                          int columns,
+                          int length,
+                          int out_start,
+                          int out_rows,
+                          int border_mode,
+                          float constant_value){
+    /*
+    1D convolution by the 2 * radius + 1 weights down the column
+    get_global_id(0), from input to output. When out_rows > 0 only the rows
+    [out_start, out_start + out_rows) are computed, and written to
+    byte_output.
+    */
+    int c = get_global_id(0);
+    if (c >= columns) return;
+
+    global const float* line = input + c;
+    int first = (out_rows > 0) ? out_start : 0;
+    int last = (out_rows > 0) ? out_start + out_rows : length;
+
+    for (int n = first ; n < last ; n++){
+        float sum = 0.0f;
+        for (int k = -radius ; k <= radius ; k++){
+            sum += weights[k + radius] * box_value(line, columns, length, n + k, border_mode, constant_value);
+        }
+
+        if (out_rows > 0){
+            byte_output[(n - out_start) * columns + c] = convert_uchar_sat_rte(sum);
+        } else {
+            output[n * columns + c] = sum;
+        }
+    }
+}
+
+__kernel void fir_unsharp_columns(global const float* input,
+                                  global const uchar* original,
+                                  global uchar* byte_output,
+                                  global const float* weights,
+                                  int radius,
+                                  int columns,
+                                  int length,
+                                  int out_start,
+                                  int out_rows,
+                                  int border_mode,
+                                  float constant_value,
+                                  float amount,
+                                  float threshold){
+    /*
+    Columns pass of fir_columns whose store stage sharpens instead of
+    blurring: original + amount * (original - blur), original being the
+    slice uploaded in the same layout as input. The pixels whose difference
+    with the blur is below threshold are kept unchanged.
+    */
+    int c = get_global_id(0);
+    if (c >= columns) return;
+
+    global const float* line = input + c;
+    for (int n = out_start ; n < out_start + out_rows ; n++){
+        float sum = 0.0f;
+        for (int k = -radius ; k <= radius ; k++){
+            sum += weights[k + radius] * box_value(line, columns, length, n + k, border_mode, constant_value);
+        }
+
+        float value = original[n * columns + c];
+        float difference = value - sum;
+        if (fabs(difference) >= threshold) value += amount * difference;
+        byte_output[(n - out_start) * columns + c] = convert_uchar_sat_rte(value);
+    }
+}
+
+__kernel void vhgw_columns(global const float* input,
+                           global float* output,
+                           global uchar* byte_output,
+                           global float* prefix,
+                           int radius,
+                           int columns,
+                           int length,
+                           int out_start,
+                           int out_rows,
+                           int border_mode,
+                           float constant_value,
+                           int dilate){
+    /*
+    Running minimum (erosion) or maximum (dilation, dilate != 0) over the
+    2 * radius + 1 rows around each row of the column get_global_id(0), van
+    Herk / Gil-Werman: the padded column is cut in blocks of the window
+    size, prefix holds the running extremum from the start of each block and
+    the one from the end of each block is kept while walking back, every
+    window being the union of the tail of a block and the head of the next.
+    Three comparisons per pixel whatever the radius. prefix is
+    (length + 2 * radius) x columns; outputs as in fir_columns.
+    */
+    int c = get_global_id(0);
+    if (c >= columns) return;
+
+    global const float* line = input + c;
+    int window = 2 * radius + 1;
+    int padded = length + 2 * radius;
+
+    float running = 0.0f;
+    for (int p = 0 ; p < padded ; p++){
+        float value = box_value(line, columns, length, p - radius, border_mode, constant_value);
+        running = (p % window == 0) ? value : (dilate ? fmax(running, value) : fmin(running, value));
+        prefix[p * columns + c] = running;
+    }
+
+    int first = (out_rows > 0) ? out_start : 0;
+    int last = (out_rows > 0) ? out_start + out_rows : length;
+    for (int p = padded - 1 ; p >= first ; p--){
+        float value = box_value(line, columns, length, p - radius, border_mode, constant_value);
+        running = (p % window == window - 1 || p == padded - 1) ? value
+                : (dilate ? fmax(running, value) : fmin(running, value));
+        if (p >= last) continue;
+
+        float tail = prefix[(p + 2 * radius) * columns + c];
+        float result = dilate ? fmax(running, tail) : fmin(running, tail);
+        if (out_rows > 0){
+            byte_output[(p - out_start) * columns + c] = convert_uchar_sat_rte(result);
+        } else {
+            output[p * columns + c] = result;
+        }
+    }
+}
+
+/*
+Batched blur of regions of interest (privacy redaction). The regions are
+packed one after the other, each with a halo of radius pixels on every side
+already filled by the host following the border mode. regions holds
+REGION_FIELDS ints per region: offsets of its patch, of its horizontally
+blurred rows and of its output, then its width and height. The work-items
+are spread over the pixels of all the regions, each one finds its region by
+a binary search on the offsets.
+*/
+#define REGION_FIELDS 5
+#define REGION_PATCH 0
+#define REGION_ROWS 1
+#define REGION_OUTPUT 2
+#define REGION_WIDTH 3
+#define REGION_HEIGHT 4
+
+int find_entry(global const int* table, int count, int stride, int field, int index){
+    // Last entry of the table (stride ints each) whose field is <= index
+    int low = 0, high = count - 1;
+    while (low < high){
+        int mid = (low + high + 1) / 2;
+        if (table[mid * stride + field] <= index) low = mid;
+        else high = mid - 1;
+    }
+    return low;
+}
+
+__kernel void region_blur_rows(global const uchar* patches,
+                               global float* rows,
+                               global const int* regions,
+                               global const float* weights,
+                               int radius,
+                               int num_regions,
+                               int total){
+    // Horizontal pass: width x (height + 2 * radius) values per region
+    int i = get_global_id(0);
+    if (i >= total) return;
+
+    global const int* region = regions + find_entry(regions, num_regions, REGION_FIELDS, REGION_ROWS, i) * REGION_FIELDS;
+    int width = region[REGION_WIDTH];
+    int index = i - region[REGION_ROWS];
+    int x = index % width;
+    int y = index / width;
+
+    global const uchar* line = patches + region[REGION_PATCH] + y * (width + 2 * radius) + x;
+    float sum = 0.0f;
+    for (int k = 0 ; k <= 2 * radius ; k++){
+        sum += weights[k] * line[k];
+    }
+    rows[i] = sum;
+}
+
+__kernel void region_blur_columns(global const float* rows,
+                                  global uchar* output,
+                                  global const int* regions,
+                                  global const float* weights,
+                                  int radius,
+                                  int num_regions,
+                                  int total){
+    // Vertical pass: width x height bytes per region
+    int i = get_global_id(0);
+    if (i >= total) return;
+
+    global const int* region = regions + find_entry(regions, num_regions, REGION_FIELDS, REGION_OUTPUT, i) * REGION_FIELDS;
+    int width = region[REGION_WIDTH];
+    int index = i - region[REGION_OUTPUT];
+    int x = index % width;
+    int y = index / width;
+
+    global const float* column = rows + region[REGION_ROWS] + y * width + x;
+    float sum = 0.0f;
+    for (int k = 0 ; k <= 2 * radius ; k++){
+        sum += weights[k] * column[k * width];
+    }
+    output[i] = convert_uchar_sat_rte(sum);
+}
+
+/*
+Direct blur of a ragged batch of images packed one after the other. table
+holds BATCH_FIELDS ints per image: offset of its pixels, width, height and
+first work-group. Each work-group finds its image in the table and
+processes get_local_size(0) consecutive pixels of it, so a single launch
+covers images of any sizes.
+*/
+#define BATCH_FIELDS 4
+#define BATCH_OFFSET 0
+#define BATCH_WIDTH 1
+#define BATCH_HEIGHT 2
+#define BATCH_FIRST_GROUP 3
+
+__kernel void gaussian_blur_batch(global const uchar* images,
+                                  global uchar* output_images,
+                                  global const float* gaussian_kernel,
+                                  global const int* table,
+                                  int num_images,
+                                  int border_mode,
+                                  uchar constant_value){
+    int group = get_group_id(0);
+    global const int* entry = table + find_entry(table, num_images, BATCH_FIELDS, BATCH_FIRST_GROUP, group) * BATCH_FIELDS;
+    int width = entry[BATCH_WIDTH];
+    int height = entry[BATCH_HEIGHT];
+    int index = (group - entry[BATCH_FIRST_GROUP]) * get_local_size(0) + get_local_id(0);
+    if (index >= width * height) return;
+
+    int x = index % width;
+    int y = index / width;
+    global const uchar* image = images + entry[BATCH_OFFSET];
+    global uchar* output_image = output_images + entry[BATCH_OFFSET];
+
+    bool inside = x >= RADIUS && x < width - RADIUS && y >= RADIUS && y < height - RADIUS;
+    if (!inside && border_mode == BORDER_COPY){
+        output_image[index] = image[index];
+        return;
+    }
+
+    float sum = 0.0f;
+    for (int j = -RADIUS ; j <= RADIUS ; j++){
+        int ny = remap_coordinate(y + j, height, border_mode);
+        for (int i = -RADIUS ; i <= RADIUS ; i++){
+            int nx = remap_coordinate(x + i, width, border_mode);
+            uchar value = (nx < 0 || ny < 0) ? constant_value : image[ny * width + nx];
+            sum += gaussian_kernel[(j + RADIUS) * DIM + (i + RADIUS)] * value;
+        }
+    }
+    output_image[index] = (uchar)sum;
+}
+
+/*
+One level of a Gaussian pyramid: 5-tap binomial blur and decimation by 2 in
+a single pass. All the levels live in the same buffer at the given offsets,
+so the pyramid is built without leaving the device. The columns are summed
+first, like the host engine, so both give the same bytes.
+*/
+constant float pyramid_weights[5] = {0.0625f, 0.25f, 0.375f, 0.25f, 0.0625f};
+
+__kernel void pyramid_reduce(global uchar* pyramid,
+                             int src_offset,
+                             int src_width,
+                             int src_height,
+                             int dst_offset,
+                             int dst_width,
+                             int dst_height,
+                             int border_mode,
+                             uchar constant_value){
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_width || y >= dst_height) return;
+
+    global const uchar* src = pyramid + src_offset;
+    int rows[5];
+    for (int j = 0 ; j < 5 ; j++){
+        rows[j] = remap_coordinate(2 * y + j - 2, src_height, border_mode);
+    }
+
+    float sum = 0.0f;
+    for (int i = 0 ; i < 5 ; i++){
+        int sx = remap_coordinate(2 * x + i - 2, src_width, border_mode);
+        float column = 0.0f;
+        for (int j = 0 ; j < 5 ; j++){
+            float value = (sx < 0 || rows[j] < 0) ? constant_value : src[rows[j] * src_width + sx];
+            column += pyramid_weights[j] * value;
+        }
+        sum += pyramid_weights[i] * column;
+    }
+    pyramid[dst_offset + y * dst_width + x] = convert_uchar_sat(sum + 0.5f);  // halves rounded up, as on the host
+}
+
+__kernel void scale_space_outputs(global const float* level,
+                                  global const float* previous,
+                                  global uchar* bytes,
+                                  global float* dog,
+                                  int pixels,
+                                  int byte_offset,
+                                  int dog_offset){
+    /*
+    Outputs of one level of a scale space: its rounded bytes and, when
+    dog_offset >= 0, the difference of Gaussians with the previous level,
+    computed from the float levels in the same pass.
+    */
+    int i = get_global_id(0);
+    if (i >= pixels) return;
+
+    float value = level[i];
+    bytes[byte_offset + i] = convert_uchar_sat_rte(value);
+    if (dog_offset >= 0){
+        dog[dog_offset + i] = value - previous[i];
+    }
+}
+
+/*
+Canny edge detector on the image blurred by the separable engine.
+fir_sobel_columns is the last blur pass with the Sobel operator folded into
+its store: it writes the magnitude and the direction quantized to
+four sectors, the smoothed image never reaches global memory.
+canny_suppress keeps the local maxima along the gradient and classifies them
+with the two thresholds; canny_hysteresis promotes the weak edges touching a
+strong one (8-connectivity) until nothing changes, and canny_finish drops
+the weak edges left. Twin of CPUBlurProcessor::detectEdges().
+*/
+#define EDGE_NONE 0
+#define EDGE_WEAK 128
+#define EDGE_STRONG 255
+#define TAN_22_5 0.41421356f
+
+float fir_column_value(global const float* input, global const float* weights, int radius, int columns,
+                       int length, int c, int n, int border_mode, float constant_value){
+    // Value of fir_columns at (c, n), coordinates outside the image following the border policy
+    int sc = remap_coordinate(c, columns, border_mode);
+    int sn = remap_coordinate(n, length, border_mode);
+    if (sc < 0 || sn < 0) return constant_value;
+
+    global const float* line = input + sc;
+    float sum = 0.0f;
+    for (int k = -radius ; k <= radius ; k++){
+        sum += weights[k + radius] * box_value(line, columns, length, sn + k, border_mode, constant_value);
+    }
+    return sum;
+}
+
+__kernel void fir_sobel_columns(global const float* input,
+                                global float* magnitude,
+                                global uchar* direction,
+                                global const float* weights,
+                                int radius,
+                                int width,
+                                int height,
+                                int border_mode,
+                                float constant_value){
+    /*
+    The work-item of column x walks down the image like fir_columns, but
+    blurs the columns x - 1, x and x + 1 and keeps their last three rows:
+    p[j][i] is the smoothed value at (x + i - 1, y + j - 1). The neighbouring
+    columns are blurred again by each work-item, three times the FIR work
+    against one write and nine reads of a float image less.
+    */
+    int x = get_global_id(0);
+    if (x >= width) return;
+
+    float p[3][3];
+    for (int j = 1 ; j < 3 ; j++){
+        for (int i = 0 ; i < 3 ; i++){
+            p[j][i] = fir_column_value(input, weights, radius, width, height, x + i - 1, j - 2,
+                                       border_mode, constant_value);
+        }
+    }
+
+    for (int y = 0 ; y < height ; y++){
+        for (int i = 0 ; i < 3 ; i++){
+            p[0][i] = p[1][i];
+            p[1][i] = p[2][i];
+            p[2][i] = fir_column_value(input, weights, radius, width, height, x + i - 1, y + 1,
+                                       border_mode, constant_value);
+        }
+
+        float gx = (p[0][2] + 2.0f * p[1][2] + p[2][2]) - (p[0][0] + 2.0f * p[1][0] + p[2][0]);
+        float gy = (p[2][0] + 2.0f * p[2][1] + p[2][2]) - (p[0][0] + 2.0f * p[0][1] + p[0][2]);
+
+        // 0: horizontal gradient, 1: down-right diagonal, 2: vertical, 3: down-left diagonal
+        float ax = fabs(gx), ay = fabs(gy);
+        uchar sector;
+        if (ay <= ax * TAN_22_5) sector = 0;
+        else if (ax <= ay * TAN_22_5) sector = 2;
+        else sector = (gx * gy > 0.0f) ? 1 : 3;
+
+        magnitude[y * width + x] = sqrt(gx * gx + gy * gy);
+        direction[y * width + x] = sector;
+    }
+}
+
+__kernel void canny_suppress(global const float* magnitude,
+                             global const uchar* direction,
+                             global uchar* edges,
+                             int width,
+                             int height,
+                             float low_threshold,
+                             float high_threshold){
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    const int dx[4] = {1, 1, 0, -1};
+    const int dy[4] = {0, 1, 1, 1};
+    int sector = direction[y * width + x];
+    float m = magnitude[y * width + x];
+
+    // Neighbours along the gradient, outside the image they are not edges
+    int ax = x + dx[sector], ay = y + dy[sector];
+    int bx = x - dx[sector], by = y - dy[sector];
+    float after = (ax >= 0 && ax < width && ay < height) ? magnitude[ay * width + ax] : 0.0f;
+    float before = (bx >= 0 && bx < width && by >= 0) ? magnitude[by * width + bx] : 0.0f;
+
+    uchar label = EDGE_NONE;
+    if (m > before && m >= after && m >= low_threshold){
+        label = (m >= high_threshold) ? EDGE_STRONG : EDGE_WEAK;
+    }
+    edges[y * width + x] = label;
+}
+
+__kernel void canny_hysteresis(global uchar* edges,
+                               int width,
+                               int height,
+                               global int* changed){
+    /*
+    One propagation step. Pixels only go from weak to strong, so reading a
+    neighbour promoted during the same launch is harmless.
+    */
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height || edges[y * width + x] != EDGE_WEAK) return;
+
+    for (int j = max(y - 1, 0) ; j <= min(y + 1, height - 1) ; j++){
+        for (int i = max(x - 1, 0) ; i <= min(x + 1, width - 1) ; i++){
+            if (edges[j * width + i] == EDGE_STRONG){
+                edges[y * width + x] = EDGE_STRONG;
+                *changed = 1;
+                return;
+            }
+        }
+    }
+}
+
+__kernel void canny_finish(global uchar* edges, int pixels){
+    int i = get_global_id(0);
+    if (i < pixels && edges[i] != EDGE_STRONG) edges[i] = EDGE_NONE;
+}
+
+/*
+Bilateral filter as a bilateral grid (see GaussianBlurProcessor::bilateralGrid
+for its geometry). bilateral_splat gives each (x, y) cell to one work-item,
+which gathers the pixels rounding to it, so no atomics are needed; the grid
+is then [z][value, weight][y][x]. After the three FIR passes the host runs on
+it, the grid is [y][x][z] (value, weight) and bilateral_slice interpolates it
+trilinearly at every pixel.
+*/
+__kernel void bilateral_splat(global const uchar* image,
+                              global float* grid,
+                              int width,
+                              int height,
+                              float spatial_scale,
+                              float range_scale,
+                              int grid_width,
+                              int grid_height,
+                              int grid_depth,
+                              int padding){
+    int cx = get_global_id(0);
+    int cy = get_global_id(1);
+    if (cx >= grid_width || cy >= grid_height) return;
+
+    int plane = grid_width * grid_height;
+    int cell = cy * grid_width + cx;
+    for (int z = 0 ; z < 2 * grid_depth ; z++){
+        grid[z * plane + cell] = 0.0f;
+    }
+
+    // Pixels whose nearest cell may be this one, one more on each side for the rounding of the division
+    int x0 = max(0, (int)floor((cx - padding - 0.5f) / spatial_scale) - 1);
+    int x1 = min(width - 1, (int)ceil((cx - padding + 0.5f) / spatial_scale) + 1);
+    int y0 = max(0, (int)floor((cy - padding - 0.5f) / spatial_scale) - 1);
+    int y1 = min(height - 1, (int)ceil((cy - padding + 0.5f) / spatial_scale) + 1);
+
+    for (int y = y0 ; y <= y1 ; y++){
+        if ((int)(y * spatial_scale + 0.5f) + padding != cy) continue;
+        for (int x = x0 ; x <= x1 ; x++){
+            if ((int)(x * spatial_scale + 0.5f) + padding != cx) continue;
+            float value = image[y * width + x];
+            int z = (int)(value * range_scale + 0.5f) + padding;
+            grid[2 * z * plane + cell] += value;
+            grid[(2 * z + 1) * plane + cell] += 1.0f;
+        }
+    }
+}
+
+__kernel void bilateral_slice(global const uchar* image,
+                              global const float2* grid,
+                              global uchar* output,
+                              int width,
+                              int height,
+                              float spatial_scale,
+                              float range_scale,
+                              int grid_width,
+                              int grid_depth,
+                              int padding){
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    float value = image[y * width + x];
+    float fx = x * spatial_scale + padding;
+    float fy = y * spatial_scale + padding;
+    float fz = value * range_scale + padding;
+    int ix = (int)fx, iy = (int)fy, iz = (int)fz;
+    float wx = fx - ix, wy = fy - iy, wz = fz - iz;
+
+    float2 sum = (float2)(0.0f, 0.0f);
+    for (int dy = 0 ; dy <= 1 ; dy++){
+        for (int dx = 0 ; dx <= 1 ; dx++){
+            global const float2* column = grid + ((iy + dy) * grid_width + ix + dx) * grid_depth + iz;
+            float weight = (dy ? wy : 1.0f - wy) * (dx ? wx : 1.0f - wx);
+            sum += weight * ((1.0f - wz) * column[0] + wz * column[1]);
+        }
+    }
+    output[y * width + x] = (sum.y > 0.0f) ? convert_uchar_sat(sum.x / sum.y + 0.5f) : convert_uchar(value);  // as on the host
+}
+
+/*
+Median of the (2 radius + 1)^2 window of the image found at offset in the
+packed images of a batch, both coordinates following the border mode.
+3x3 and 5x5 windows go through data-independent compare-exchange networks
+held in registers: the optimal 19 exchange network for 9 values, and for
+25 a selection network that only orders the 13 smallest values. Larger
+windows find the median bit by bit, counting the samples below each
+candidate.
+*/
+#define MEDIAN_SORT(a, b) { uchar t = min(a, b); b = max(a, b); a = t; }
+
+uchar median_sample(global const uchar* image, int width, int height, int x, int y, int border_mode, uchar constant_value){
+    int sx = remap_coordinate(x, width, border_mode);
+    int sy = remap_coordinate(y, height, border_mode);
+    return (sx < 0 || sy < 0) ? constant_value : image[sy * width + sx];
+}
+
+__kernel void median_filter(global const uchar* images,
+                            global uchar* outputs,
+                            int offset,
+                            int width,
+                            int height,
+                            int radius,
+                            int border_mode,
+                            uchar constant_value){
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+    global const uchar* image = images + offset;
+
+    uchar median;
+    if (radius == 1){
+        uchar p[9];
+        for (int j = 0 ; j < 3 ; j++){
+            for (int i = 0 ; i < 3 ; i++) p[j * 3 + i] = median_sample(image, width, height, x + i - 1, y + j - 1, border_mode, constant_value);
+        }
+        MEDIAN_SORT(p[1], p[2]); MEDIAN_SORT(p[4], p[5]); MEDIAN_SORT(p[7], p[8]);
+        MEDIAN_SORT(p[0], p[1]); MEDIAN_SORT(p[3], p[4]); MEDIAN_SORT(p[6], p[7]);
+        MEDIAN_SORT(p[1], p[2]); MEDIAN_SORT(p[4], p[5]); MEDIAN_SORT(p[7], p[8]);
+        MEDIAN_SORT(p[0], p[3]); MEDIAN_SORT(p[5], p[8]); MEDIAN_SORT(p[4], p[7]);
+        MEDIAN_SORT(p[3], p[6]); MEDIAN_SORT(p[1], p[4]); MEDIAN_SORT(p[2], p[5]);
+        MEDIAN_SORT(p[4], p[7]); MEDIAN_SORT(p[4], p[2]); MEDIAN_SORT(p[6], p[4]);
+        MEDIAN_SORT(p[4], p[2]);
+        median = p[4];
+    } else if (radius == 2){
+        uchar p[25];
+        for (int j = 0 ; j < 5 ; j++){
+            for (int i = 0 ; i < 5 ; i++) p[j * 5 + i] = median_sample(image, width, height, x + i - 2, y + j - 2, border_mode, constant_value);
+        }
+        #pragma unroll
+        for (int i = 0 ; i <= 12 ; i++){
+            #pragma unroll
+            for (int j = i + 1 ; j < 25 ; j++) MEDIAN_SORT(p[i], p[j]);
+        }
+        median = p[12];
+    } else {
+        int half = (2 * radius + 1) * (2 * radius + 1) / 2;
+        int result = 0;
+        for (int bit = 128 ; bit > 0 ; bit >>= 1){
+            int candidate = result | bit;
+            int below = 0;
+            for (int j = -radius ; j <= radius ; j++){
+                for (int i = -radius ; i <= radius ; i++){
+                    below += median_sample(image, width, height, x + i, y + j, border_mode, constant_value) < candidate;
+                }
+            }
+            if (below <= half) result = candidate;
+        }
+        median = (uchar)result;
+    }
+    outputs[offset + y * width + x] = median;
+}
+
+/*
+Summed-area tables: sums[(y + 1) * (width + 1) + x + 1] is the sum of the
+pixels of [0, x] x [0, y], the first row and column being zero, and squares
+the same for the squared pixels when with_squares is set. sums wraps
+around in 32 bits, the differences giving the sum of a window stay exact.
+sat_rows gives every row to a work-group, which scans chunks of twice its
+size in local memory (Blelloch up-sweep and down-sweep) and carries the
+total of the chunk to the next one; sat_columns then accumulates down the
+columns, one work-item per column so the accesses of a row are coalesced.
+*/
+#define STAT_MEAN 0
+#define STAT_STDDEV 1
+#define STAT_CONTRAST 2
+#define CONTRAST_SCALE 32.0f        // same values as gaussian_blur_processor.h
+#define CONTRAST_EPSILON 1.0f
+
+__kernel void sat_rows(global const uchar* image,
+                       global uint* sums,
+                       global ulong* squares,
+                       int width,
+                       int with_squares,
+                       local uint* scan,
+                       local ulong* scan_squares){
+    int y = get_group_id(0);
+    int lid = get_local_id(0);
+    int n = 2 * get_local_size(0);
+    int pitch = width + 1;
+    global const uchar* row = image + y * width;
+
+    if (lid == 0){
+        sums[(y + 1) * pitch] = 0;
+        if (with_squares) squares[(y + 1) * pitch] = 0;
+    }
+
+    uint carry = 0;
+    ulong carry_squares = 0;
+    for (int start = 0 ; start < width ; start += n){
+        for (int k = 2 * lid ; k <= 2 * lid + 1 ; k++){
+            uint value = (start + k < width) ? row[start + k] : 0;
+            scan[k] = value;
+            if (with_squares) scan_squares[k] = value * value;
+        }
+
+        int offset = 1;
+        for (int d = n >> 1 ; d > 0 ; d >>= 1){
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if (lid < d){
+                int a = offset * (2 * lid + 1) - 1;
+                int b = offset * (2 * lid + 2) - 1;
+                scan[b] += scan[a];
+                if (with_squares) scan_squares[b] += scan_squares[a];
+            }
+            offset <<= 1;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        uint total = scan[n - 1];
+        ulong total_squares = with_squares ? scan_squares[n - 1] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid == 0){
+            scan[n - 1] = 0;
+            if (with_squares) scan_squares[n - 1] = 0;
+        }
+
+        for (int d = 1 ; d < n ; d <<= 1){
+            offset >>= 1;
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if (lid < d){
+                int a = offset * (2 * lid + 1) - 1;
+                int b = offset * (2 * lid + 2) - 1;
+                uint t = scan[a];
+                scan[a] = scan[b];
+                scan[b] += t;
+                if (with_squares){
+                    ulong u = scan_squares[a];
+                    scan_squares[a] = scan_squares[b];
+                    scan_squares[b] += u;
+                }
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Exclusive scan + own value: inclusive prefix of the row
+        for (int k = 2 * lid ; k <= 2 * lid + 1 ; k++){
+            int x = start + k;
+            if (x >= width) continue;
+            uint value = row[x];
+            sums[(y + 1) * pitch + x + 1] = carry + scan[k] + value;
+            if (with_squares) squares[(y + 1) * pitch + x + 1] = carry_squares + scan_squares[k] + value * value;
+        }
+        carry += total;
+        carry_squares += total_squares;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+__kernel void sat_columns(global uint* sums,
+                          global ulong* squares,
+                          int width,
+                          int height,
+                          int with_squares){
+    int c = get_global_id(0);
+    int pitch = width + 1;
+    if (c >= pitch) return;
+
+    uint sum = 0;
+    ulong sum_squares = 0;
+    sums[c] = 0;
+    if (with_squares) squares[c] = 0;
+    for (int y = 1 ; y <= height ; y++){
+        sum += sums[y * pitch + c];
+        sums[y * pitch + c] = sum;
+        if (with_squares){
+            sum_squares += squares[y * pitch + c];
+            squares[y * pitch + c] = sum_squares;
+        }
+    }
+}
+
+__kernel void sat_statistics(global const uchar* image,
+                             global const uint* sums,
+                             global const ulong* squares,
+                             global uchar* output,
+                             int width,
+                             int height,
+                             int radius_x,
+                             int radius_y,
+                             int statistic){
+    /*
+    Mean, standard deviation or contrast normalized value ((pixel - mean) /
+    deviation, scaled by CONTRAST_SCALE around 128) of the window of each
+    pixel, clipped to the image, from four reads of each table.
+    */
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    int pitch = width + 1;
+    int x0 = max(x - radius_x, 0), x1 = min(x + radius_x + 1, width);
+    int y0 = max(y - radius_y, 0), y1 = min(y + radius_y + 1, height);
+    float count = (x1 - x0) * (y1 - y0);
+
+    uint sum = sums[y1 * pitch + x1] - sums[y0 * pitch + x1] - sums[y1 * pitch + x0] + sums[y0 * pitch + x0];
+    float mean = sum / count;
+    if (statistic == STAT_MEAN){
+        output[y * width + x] = convert_uchar_sat_rte(mean);
+        return;
+    }
+
+    ulong sum_squares = squares[y1 * pitch + x1] - squares[y0 * pitch + x1]
+                      - squares[y1 * pitch + x0] + squares[y0 * pitch + x0];
+    float deviation = sqrt(fmax(sum_squares / count - mean * mean, 0.0f));
+    float value = (statistic == STAT_STDDEV) ? deviation
+                : 128.0f + CONTRAST_SCALE * (image[y * width + x] - mean) / (deviation + CONTRAST_EPSILON);
+    output[y * width + x] = convert_uchar_sat_rte(value);
+}
+
+/*
+Non-local means (same algorithm as CImg's plugins/nlmeans.h), one search
+offset (dx, dy) at a time: nlmeans_rows sums along every row the squared
+differences between the image and its shifted copy over the 2 p + 1
+columns of a patch, nlmeans_columns then walks down the 2 p + 1 rows of
+the patch of every pixel whose neighbour passes the pre-selection on the
+blurred guide, adding one weight per row on the distance of the rows so
+far as the plugin does. Positions whose pixel or neighbour falls outside
+the image count for 0, as in the plugin. The offset (0, 0) is not
+accumulated: nlmeans_finish gives the pixel itself the largest weight.
+*/
+uint nlmeans_difference(global const uchar* image, int width, int height, int x, int y, int dx, int dy){
+    int nx = x + dx, ny = y + dy;
+    if (x < 0 || x >= width || nx < 0 || nx >= width || ny < 0 || ny >= height) return 0;
+    int d = (int)image[ny * width + nx] - (int)image[y * width + x];
+    return d * d;
+}
+
+__kernel void nlmeans_rows(global const uchar* image,
+                           global uint* row_sums,
+                           int width,
+                           int height,
+                           int dx,
+                           int dy,
+                           int patch_radius,
+                           local uint* differences){
+    /*
+    A work-group covers get_local_size(0) pixels of the row get_global_id(1).
+    The squared differences of those pixels and of patch_radius columns on
+    each side are computed once into local memory, neighbouring work-items
+    reading neighbouring bytes, then every work-item sums its 2 p + 1 of them.
+    */
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    int lx = get_local_id(0);
+    int group = get_local_size(0);
+    int x0 = get_group_id(0) * group - patch_radius;
+
+    for (int i = lx ; i < group + 2 * patch_radius ; i += group){
+        differences[i] = nlmeans_difference(image, width, height, x0 + i, y, dx, dy);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (x >= width) return;
+
+    uint sum = 0;
+    for (int k = 0 ; k <= 2 * patch_radius ; k++) sum += differences[lx + k];
+    row_sums[y * width + x] = sum;
+}
+
+__kernel void nlmeans_columns(global const uchar* image,
+                              global const uint* row_sums,
+                              global const float* guide,
+                              global float* weighted_sum,
+                              global float* weight_sum,
+                              global float* max_weight,
+                              int width,
+                              int height,
+                              int dx,
+                              int dy,
+                              int patch_radius,
+                              float h2,
+                              float deviation,
+                              int first){
+    // The offset (0, 0) only initializes the sums, which first does for any offset
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    int i = y * width + x;
+    if (first){
+        weighted_sum[i] = 0.0f;
+        weight_sum[i] = 0.0f;
+        max_weight[i] = -1.0f;
+    }
+    int nx = x + dx, ny = y + dy;
+    if ((dx == 0 && dy == 0) || nx < 0 || nx >= width || ny < 0 || ny >= height) return;
+    int j = ny * width + nx;
+    if (!(fabs(guide[i] - guide[j]) / deviation < 3.0f)) return;
+
+    float value = image[j];
+    float sum = weighted_sum[i], total = weight_sum[i], largest = max_weight[i];
+    uint distance = 0;
+    for (int k = -patch_radius ; k <= patch_radius ; k++){
+        if (y + k >= 0 && y + k < height) distance += row_sums[i + k * width];
+        float w = exp(distance * h2);
+        sum += w * value;
+        total += w;
+        largest = fmax(largest, w);
+    }
+    weighted_sum[i] = sum;
+    weight_sum[i] = total;
+    max_weight[i] = largest;
+}
+
+__kernel void nlmeans_finish(global const uchar* image,
+                             global const float* weighted_sum,
+                             global const float* weight_sum,
+                             global const float* max_weight,
+                             global uchar* output,
+                             int pixels){
+    // The pixel itself weighs as much as its most similar neighbour, the result is truncated like the plugin's
+    int i = get_global_id(0);
+    if (i >= pixels) return;
+    float sum = weight_sum[i] + max_weight[i];
+    float value = (sum != 0.0f) ? (weighted_sum[i] + max_weight[i] * image[i]) / sum : image[i];
+    output[i] = convert_uchar_sat(value);
+}
+
+/*
+Demosaic of raw Bayer data (CImg's BayertoRGB(), bilinear and edge directed
+types) as the first stage of the separable blur. pattern is a BayerPattern:
+bit 0 moves the red sites one column, bit 1 one row, so px == py == 0 on the
+red sites. The missing greens are the mean of the 4 green neighbours, edge
+directed weighting them by 1 / (1 + squared difference) horizontally and
+vertically. Red and blue next to a site of theirs average the two sites,
+on the opposite colour they average the diagonals or, edge directed,
+interpolate the values of the 4 green neighbours the same way. The samples
+are scaled to [0, 255] in float (no truncation between the stages) and the
+mosaic is reflected without repeating the edge, which keeps its parity.
+*/
+float bayer_sample(global const uchar* raw, int x, int y, int width, int height, int sample_bytes, float scale){
+    x = (x < 0) ? -x : ((x >= width) ? 2 * width - 2 - x : x);
+    y = (y < 0) ? -y : ((y >= height) ? 2 * height - 2 - y : y);
+    int i = y * width + x;
+    return scale * ((sample_bytes == 2) ? ((global const ushort*)raw)[i] : raw[i]);
+}
+
+float edge_directed(float left, float right, float up, float down){
+    float cx = 1.0f / (1.0f + (right - left) * (right - left));
+    float cy = 1.0f / (1.0f + (down - up) * (down - up));
+    return (cx * (left + right) + cy * (up + down)) / (2.0f * (cx + cy));
+}
+
+// Sample at an offset of the pixel (x, y) of bayer_green() and bayer_chroma()
+#define S(dx, dy) bayer_sample(raw, x + (dx), y + (dy), width, height, sample_bytes, scale)
+
+float bayer_green(global const uchar* raw, int x, int y, int width, int height, int sample_bytes, float scale,
+                  int px, int py, int edge){
+    if (px != py) return S(0, 0);
+    if (edge) return edge_directed(S(-1, 0), S(1, 0), S(0, -1), S(0, 1));
+    return 0.25f * (S(-1, 0) + S(1, 0) + S(0, -1) + S(0, 1));
+}
+
+float bayer_chroma(global const uchar* raw, int x, int y, int width, int height, int sample_bytes, float scale,
+                   int px, int py, int edge){
+    // Red with the parity of the red sites, blue with the inverted parity
+    if (!px && !py) return S(0, 0);
+    if (!py) return 0.5f * (S(-1, 0) + S(1, 0));
+    if (!px) return 0.5f * (S(0, -1) + S(0, 1));
+    if (edge) {
+        return edge_directed(0.5f * (S(-1, -1) + S(-1, 1)), 0.5f * (S(1, -1) + S(1, 1)),
+                             0.5f * (S(-1, -1) + S(1, -1)), 0.5f * (S(-1, 1) + S(1, 1)));
+    }
+    return 0.25f * (S(-1, -1) + S(1, -1) + S(-1, 1) + S(1, 1));
+}
+
+#undef S
+
+__kernel void bayer_demosaic(global const uchar* raw,
+                             global float* output,
+                             int width,
+                             int height,
+                             int sample_bytes,
+                             float scale,
+                             int pattern,
+                             int edge){
+    /*
+    Writes the transposed image read by the rows pass of the blur, the 3
+    colours of a pixel side by side: output[(x * height + y) * 3 + c].
+    get_global_id(0) runs along the columns of the image so that neighbouring
+    work-items write neighbouring floats.
+    */
+    int y = get_global_id(0);
+    int x = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    int px = (x + (pattern & 1)) & 1;
+    int py = (y + (pattern >> 1)) & 1;
+    global float* pixel = output + (x * height + y) * 3;
+    pixel[0] = bayer_chroma(raw, x, y, width, height, sample_bytes, scale, px, py, edge);
+    pixel[1] = bayer_green(raw, x, y, width, height, sample_bytes, scale, px, py, edge);
+    pixel[2] = bayer_chroma(raw, x, y, width, height, sample_bytes, scale, 1 - px, 1 - py, edge);
+}
+
+/*
+Antialiased resize: each pass resamples one axis with the antialiasing
+Gaussian built in its weights (GaussianBlurProcessor::resizeFilter), so the
+blur is never computed at the source resolution. Output sample i of an axis
+reads the taps source samples indices[table + i * taps + k] (-1: constant
+value) with weights[table + i * taps + k], table being the start of the
+taps of the axis. resize_rows goes from the source to float rows
+of the destination width, resize_columns from those rows to the bytes of
+the destination, written at output_offset.
+*/
+__kernel void resize_rows(global const uchar* input,
+                          global float* output,
+                          global const int* indices,
+                          global const float* weights,
+                          int table,
+                          int taps,
+                          int src_width,
+                          int height,
+                          int dst_width,
+                          float constant_value){
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_width || y >= height) return;
+
+    global const uchar* row = input + y * src_width;
+    float sum = 0.0f;
+    for (int k = table + x * taps ; k < table + (x + 1) * taps ; k++){
+        int i = indices[k];
+        sum += weights[k] * ((i < 0) ? constant_value : row[i]);
+    }
+    output[y * dst_width + x] = sum;
+}
+
+__kernel void resize_columns(global const float* input,
+                             global uchar* output,
+                             global const int* indices,
+                             global const float* weights,
+                             int table,
+                             int taps,
+                             int width,
+                             int dst_height,
+                             int output_offset,
+                             float constant_value){
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= dst_height) return;
+
+    float sum = 0.0f;
+    for (int k = table + y * taps ; k < table + (y + 1) * taps ; k++){
+        int i = indices[k];
+        sum += weights[k] * ((i < 0) ? constant_value : input[i * width + x]);
     }
+    output[output_offset + y * width + x] = convert_uchar_sat(sum + 0.5f);  // halves rounded up, as on the host
 }
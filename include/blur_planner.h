@@ -0,0 +1,45 @@
+#pragma once
+
+#include "gaussian_blur_processor.h"
+
+// Algorithm picked for one job, with the cost predicted for every candidate
+struct BlurPlan {
+    BlurAlgorithm algorithm;
+    double predicted_time;                  // seconds per image
+    double costs[BLUR_ALGORITHM_COUNT];     // seconds per image, -1 when not a candidate
+};
+
+/*
+Picks the fastest blur algorithm for a Gaussian job. The time of an
+algorithm on an image is modelled as
+    pixels * pixel_bytes * (fixed + unit * work(sigma))
+where work is the number of operations per pixel the algorithm does for
+that sigma (DIM^2 for the matrix, 2 (2r + 1) for the separable passes,
+log2 of the tile for the FFT, 1 for the recursive and box engines).
+fixed and unit are calibrated per device the first time it is planned, by
+timing every algorithm at two sigmas on the job image (sample, or a
+synthetic textured image without one), and kept as the cost records of the
+tuning database.
+Only 8-bit images exist today, pixel_bytes scales the calibrated costs for
+wider pixels.
+*/
+class BlurPlanner {
+public:
+    BlurPlanner(TuningDatabase& database);
+    void setAllowApproximate(bool allow);
+    template <typename Processor>
+    BlurPlan plan(Processor& processor, double sigma, int width, int height, int pixel_bytes = 1,
+        const unsigned char* sample = NULL);
+    static bool isCandidate(BlurAlgorithm algorithm, double sigma, bool allow_approximate);
+    static double workPerPixel(BlurAlgorithm algorithm, double sigma);
+    static const char* algorithmName(BlurAlgorithm algorithm);
+    static void printPlan(const BlurPlan& plan);
+
+private:
+    TuningDatabase& database;
+    bool allow_approximate;
+
+    template <typename Processor>
+    void calibrate(Processor& processor, const std::string& device, int width, int height,
+        const unsigned char* sample);
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "gaussian_blur_processor.h"
+#include <stdint.h>
+#include <complex>
+
+/*
+Host engine of the blur, multithreaded with OpenMP and vectorized along the
+rows. Same matrix, border modes and metrics as GaussianBlurProcessor, the
+whole image is processed by one call.
+*/
+class CPUBlurProcessor {
+    public:
+        CPUBlurProcessor(double sigma = 1.0);
+        void setBorderMode(BorderMode mode, unsigned char constant_value = 0);
+        void setSigma(double sigma);
+        void setAlgorithm(BlurAlgorithm algorithm, double predicted_time = 0);
+        BlurAlgorithm getAlgorithm() const;
+        std::string getDeviceKey() const;
+        void setFixedPoint(bool enabled);
+        void setCustomKernel(const std::vector<float>& weights, int kernel_width, int kernel_height);
+        void clearCustomKernel();
+        long getFFTBreakEven() const;
+        bool fixedPointAvailable() const;
+        int fixedPointErrorBound() const;
+        ProcessingMetrics processImage(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        ProcessingMetrics processUnsharp(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const UnsharpMask& unsharp);
+        ProcessingMetrics processBayer(const void* raw_data, int bits_per_sample, unsigned char* output_data,
+            int width, int height, BayerPattern pattern, DemosaicMethod method);
+        ProcessingMetrics summedAreaTable(const unsigned char* input_data, int width, int height,
+            std::vector<cl_uint>& sums, std::vector<cl_ulong>* squares = NULL);
+        ProcessingMetrics processLocalStatistic(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, LocalStatistic statistic, int radius_x, int radius_y);
+        ProcessingMetrics processMorphology(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, MorphologyOp op, int radius_x, int radius_y);
+        ProcessingMetrics processMedian(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, int radius);
+        ProcessingMetrics processBilateral(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, double spatial_sigma, double range_sigma);
+        ProcessingMetrics processNLMeans(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, int patch_radius, double sigma, double lambda = -1, double alpha = 3);
+        ProcessingMetrics detectEdges(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, float low_threshold, float high_threshold);
+        ProcessingMetrics processResize(const unsigned char* input_data, int width, int height,
+            std::vector<PyramidLevel>& sizes, std::vector<unsigned char>& outputs);
+        ProcessingMetrics buildPyramid(const unsigned char* input_data, int width, int height, int num_levels,
+            std::vector<unsigned char>& pyramid, std::vector<PyramidLevel>& levels);
+
+    private:
+        double sigma;
+        BlurAlgorithm algorithm;
+        double predicted_time;
+        std::vector<float> gaussian_kernel;
+        std::vector<cl_ushort> fixed_gaussian_kernel;
+        int fixed_point_error;
+        bool fixed_point;
+        BorderMode border_mode;
+        unsigned char border_constant;
+        std::vector<float> custom_kernel;
+        int custom_kernel_width, custom_kernel_height;
+        long fft_break_even_area;           // kernel area from which the FFT is faster, 0 until measured
+        int fft_measured_width, fft_measured_height;
+
+        void blurRow(const unsigned char* const* rows, unsigned char* output, int width, bool use_fixed,
+            const unsigned char* constant_row) const;
+        ProcessingMetrics processImageDirect(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        ProcessingMetrics processImageSeparable(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const UnsharpMask* unsharp = NULL);
+        void firColumns(const float* input, float* output, unsigned char* byte_output, int columns, int length,
+            const std::vector<float>& weights, const unsigned char* original = NULL,
+            const UnsharpMask* unsharp = NULL) const;
+        void vhgwColumns(const float* input, float* output, unsigned char* byte_output, int columns, int length,
+            int radius, bool dilate) const;
+        ProcessingMetrics processImageIIR(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        void iirColumns(float* data, unsigned char* output, int columns, int length, int pad) const;
+        ProcessingMetrics processImageBox(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        void boxColumns(const float* input, float* output, unsigned char* byte_output, int columns, int length,
+            int radius) const;
+        ProcessingMetrics processImageCustom(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        ProcessingMetrics processImageConvolution(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const std::vector<float>& weights, int kernel_width, int kernel_height, bool use_fft);
+        void measureFFTBreakEven(int width, int height);
+        static void fft2D(std::complex<float>* tile, int size, float direction);
+        template <typename T>
+        static void transpose(const T* input, float* output, int width, int height);
+};
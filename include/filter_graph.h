@@ -0,0 +1,91 @@
+#pragma once
+
+#include "gaussian_blur_processor.h"
+#include <sstream>
+
+// Operations of a FilterGraph node
+enum FilterOp {
+    OP_INPUT = 0,           // the image given to run(), 1 or 3 planar channels
+    OP_GRAYSCALE = 1,       // luma of a 3 channel input
+    OP_BLUR = 2,            // separable Gaussian (create_separable_kernel weights)
+    OP_UNSHARP = 3,         // a + amount * (a - b), b usually a blur of a
+    OP_THRESHOLD = 4,       // 255 where a >= level, 0 elsewhere
+    OP_LINEAR = 5           // a * gain + bias
+};
+
+/*
+Chain (or DAG) of image operations run on the device in one go. Nodes are
+added in order and only refer to earlier ones. run() generates OpenCL
+source for the live nodes:
+- every blur is two kernels (rows pass, columns pass), the pointwise
+  operations before it are inlined in the loads of its rows pass
+- the pointwise operations after the last blur are fused into its columns
+  pass, which writes the bytes of the output
+- a graph without blur is a single pointwise kernel
+The values stay in float on the device, the input is uploaded once and
+the output downloaded once. Intermediate buffers come from a pool, a buffer
+being reused as soon as its last reader has run. The graph runs in the
+context and queue of the GaussianBlurProcessor it is initialized with.
+*/
+class FilterGraph {
+    public:
+        FilterGraph();
+        ~FilterGraph();
+        void initializeOpenCL(const GaussianBlurProcessor& processor);
+        void setBorderMode(BorderMode mode, unsigned char constant_value = 0);
+
+        int input(int channels = 1);
+        int grayscale(int source);
+        int blur(int source, double sigma);
+        int unsharp(int source, int blurred, float amount);
+        int threshold(int source, float level);
+        int linear(int source, float gain, float bias);
+        void setOutput(int node);
+
+        std::string generateSource();
+        ProcessingMetrics run(const unsigned char* input_data, unsigned char* output_data, int width, int height);
+
+    private:
+        struct Node {
+            FilterOp op;
+            int inputs[2];          // -1 when unused
+            double parameters[2];
+        };
+
+        // One launch of the plan
+        struct Step {
+            int blur;               // blur node
+            bool rows;              // rows pass, else columns pass
+            bool store;             // columns pass: keep the blur in its buffer
+            bool fused_output;      // columns pass: also evaluates the output
+        };
+
+        cl_context context;
+        cl_command_queue commands;
+        cl_device_id device;
+        cl_program program;
+        std::string program_source;
+        std::vector<cl_kernel> kernels;
+        std::vector<cl_mem> pool;
+        size_t pool_buffer_size;
+        std::vector<Node> nodes;
+        int input_node, input_channels, output_node;
+        BorderMode border_mode;
+        unsigned char border_constant;
+        std::vector<int> blurs;             // live blur nodes, in order
+        std::vector<Step> steps;
+        std::vector<int> slots;             // pool buffer of the rows pass (2 i) and result (2 i + 1) of blur i
+        std::vector<int> first_step, last_step;     // lifetime of the same logical buffers, -1 when unused
+        int num_slots;
+
+        int addNode(FilterOp op, int a, int b, double p0, double p1);
+        void plan();
+        void buildProgram();
+        void releaseKernels();
+        void referencedBlurs(int node, std::vector<bool>& used) const;
+        std::string expression(int node, const std::string& x, const std::string& y, int local_blur,
+            const std::string& indent, std::string& statements, std::vector<bool>& emitted) const;
+        std::string temporary(int node, const std::string& x, const std::string& y, int local_blur,
+            const std::string& indent, std::string& statements, std::vector<bool>& emitted) const;
+        static std::string literal(double value);
+};
@@ -1,10 +1,44 @@
 #pragma once
 #define cimg_use_jpeg
+#define cimg_plugin "plugins/nlmeans.h"     // reference of processNLMeans()
 
 #include <CL/cl.h>
 #include <vector>
 #include <CImg.h>
 #include <iostream>
+#include <string>
+#include "tuning_database.h"
+
+#define DIM 3                       // size of the direct convolution matrix
+#define RADIUS (DIM / 2)
+
+/*
+Fixed-point arithmetic: weights are integers summing to 2^FIXED_POINT_SHIFT,
+products are accumulated on 16 bits and the result is rounded by shifting.
+With e = 255 * max(sum of positive, sum of negative weight rounding errors),
+the error against the float path (which truncates) is at most floor(e + 0.5) + 1 LSB,
+i.e. 2 LSB for the 3x3 sigma = 1 matrix (3 for sigma = 1.5). The fixed-point variants are refused
+above FIXED_POINT_MAX_ERROR LSB or when 16 bits could overflow.
+*/
+#define FIXED_POINT_SHIFT 8
+#define FIXED_POINT_MAX_ERROR 2
+
+#define IIR_HALO_SIGMAS 4           // halo rows of the IIR engine, in sigmas
+#define BOX_PASSES 3                // box filters composed by the approximate blur
+#define GAUSSIAN_TRUNCATE_SIGMAS 3  // radius of the separable and FFT Gaussian kernels, in sigmas
+#define FFT_MIN_TILE 32             // smallest tile of the overlap-add FFT convolution
+#define FFT_BREAK_EVEN_MAX_RADIUS 64    // largest kernel radius benchmarked for the FFT break-even
+#define TILE_MEMORY_FRACTION 0.75   // share of the device memory a tile may use
+#define REGION_MASK_BLOCK 32        // side of the blocks a blur mask is covered with
+#define BATCH_GROUP_SIZE 256        // pixels of one image per work-group of the batched blur
+#define PYRAMID_TAPS 5              // binomial kernel of the pyramid reduction (1 4 6 4 1) / 16
+#define BILATERAL_GRID_SIGMA 1.0    // blur of the bilateral grid, in cells
+#define SAT_GROUP_SIZE 128          // work-items scanning one row of a summed-area table
+#define CONTRAST_SCALE 32.0f        // grey levels per standard deviation of the contrast normalization
+#define CONTRAST_EPSILON 1.0f       // added to the deviation of flat windows
+#define RESIZE_SIGMA 0.5            // antialiasing Gaussian of the resize, in pixels of the smaller sampling
+#define HYSTERESIS_BATCH 8          // hysteresis steps enqueued between two reads of the change flag
+#define NLMEANS_ROW_GROUP 64        // pixels of one row per work-group of the NL-means rows pass
 
 struct ProcessingMetrics {
     double memory_transfer_time;    
@@ -14,28 +48,309 @@ struct ProcessingMetrics {
     size_t memory_used;            
     double gpu_occupancy;          
     double transfer_bandwidth;      
+    double approximation_rms_error; // RMS deviation of the impulse response from the exact Gaussian, relative to its peak
+    int algorithm;                  // BlurAlgorithm actually run
+    double predicted_time;          // planner estimate for the whole image (s), 0 when not planned
+};
+
+// Rectangle of the image, in pixels
+struct BlurRegion {
+    int x, y;
+    int width, height;
+};
+
+// One image of a ragged batch, any size
+struct BatchImage {
+    const unsigned char* input;
+    unsigned char* output;
+    int width, height;
+};
+
+// Level of a Gaussian pyramid or output of a resize, all of them are stored one after the other
+struct PyramidLevel {
+    size_t offset;
+    int width, height;
+};
+
+// Unsharp mask: original + amount * (original - blur), only where the difference reaches threshold
+struct UnsharpMask {
+    float amount;
+    float threshold;
+};
+
+// Bilateral grid: one cell per spatial_sigma pixels and per range_sigma grey levels,
+// padded so that the blur of the cells read by the slicing never leaves the grid
+struct BilateralGrid {
+    int width, height, depth;
+    int padding;
+    float spatial_scale, range_scale;       // 1 / sigma
+};
+
+// How the pixels whose neighbourhood leaves the image are computed.
+// Values must match the BORDER_* defines of gaussian_kernel.cl
+enum BorderMode {
+    BORDER_COPY = 0,        // border pixels are copied unblurred (historical behaviour)
+    BORDER_CLAMP = 1,       // clamp-to-edge
+    BORDER_MIRROR = 2,      // symmetric reflection, edge pixel repeated
+    BORDER_WRAP = 3,        // periodic image
+    BORDER_CONSTANT = 4     // pixels outside the image take a constant value
+};
+
+// Grayscale morphology with a rectangular structuring element
+enum MorphologyOp {
+    MORPH_ERODE = 0,        // minimum over the rectangle
+    MORPH_DILATE = 1,       // maximum over the rectangle
+    MORPH_OPEN = 2,         // erosion then dilation, removes bright specks
+    MORPH_CLOSE = 3         // dilation then erosion, fills dark holes
+};
+
+// Window statistics answered from summed-area tables.
+// Values must match the STAT_* defines of gaussian_kernel.cl
+enum LocalStatistic {
+    STAT_MEAN = 0,          // box filter
+    STAT_STDDEV = 1,        // local standard deviation
+    STAT_CONTRAST = 2       // 128 + CONTRAST_SCALE * (pixel - mean) / (deviation + CONTRAST_EPSILON)
+};
+
+// Colour filter array of raw sensor data, colours of the top-left 2 x 2 cell
+enum BayerPattern {
+    BAYER_RGGB = 0,         // red top-left, as CImg's RGBtoBayer()
+    BAYER_GRBG = 1,
+    BAYER_GBRG = 2,
+    BAYER_BGGR = 3
+};
+
+// Interpolation of the missing colours of a Bayer mosaic
+enum DemosaicMethod {
+    DEMOSAIC_BILINEAR = 0,      // BayertoRGB(2)
+    DEMOSAIC_EDGE_AWARE = 1     // BayertoRGB(3), edge directed
+};
+
+// How the Gaussian is computed
+enum BlurAlgorithm {
+    BLUR_DIRECT = 0,        // DIM x DIM convolution matrix
+    BLUR_IIR = 1,           // recursive Young - van Vliet filter, cost independent of sigma
+    BLUR_BOX = 2,           // BOX_PASSES running-sum box filters, approximate, cost independent of sigma
+    BLUR_SEPARABLE = 3,     // two 1D passes of the Gaussian truncated at GAUSSIAN_TRUNCATE_SIGMAS, cost O(sigma)
+    BLUR_FFT = 4,           // same truncated Gaussian by overlap-add FFT, cost O(log sigma)
+    BLUR_ALGORITHM_COUNT = 5
+};
+
+// Kernel family used for the direct blur
+enum KernelPath {
+    PATH_BUFFER = 0,        // global buffers, interior + border kernels
+    PATH_IMAGE = 1,         // image2d_t read through a sampler (needs CL_DEVICE_IMAGE_SUPPORT)
+    PATH_VECTOR = 2,        // buffers, several horizontally adjacent pixels per work-item
+    PATH_FIXED = 3          // buffers, fixed-point arithmetic (see FIXED_POINT_SHIFT)
 };
 
 class GaussianBlurProcessor {
     public:
         GaussianBlurProcessor(bool boolean);
         void initializeOpenCL(cl_device_id device);
+        void setBorderMode(BorderMode mode, unsigned char constant_value = 0);
+        void setSigma(double sigma);
+        void setAlgorithm(BlurAlgorithm algorithm, double predicted_time = 0);
+        BlurAlgorithm getAlgorithm() const;
+        std::string getDeviceKey() const;
+        cl_device_id getDevice() const;
+        cl_context getContext() const;
+        cl_command_queue getCommandQueue() const;
+        cl_program getProgram() const;
+        void setCustomKernel(const std::vector<float>& weights, int kernel_width, int kernel_height);
+        void clearCustomKernel();
+        long getFFTBreakEven() const;
+        void setRegion(int x, int y, int width, int height);
+        void clearRegion();
+        int tileHalo() const;
+        size_t maxTilePixels() const;
+        void setKernelPath(KernelPath path);
+        KernelPath getKernelPath() const;
+        TuningEntry autoTune(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, TuningDatabase& database, int runs = 3);
         ProcessingMetrics processImage(const unsigned char* input_data, unsigned char* output_data,
             int width, int height);
+        ProcessingMetrics processRegions(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const std::vector<BlurRegion>& regions);
+        ProcessingMetrics processMask(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const unsigned char* mask);
+        ProcessingMetrics processUnsharp(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const UnsharpMask& unsharp);
+        ProcessingMetrics processBayer(const void* raw_data, int bits_per_sample, unsigned char* output_data,
+            int width, int height, BayerPattern pattern, DemosaicMethod method);
+        ProcessingMetrics processBatch(const std::vector<BatchImage>& images);
+        ProcessingMetrics buildPyramid(const unsigned char* input_data, int width, int height, int num_levels,
+            std::vector<unsigned char>& pyramid, std::vector<PyramidLevel>& levels);
+        ProcessingMetrics processResize(const unsigned char* input_data, int width, int height,
+            std::vector<PyramidLevel>& sizes, std::vector<unsigned char>& outputs);
+        ProcessingMetrics processScaleSpace(const unsigned char* input_data, int width, int height,
+            const std::vector<double>& sigmas, std::vector<unsigned char>& levels, std::vector<float>* dog = NULL);
+        ProcessingMetrics processNLMeans(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, int patch_radius, double sigma, double lambda = -1, double alpha = 3);
+        ProcessingMetrics summedAreaTable(const unsigned char* input_data, int width, int height,
+            std::vector<cl_uint>& sums, std::vector<cl_ulong>* squares = NULL);
+        ProcessingMetrics processLocalStatistic(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, LocalStatistic statistic, int radius_x, int radius_y);
+        ProcessingMetrics processMorphology(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, MorphologyOp op, int radius_x, int radius_y);
+        ProcessingMetrics processBilateral(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, double spatial_sigma, double range_sigma);
+        ProcessingMetrics detectEdges(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, float low_threshold, float high_threshold);
+        static double nlmeansBandwidth(int patch_radius);
+        static double nlmeansPreselection(const unsigned char* input_data, int width, int height, double& sigma,
+            std::vector<float>& guide);
+        static BilateralGrid bilateralGrid(int width, int height, double spatial_sigma, double range_sigma);
+        static int resizeFilter(int src_size, int dst_size, BorderMode mode, std::vector<cl_int>& indices,
+            std::vector<float>& weights);
+        static std::vector<PyramidLevel> pyramidLayout(int width, int height, int num_levels);
+        static const float* pyramidWeights();
+        static std::vector<BlurRegion> maskRegions(const unsigned char* mask, int width, int height);
         void printDeviceInfo();
+        static int remapCoordinate(int i, int n, BorderMode mode);
+        static const char* kernelPathName(KernelPath path);
+        static const char* borderModeName(BorderMode mode);
+        static std::vector<float> create_gaussian_matrix(double sigma = 1);
+        static std::vector<float> create_separable_kernel(double sigma);
+        static std::vector<float> outerProduct(const std::vector<float>& line);
+        static void iirCoefficients(double sigma, float coefficients[4]);
+        static void boxRadii(double sigma, int radii[BOX_PASSES]);
+        static double boxApproximationError(double sigma);
+        static int fftTileSize(int kernel_width, int kernel_height);
+        static int quantizeKernel(const std::vector<float>& weights, std::vector<cl_ushort>& fixed_weights);
+        static void check_error(cl_int err, const char* operation);
+        static double getEventExecutionTime(cl_event event);
+        bool fixedPointAvailable() const;
+        int fixedPointErrorBound() const;
         ~GaussianBlurProcessor();
 
     private:
+        // Rows of the image handled by one device and how they are uploaded
+        struct SliceLayout {
+            int start_row, rows;            // rows computed
+            int halo_top, halo_bottom;      // extra rows uploaded above and below
+            int input_rows;                 // rows + halos
+            int top_rows, bottom_start;     // rows left entirely to the border kernel
+        };
+
+        // Columns of the image uploaded for a region, all of them real pixels
+        struct SliceColumns {
+            int left, width;                // first column uploaded and buffer width
+            int out_offset, out_width;      // columns kept, relative to left
+        };
+
         cl_context context;
         cl_command_queue commands;
         cl_program program;
         cl_kernel kernel;
+        cl_kernel border_kernel;
+        cl_kernel image_kernel;
+        cl_kernel vector_kernel;
+        cl_kernel fixed_point_kernel;
+        cl_kernel transpose_uchar_kernel;
+        cl_kernel transpose_float_kernel;
+        cl_kernel iir_kernel;
+        cl_kernel box_kernel;
+        cl_kernel fir_kernel;
+        cl_kernel unsharp_kernel;
+        cl_kernel convolve_kernel;
+        cl_kernel fft_load_kernel;
+        cl_kernel fft_stage_kernel;
+        cl_kernel fft_multiply_kernel;
+        cl_kernel fft_gather_kernel;
+        cl_kernel region_rows_kernel;
+        cl_kernel region_columns_kernel;
+        cl_kernel batch_kernel;
+        cl_kernel pyramid_kernel;
+        cl_kernel scale_space_kernel;
+        cl_kernel vhgw_kernel;
+        cl_kernel sat_rows_kernel;
+        cl_kernel sat_columns_kernel;
+        cl_kernel sat_statistics_kernel;
+        cl_kernel nlmeans_rows_kernel;
+        cl_kernel nlmeans_columns_kernel;
+        cl_kernel nlmeans_finish_kernel;
+        cl_kernel demosaic_kernel;
+        cl_kernel resize_rows_kernel;
+        cl_kernel resize_columns_kernel;
+        cl_kernel bilateral_splat_kernel;
+        cl_kernel bilateral_slice_kernel;
+        cl_kernel fir_sobel_kernel;
+        cl_kernel canny_suppress_kernel;
+        cl_kernel canny_hysteresis_kernel;
+        cl_kernel canny_finish_kernel;
         cl_device_id device;
+        double sigma;
+        BlurAlgorithm algorithm;
+        double predicted_time;
         std::vector<float> gaussian_kernel;
+        std::vector<cl_ushort> fixed_gaussian_kernel;
+        int fixed_point_error;
         bool first_gpu;
+        BorderMode border_mode;
+        unsigned char border_constant;
+        KernelPath kernel_path;
+        bool image_support;
+        size_t image2d_max_width;
+        size_t image2d_max_height;
+        int vector_width;
+        size_t local_size[2];
+        std::vector<float> custom_kernel;
+        int custom_kernel_width, custom_kernel_height;
+        long fft_break_even_area;           // kernel area from which the FFT is faster, 0 until measured
+        int fft_measured_width, fft_measured_height;
+        int region_x, region_y, region_width, region_height;   // region_width == 0: half of the image
 
-        void check_error(cl_int err, const char* operation);
-        std::vector<float> create_gaussian_matrix(double sigma = 1);
-        double getEventExecutionTime(cl_event event);
         double calculateGPUOccupancy(size_t global_work_items, size_t local_work_items);
+        std::string deviceKey() const;
+        static size_t roundUp(size_t value, size_t multiple);
+        const size_t* localSizeFor(cl_kernel k) const;
+        bool launchConfigValid(KernelPath path, const size_t local[2], int width, int height) const;
+        void getSlice(int height, int& start_row, int& rows) const;
+        SliceColumns getSliceColumns(int image_width, int halo) const;
+        void bytesPerPixel(size_t& largest_buffer, size_t& total) const;
+        SliceLayout computeSliceLayout(int width, int height, int start_row, int rows) const;
+        cl_uint enqueueBlurKernels(cl_mem input_buffer, bool use_image, cl_mem output_buffer, cl_mem kernel_buffer,
+            cl_mem fixed_kernel_buffer, cl_mem dim_buffer, int width, const SliceLayout& layout, const std::vector<cl_event>& wait_events,
+            cl_event* kernel_events, cl_sampler* sampler, size_t* work_items);
+        ProcessingMetrics processImageIIR(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        void enqueueTranspose(cl_kernel transpose, cl_mem input, cl_mem output, int width, int height,
+            cl_uint num_wait, const cl_event* wait, cl_event* event);
+        void enqueueIIR(cl_mem data, cl_mem output, int columns, int length, int pad, int out_start, int out_rows,
+            cl_event wait, cl_event* event);
+        ProcessingMetrics processImageBox(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        void enqueueBox(cl_mem input, cl_mem output, cl_mem byte_output, int columns, int length, int radius,
+            int out_start, int out_rows, BorderMode mode, cl_event wait, cl_event* event);
+        ProcessingMetrics processImageDirect(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        ProcessingMetrics processImageSeparable(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const UnsharpMask* unsharp = NULL);
+        void enqueueFIR(cl_mem input, cl_mem output, cl_mem byte_output, cl_mem weights, int radius, int columns,
+            int length, int out_start, int out_rows, BorderMode mode, cl_event wait, cl_event* event);
+        void enqueueSummedAreaTable(cl_mem input, cl_mem sums, cl_mem squares, int width, int height,
+            cl_event wait, std::vector<cl_event>& events);
+        void enqueueVHGW(cl_mem input, cl_mem output, cl_mem byte_output, cl_mem prefix, int radius, int columns,
+            int length, int out_start, int out_rows, BorderMode mode, bool dilate, cl_event wait, cl_event* event);
+        ProcessingMetrics processImageCustom(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        ProcessingMetrics processImageConvolution(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const std::vector<float>& weights, int kernel_width, int kernel_height, bool use_fft);
+        void measureFFTBreakEven(int width, int height);
+        cl_mem createKernelSpectrum(const std::vector<float>& weights, int kernel_width, int kernel_height,
+            int tile_size, std::vector<cl_event>& events);
+        void enqueueFFT(cl_mem tiles, int num_tiles, int tile_size, float direction, std::vector<cl_event>& events);
+        ProcessingMetrics blurRegions(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height, const std::vector<BlurRegion>& regions, const unsigned char* mask);
+        bool imagePathAvailable(int width, int rows) const;
+        cl_sampler createBorderSampler();
+        void enqueueWriteRows(cl_mem target, bool is_image, int dst_row, int num_rows, int width,
+            const unsigned char* src, int src_pitch, cl_event* event);
+        void writeSliceWithHalo(cl_mem buffer, bool is_image, const unsigned char* input_data, int image_width,
+            const SliceColumns& columns, int height, int start_row, int rows, int halo_top, int halo_bottom,
+            BorderMode mode, std::vector<unsigned char>& constant_row, std::vector<cl_event>& events);
+        void enqueueReadSlice(cl_mem output_buffer, unsigned char* output_data, int image_width,
+            const SliceColumns& columns, int start_row, int rows, cl_uint num_wait, const cl_event* wait,
+            cl_event* event);
 };
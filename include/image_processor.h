@@ -1,6 +1,9 @@
 #pragma once
 
 #include "gaussian_blur_processor.h"
+#include "cpu_blur_processor.h"
+#include "blur_planner.h"
+#include "median_filter.h"
 #include <chrono>
 
 struct GlobalMetrics {
@@ -10,22 +13,54 @@ struct GlobalMetrics {
     double total_kernel_execution_time;
     size_t peak_memory_usage;
     double avg_gpu_occupancy[2];
+    double approximation_rms_error;
+    int algorithm[2];
+    double predicted_time[2];
 };
 
 class ImageProcessor {
 public:
     ImageProcessor();
     void loadAndReplicateImage(const char* filename);
+    void setBorderMode(BorderMode mode, unsigned char constant_value = 0);
+    void setBlur(double sigma, BlurAlgorithm algorithm);
+    void setCustomKernel(const std::vector<float>& weights, int kernel_width, int kernel_height);
+    void setAutoBlur(double sigma, bool allow_approximate = false);
+    void setMorphology(MorphologyOp op, int radius_x, int radius_y);
+    void setMedian(int radius);
     GlobalMetrics processImagesWithOpenCL();
+    GlobalMetrics processLargeImageWithOpenCL(const char* filename, const char* output_filename);
+    GlobalMetrics processImagesWithCPU(bool fixed_point = false);
+    int compareEngines(const char* filename, double sigma);
     void printMetrics(const GlobalMetrics& metrics);
     ~ImageProcessor();
 
 private:
     static const int NUM_IMAGES = 1000;
+    static const int TILES_PER_DEVICE = 4;      // tiles queued per device at least, for load balancing
+    static const int MIN_BAND_ROWS = 64;        // shorter full-width bands are replaced by square tiles
+    static const int MEDIAN_BATCH = 50;         // images of one median batch
     std::vector<unsigned char> all_images_data;
     std::vector<unsigned char> all_output_data;
     int single_image_size;
     int width, height;
     GaussianBlurProcessor processors[2];
+    MedianFilter medians[2];
+    CPUBlurProcessor cpu_processor;
+    TuningDatabase tuning_database;
+    BlurPlanner planner;
+    bool auto_blur;
+    double auto_sigma;
+    BorderMode border_mode;
+    unsigned char border_constant;
+    bool morphology;                    // the batches run processMorphology() instead of the blur
+    MorphologyOp morphology_op;
+    int morphology_radius[2];
+    bool median;                        // the batches run the median filter instead of the blur
+    int median_radius;
+
+    cl_uint initializeDevices();
+    static bool checkDifference(const char* operation, const unsigned char* gpu, const unsigned char* cpu, size_t size,
+                                int tolerance, double outliers = 0);
 };
 
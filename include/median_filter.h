@@ -0,0 +1,39 @@
+#pragma once
+
+#include "gaussian_blur_processor.h"
+
+#define MEDIAN_POOL_BUFFERS 2       // packed inputs and outputs of a batch
+
+/*
+Median filter of the (2 radius + 1)^2 window (salt-and-pepper noise), next
+to the blur: it runs in the context and queue of the GaussianBlurProcessor
+it is initialized with and creates its kernel from the program of that
+processor. A batch of images of any sizes is packed into the buffers of a
+pool, kept from one batch to the next and only grown, so it costs one
+transfer each way and one launch per image. Copy is handled as clamp.
+*/
+class MedianFilter {
+    public:
+        MedianFilter();
+        ~MedianFilter();
+        void initializeOpenCL(const GaussianBlurProcessor& processor);
+        void setBorderMode(BorderMode mode, unsigned char constant_value = 0);
+        void setRadius(int radius);
+        ProcessingMetrics processImage(const unsigned char* input_data, unsigned char* output_data,
+            int width, int height);
+        ProcessingMetrics processBatch(const std::vector<BatchImage>& images);
+
+    private:
+        cl_context context;
+        cl_command_queue commands;
+        cl_device_id device;
+        cl_program program;
+        cl_kernel median_kernel;
+        std::vector<cl_mem> pool;
+        size_t pool_buffer_size;
+        int radius;
+        BorderMode border_mode;
+        unsigned char border_constant;
+
+        void releaseOpenCL();
+};
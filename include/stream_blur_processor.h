@@ -0,0 +1,51 @@
+#pragma once
+
+#include "gaussian_blur_processor.h"
+
+/*
+Sources and sinks of 8-bit grey rows, read and written top to bottom. Colour
+inputs give their first channel, like the planar CImg images of the other
+engines. open() picks the format from the extension: JPEG (libjpeg scanline
+API) or binary PGM/PPM.
+*/
+class ScanlineReader {
+    public:
+        virtual ~ScanlineReader() {}
+        int width() const { return image_width; }
+        int height() const { return image_height; }
+        virtual void readRow(unsigned char* row) = 0;
+        static ScanlineReader* open(const char* filename);
+
+    protected:
+        int image_width, image_height;
+};
+
+class ScanlineWriter {
+    public:
+        virtual ~ScanlineWriter() {}
+        virtual void writeRow(const unsigned char* row) = 0;
+        static ScanlineWriter* open(const char* filename, int width, int height);
+};
+
+/*
+Gaussian blur of images that do not fit in host memory: rows are blurred as
+they are read and only a window of 2r + 1 horizontally blurred rows is kept
+(r the radius of create_separable_kernel()), so memory is O(width * r) and
+the speed is the one of the decoder and encoder.
+*/
+class StreamBlurProcessor {
+    public:
+        StreamBlurProcessor(double sigma = 1.0);
+        void setSigma(double sigma);
+        void setBorderMode(BorderMode mode, unsigned char constant_value = 0);
+        ProcessingMetrics processFile(const char* input_filename, const char* output_filename);
+        ProcessingMetrics processStream(ScanlineReader& reader, ScanlineWriter& writer);
+
+    private:
+        double sigma;
+        std::vector<float> line;
+        BorderMode border_mode;
+        unsigned char border_constant;
+
+        void blurRow(const unsigned char* input, float* output, int width) const;
+};
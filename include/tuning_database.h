@@ -0,0 +1,47 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+// Best launch configuration measured for one (device, image size class and border mode)
+struct TuningEntry {
+    int kernel_path;        // KernelPath of gaussian_blur_processor.h
+    size_t local_size[2];
+    double time;            // seconds per image (transfers + kernels) when it was measured
+};
+
+// Calibrated cost of one blur algorithm on one device (see BlurPlanner)
+struct CostEntry {
+    double fixed;           // seconds per byte
+    double unit;            // seconds per byte and unit of work
+};
+
+/*
+On-disk database of the auto-tuner results, so that production runs launch
+with the best configuration without benchmarking again. One entry per line:
+device <TAB> size class <TAB> kernel path <TAB> local x <TAB> local y <TAB> time
+where the work-group tuner suffixes the size class with the border mode
+("1024x1024 mirror"). Entries are not trusted: the tuner checks them against
+the device limits before launching with them.
+The cost model of BlurPlanner is kept in a second file, one line per
+device <TAB> algorithm <TAB> fixed <TAB> unit
+*/
+class TuningDatabase {
+public:
+    TuningDatabase(const char* filename = "tuning.db", const char* cost_filename = "cost_model.db");
+    bool load();
+    bool save() const;
+    bool lookup(const std::string& device, const std::string& size_class, TuningEntry& entry) const;
+    void store(const std::string& device, const std::string& size_class, const TuningEntry& entry);
+    bool lookupCost(const std::string& device, const std::string& algorithm, CostEntry& cost) const;
+    void storeCost(const std::string& device, const std::string& algorithm, const CostEntry& cost);
+    static std::string sizeClass(int width, int height);
+
+private:
+    std::string filename;
+    std::string cost_filename;
+    std::map<std::string, TuningEntry> entries;   // key: device + '\t' + size class
+    std::map<std::string, CostEntry> costs;       // key: device + '\t' + algorithm
+
+    static std::string makeKey(const std::string& device, const std::string& size_class);
+};
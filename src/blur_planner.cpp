@@ -0,0 +1,162 @@
+#include "../include/blur_planner.h"
+#include "../include/cpu_blur_processor.h"
+#include <math.h>
+
+#define IIR_MIN_SIGMA 1.0           // below, the recursive filter drifts too far from the Gaussian
+#define CALIBRATION_SIGMA_LOW 2.0   // sigmas of the calibration runs
+#define CALIBRATION_SIGMA_HIGH 8.0
+
+BlurPlanner::BlurPlanner(TuningDatabase& database) : database(database), allow_approximate(false) {}
+
+void BlurPlanner::setAllowApproximate(bool allow){
+    allow_approximate = allow;
+}
+
+const char* BlurPlanner::algorithmName(BlurAlgorithm algorithm){
+    switch (algorithm) {
+        case BLUR_IIR: return "iir";
+        case BLUR_BOX: return "box";
+        case BLUR_SEPARABLE: return "separable";
+        case BLUR_FFT: return "fft";
+        default: return "direct";
+    }
+}
+
+bool BlurPlanner::isCandidate(BlurAlgorithm algorithm, double sigma, bool allow_approximate){
+    switch (algorithm) {
+        case BLUR_DIRECT:
+            // The DIM x DIM matrix truncates at RADIUS, accepted up to sigma = RADIUS
+            // as the historical 3 x 3 matrix of sigma 1
+            return sigma <= RADIUS;
+        case BLUR_IIR:
+            return sigma >= IIR_MIN_SIGMA;
+        case BLUR_BOX:
+            return allow_approximate;
+        default:
+            return true;
+    }
+}
+
+double BlurPlanner::workPerPixel(BlurAlgorithm algorithm, double sigma){
+    int size = 2 * static_cast<int>(ceil(GAUSSIAN_TRUNCATE_SIGMAS * sigma)) + 1;
+    switch (algorithm) {
+        case BLUR_SEPARABLE:
+            return 2.0 * size;
+        case BLUR_FFT: {
+            // Transforms of the tiles, inflated by their overlap
+            int tile = GaussianBlurProcessor::fftTileSize(size, size);
+            double block = tile - size + 1;
+            return (tile / block) * (tile / block) * log2(static_cast<double>(tile));
+        }
+        case BLUR_DIRECT:
+            return DIM * DIM;
+        default:
+            return 1.0;
+    }
+}
+
+template <typename Processor>
+void BlurPlanner::calibrate(Processor& processor, const std::string& device, int width, int height,
+                            const unsigned char* sample){
+    /*
+    Time every algorithm on an image of the job size at two sigmas and fit
+    fixed + unit * work per pixel. Algorithms whose work does not depend on
+    sigma only get a fixed cost. The job image is used when given, otherwise
+    a gradient with noise, so that data-dependent paths are not timed on
+    a flat image.
+    */
+    std::vector<unsigned char> input(static_cast<size_t>(width) * height);
+    if (sample) {
+        std::copy(sample, sample + input.size(), input.begin());
+    } else {
+        unsigned int state = 12345;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                state = state * 1103515245u + 12345u;
+                int value = (x + y) * 255 / std::max(width + height - 2, 1) + static_cast<int>((state >> 16) % 64) - 32;
+                input[static_cast<size_t>(y) * width + x] = static_cast<unsigned char>(std::min(std::max(value, 0), 255));
+            }
+        }
+    }
+    std::vector<unsigned char> output(input.size());
+    const double pixels = static_cast<double>(width) * height;
+    const double sigmas[2] = {CALIBRATION_SIGMA_LOW, CALIBRATION_SIGMA_HIGH};
+
+    for (int a = 0; a < BLUR_ALGORITHM_COUNT; a++) {
+        BlurAlgorithm algorithm = static_cast<BlurAlgorithm>(a);
+        double times[2], works[2];
+
+        for (int s = 0; s < 2; s++) {
+            double sigma = (algorithm == BLUR_DIRECT) ? 1.0 : sigmas[s];
+            processor.setSigma(sigma);
+            processor.setAlgorithm(algorithm);
+            for (int run = 0; run < 2; run++) {
+                double t = processor.processImage(input.data(), output.data(), width, height).total_processing_time;
+                if (run == 0 || t < times[s]) times[s] = t;
+            }
+            times[s] /= pixels;
+            works[s] = workPerPixel(algorithm, sigma);
+        }
+
+        CostEntry cost = {0, 0};
+        if (works[1] != works[0]) {
+            cost.unit = std::max(0.0, (times[1] - times[0]) / (works[1] - works[0]));
+            cost.fixed = std::max(0.0, times[0] - cost.unit * works[0]);
+        } else {
+            cost.fixed = (times[0] + times[1]) / 2;
+        }
+        database.storeCost(device, algorithmName(algorithm), cost);
+    }
+}
+
+template <typename Processor>
+BlurPlan BlurPlanner::plan(Processor& processor, double sigma, int width, int height, int pixel_bytes,
+                           const unsigned char* sample){
+    /*
+    Predict the time of every candidate for this job, configure the
+    processor with the fastest one and return the whole comparison.
+    */
+    std::string device = processor.getDeviceKey();
+    CostEntry cost;
+    if (!database.lookupCost(device, algorithmName(BLUR_DIRECT), cost)) {
+        std::cout << "Calibrating the blur cost model of " << device << std::endl;
+        calibrate(processor, device, width, height, sample);
+    }
+
+    BlurPlan result;
+    result.algorithm = BLUR_SEPARABLE;
+    result.predicted_time = -1;
+    const double scale = static_cast<double>(width) * height * pixel_bytes;
+
+    for (int a = 0; a < BLUR_ALGORITHM_COUNT; a++) {
+        BlurAlgorithm algorithm = static_cast<BlurAlgorithm>(a);
+        result.costs[a] = -1;
+        if (!isCandidate(algorithm, sigma, allow_approximate)) continue;
+        if (!database.lookupCost(device, algorithmName(algorithm), cost)) continue;
+
+        result.costs[a] = scale * (cost.fixed + cost.unit * workPerPixel(algorithm, sigma));
+        if (result.predicted_time < 0 || result.costs[a] < result.predicted_time) {
+            result.algorithm = algorithm;
+            result.predicted_time = result.costs[a];
+        }
+    }
+
+    processor.setSigma(sigma);
+    processor.setAlgorithm(result.algorithm, result.predicted_time);
+    return result;
+}
+
+void BlurPlanner::printPlan(const BlurPlan& plan){
+    std::cout << "Blur plan: " << algorithmName(plan.algorithm) << " (";
+    for (int a = 0; a < BLUR_ALGORITHM_COUNT; a++) {
+        if (a > 0) std::cout << ", ";
+        std::cout << algorithmName(static_cast<BlurAlgorithm>(a)) << " ";
+        if (plan.costs[a] < 0) std::cout << "n/a";
+        else std::cout << plan.costs[a] * 1000 << " ms";
+    }
+    std::cout << ")" << std::endl;
+}
+
+template BlurPlan BlurPlanner::plan<GaussianBlurProcessor>(GaussianBlurProcessor&, double, int, int, int,
+                                                           const unsigned char*);
+template BlurPlan BlurPlanner::plan<CPUBlurProcessor>(CPUBlurProcessor&, double, int, int, int, const unsigned char*);
@@ -0,0 +1,1532 @@
+#include "../include/cpu_blur_processor.h"
+#include <chrono>
+#include <math.h>
+#include <omp.h>
+#include <sstream>
+
+#define TRANSPOSE_BLOCK 32      // side of the blocks of the cache friendly transpose
+#define IIR_COLUMN_BLOCK 256    // columns filtered together by one thread (IIR and box passes)
+#define MEDIAN_STRIPE 256       // output columns of the median handled by one task
+#define EDGE_WEAK 128           // labels of the edge detector, as in gaussian_kernel.cl
+#define EDGE_STRONG 255
+#define TAN_22_5 0.41421356f
+
+CPUBlurProcessor::CPUBlurProcessor(double sigma){
+    setSigma(sigma);
+    algorithm = BLUR_DIRECT;
+    predicted_time = 0;
+    fixed_point = false;
+    border_mode = BORDER_COPY;
+    border_constant = 0;
+    custom_kernel_width = custom_kernel_height = 0;
+    fft_break_even_area = 0;
+    fft_measured_width = fft_measured_height = 0;
+}
+
+void CPUBlurProcessor::setBorderMode(BorderMode mode, unsigned char constant_value){
+    border_mode = mode;
+    border_constant = constant_value;
+}
+
+void CPUBlurProcessor::setSigma(double sigma){
+    this->sigma = sigma;
+    gaussian_kernel = GaussianBlurProcessor::create_gaussian_matrix(sigma);
+    fixed_point_error = GaussianBlurProcessor::quantizeKernel(gaussian_kernel, fixed_gaussian_kernel);
+}
+
+void CPUBlurProcessor::setAlgorithm(BlurAlgorithm algorithm, double predicted_time){
+    this->algorithm = algorithm;
+    this->predicted_time = predicted_time;
+}
+
+BlurAlgorithm CPUBlurProcessor::getAlgorithm() const {
+    return algorithm;
+}
+
+std::string CPUBlurProcessor::getDeviceKey() const {
+    std::ostringstream key;
+    key << "CPU " << omp_get_max_threads() << " threads";
+    return key.str();
+}
+
+void CPUBlurProcessor::setFixedPoint(bool enabled){
+    fixed_point = enabled;
+}
+
+void CPUBlurProcessor::setCustomKernel(const std::vector<float>& weights, int kernel_width, int kernel_height){
+    if (kernel_width % 2 == 0 || kernel_height % 2 == 0 ||
+        weights.size() != static_cast<size_t>(kernel_width) * kernel_height) {
+        fprintf(stderr, "Custom kernel must have odd sizes and kernel_width * kernel_height weights\n");
+        exit(EXIT_FAILURE);
+    }
+    custom_kernel = weights;
+    custom_kernel_width = kernel_width;
+    custom_kernel_height = kernel_height;
+}
+
+void CPUBlurProcessor::clearCustomKernel(){
+    custom_kernel.clear();
+    custom_kernel_width = custom_kernel_height = 0;
+}
+
+long CPUBlurProcessor::getFFTBreakEven() const {
+    return fft_break_even_area;
+}
+
+bool CPUBlurProcessor::fixedPointAvailable() const {
+    return fixed_point_error >= 0 && fixed_point_error <= FIXED_POINT_MAX_ERROR;
+}
+
+int CPUBlurProcessor::fixedPointErrorBound() const {
+    return fixed_point_error;
+}
+
+void CPUBlurProcessor::blurRow(const unsigned char* const* rows, unsigned char* output, int width,
+                               bool use_fixed, const unsigned char* constant_row) const {
+    /*
+    Blur one output row from its DIM source rows. The interior columns are
+    written as a plain loop the compiler vectorizes (16-bit lanes for the
+    fixed-point path, twice as many as float), the RADIUS columns on each side
+    go through the border remapping.
+    */
+    const int x_end = width - RADIUS;
+
+    if (use_fixed) {
+        for (int x = RADIUS; x < x_end; x++) {
+            uint16_t sum = 1 << (FIXED_POINT_SHIFT - 1);
+            for (int j = 0; j < DIM; j++) {
+                for (int i = 0; i < DIM; i++) {
+                    sum += fixed_gaussian_kernel[j * DIM + i] * rows[j][x + i - RADIUS];
+                }
+            }
+            output[x] = static_cast<unsigned char>(sum >> FIXED_POINT_SHIFT);
+        }
+    } else {
+        for (int x = RADIUS; x < x_end; x++) {
+            float sum = 0.0f;
+            for (int j = 0; j < DIM; j++) {
+                for (int i = 0; i < DIM; i++) {
+                    sum += gaussian_kernel[j * DIM + i] * rows[j][x + i - RADIUS];
+                }
+            }
+            output[x] = static_cast<unsigned char>(sum);
+        }
+    }
+
+    for (int x = 0; x < width; x++) {
+        if (x == RADIUS && x_end > RADIUS) x = x_end;
+
+        if (border_mode == BORDER_COPY) {
+            output[x] = rows[RADIUS][x];
+            continue;
+        }
+        float sum = 0.0f;
+        for (int j = 0; j < DIM; j++) {
+            for (int i = 0; i < DIM; i++) {
+                int nx = GaussianBlurProcessor::remapCoordinate(x + i - RADIUS, width, border_mode);
+                unsigned char value = (nx < 0) ? constant_row[0] : rows[j][nx];
+                sum += gaussian_kernel[j * DIM + i] * value;
+            }
+        }
+        output[x] = static_cast<unsigned char>(sum);
+    }
+}
+
+ProcessingMetrics CPUBlurProcessor::processImage(const unsigned char* input_data, unsigned char* output_data,
+                                                 int width, int height) {
+    if (!custom_kernel.empty()) {
+        return processImageCustom(input_data, output_data, width, height);
+    }
+
+    ProcessingMetrics metrics;
+    switch (algorithm) {
+        case BLUR_IIR:
+            metrics = processImageIIR(input_data, output_data, width, height);
+            break;
+        case BLUR_BOX:
+            metrics = processImageBox(input_data, output_data, width, height);
+            break;
+        case BLUR_SEPARABLE:
+            metrics = processImageSeparable(input_data, output_data, width, height);
+            break;
+        case BLUR_FFT: {
+            std::vector<float> line = GaussianBlurProcessor::create_separable_kernel(sigma);
+            int size = static_cast<int>(line.size());
+            metrics = processImageConvolution(input_data, output_data, width, height,
+                                              GaussianBlurProcessor::outerProduct(line), size, size, true);
+            break;
+        }
+        default:
+            metrics = processImageDirect(input_data, output_data, width, height);
+            break;
+    }
+    metrics.algorithm = algorithm;
+    metrics.predicted_time = predicted_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processUnsharp(const unsigned char* input_data, unsigned char* output_data,
+                                                   int width, int height, const UnsharpMask& unsharp) {
+    ProcessingMetrics metrics = processImageSeparable(input_data, output_data, width, height, &unsharp);
+    metrics.algorithm = BLUR_SEPARABLE;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processImageDirect(const unsigned char* input_data, unsigned char* output_data,
+                                                       int width, int height) {
+    ProcessingMetrics metrics = {};
+    bool use_fixed = fixed_point && fixedPointAvailable();
+    std::vector<unsigned char> constant_row(width, border_constant);
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        unsigned char* output = output_data + static_cast<size_t>(y) * width;
+
+        // Rows of the neighbourhood, picked with the same rules as the halo
+        // of the OpenCL slices
+        bool copy_row = false;
+        const unsigned char* rows[DIM];
+        for (int j = 0; j < DIM; j++) {
+            int ny = GaussianBlurProcessor::remapCoordinate(y + j - RADIUS, height, border_mode);
+            if (ny < 0 && border_mode == BORDER_COPY) copy_row = true;
+            rows[j] = (ny < 0) ? constant_row.data() : input_data + static_cast<size_t>(ny) * width;
+        }
+
+        if (copy_row) {
+            std::copy(rows[RADIUS], rows[RADIUS] + width, output);
+        } else {
+            blurRow(rows, output, width, use_fixed, constant_row.data());
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    metrics.memory_used = constant_row.size();
+    return metrics;
+}
+
+template <typename T>
+void CPUBlurProcessor::transpose(const T* input, float* output, int width, int height){
+    // height x width -> width x height, by blocks so both sides stay in cache
+    #pragma omp parallel for schedule(static)
+    for (int by = 0; by < height; by += TRANSPOSE_BLOCK) {
+        for (int bx = 0; bx < width; bx += TRANSPOSE_BLOCK) {
+            int y_end = std::min(by + TRANSPOSE_BLOCK, height);
+            int x_end = std::min(bx + TRANSPOSE_BLOCK, width);
+            for (int y = by; y < y_end; y++) {
+                for (int x = bx; x < x_end; x++) {
+                    output[static_cast<size_t>(x) * height + y] = input[static_cast<size_t>(y) * width + x];
+                }
+            }
+        }
+    }
+}
+
+void CPUBlurProcessor::iirColumns(float* data, unsigned char* output, int columns, int length, int pad) const {
+    /*
+    Young - van Vliet recursions down every column of a length x columns
+    buffer. The recursion runs along the rows while the inner loop walks
+    IIR_COLUMN_BLOCK neighbouring columns, which vectorizes. The causal pass
+    goes on over pad extra rows holding the edge value so that the anticausal
+    pass starts from a steady state. With output the anticausal pass writes
+    rounded bytes, otherwise it stores back in data.
+    */
+    float c[4];
+    GaussianBlurProcessor::iirCoefficients(sigma, c);
+    const float B = c[0], a1 = c[1], a2 = c[2], a3 = c[3];
+    const bool use_constant = (border_mode == BORDER_CONSTANT);
+    const float constant_value = border_constant;
+
+    #pragma omp parallel for schedule(static)
+    for (int block = 0; block < columns; block += IIR_COLUMN_BLOCK) {
+        const int count = std::min(IIR_COLUMN_BLOCK, columns - block);
+        float s1[IIR_COLUMN_BLOCK], s2[IIR_COLUMN_BLOCK], s3[IIR_COLUMN_BLOCK];
+        float edge[IIR_COLUMN_BLOCK];
+        const float* last = data + static_cast<size_t>(length - 1) * columns + block;
+
+        // Causal pass, from the steady state of the first row
+        for (int x = 0; x < count; x++) {
+            s1[x] = s2[x] = s3[x] = use_constant ? constant_value : data[block + x];
+            edge[x] = use_constant ? constant_value : last[x];
+        }
+        for (int n = 0; n < length + pad; n++) {
+            float* line = data + static_cast<size_t>(n) * columns + block;
+            const float* input = (n < length) ? line : edge;
+            #pragma omp simd
+            for (int x = 0; x < count; x++) {
+                float w = B * input[x] + a1 * s1[x] + a2 * s2[x] + a3 * s3[x];
+                line[x] = w;
+                s3[x] = s2[x]; s2[x] = s1[x]; s1[x] = w;
+            }
+        }
+
+        // Anticausal pass, from the steady state of the edge value
+        for (int x = 0; x < count; x++) {
+            s1[x] = s2[x] = s3[x] = edge[x];
+        }
+        for (int n = length + pad - 1; n >= 0; n--) {
+            float* line = data + static_cast<size_t>(n) * columns + block;
+            #pragma omp simd
+            for (int x = 0; x < count; x++) {
+                float y = B * line[x] + a1 * s1[x] + a2 * s2[x] + a3 * s3[x];
+                s3[x] = s2[x]; s2[x] = s1[x]; s1[x] = y;
+            }
+            if (n >= length) continue;
+            if (output) {
+                unsigned char* out = output + static_cast<size_t>(n) * columns + block;
+                #pragma omp simd
+                for (int x = 0; x < count; x++) {
+                    out[x] = static_cast<unsigned char>(std::min(std::max(s1[x] + 0.5f, 0.0f), 255.0f));
+                }
+            } else {
+                std::copy(s1, s1 + count, line);
+            }
+        }
+    }
+}
+
+ProcessingMetrics CPUBlurProcessor::processImageIIR(const unsigned char* input_data, unsigned char* output_data,
+                                                    int width, int height) {
+    /*
+    Recursive Gaussian, same passes as the OpenCL engine: rows on the
+    transposed image, then columns. The lines are extended as clamp (or
+    constant) over IIR_HALO_SIGMAS sigmas, mirror and wrap are not reproduced
+    by the recursion.
+    */
+    ProcessingMetrics metrics = {};
+    int pad = static_cast<int>(ceil(IIR_HALO_SIGMAS * sigma));
+    std::vector<float> transposed(static_cast<size_t>(width + pad) * height);
+    std::vector<float> image(static_cast<size_t>(width) * (height + pad));
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    transpose(input_data, transposed.data(), width, height);
+    iirColumns(transposed.data(), NULL, height, width, pad);
+    transpose(transposed.data(), image.data(), height, width);
+    iirColumns(image.data(), output_data, width, height, pad);
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    metrics.memory_used = (transposed.size() + image.size()) * sizeof(float);
+    return metrics;
+}
+
+void CPUBlurProcessor::boxColumns(const float* input, float* output, unsigned char* byte_output,
+                                  int columns, int length, int radius) const {
+    /*
+    Running mean over 2 * radius + 1 rows down every column, from input to
+    output or, when byte_output is given, to rounded bytes. Blocks of
+    IIR_COLUMN_BLOCK columns as in iirColumns, the rows outside the buffer
+    follow the border mode (copy is handled as clamp).
+    */
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const float scale = 1.0f / (2 * radius + 1);
+
+    #pragma omp parallel for schedule(static)
+    for (int block = 0; block < columns; block += IIR_COLUMN_BLOCK) {
+        const int count = std::min(IIR_COLUMN_BLOCK, columns - block);
+        float sum[IIR_COLUMN_BLOCK];
+        float constant_row[IIR_COLUMN_BLOCK];
+        std::fill(sum, sum + count, 0.0f);
+        std::fill(constant_row, constant_row + count, static_cast<float>(border_constant));
+
+        for (int i = -radius - 1; i < length + radius; i++) {
+            int n_in = GaussianBlurProcessor::remapCoordinate(i, length, mode);
+            const float* in = (n_in < 0) ? constant_row : input + static_cast<size_t>(n_in) * columns + block;
+            int i_out = i - 2 * radius - 1; // row leaving the window once row i is added
+            int n_out = GaussianBlurProcessor::remapCoordinate(i_out, length, mode);
+            const float* out = (n_out < 0) ? constant_row : input + static_cast<size_t>(n_out) * columns + block;
+
+            if (i < radius) {
+                #pragma omp simd
+                for (int x = 0; x < count; x++) sum[x] += in[x];
+                continue;
+            }
+
+            int n = i - radius;
+            #pragma omp simd
+            for (int x = 0; x < count; x++) sum[x] += in[x] - out[x];
+
+            if (byte_output) {
+                unsigned char* dst = byte_output + static_cast<size_t>(n) * columns + block;
+                #pragma omp simd
+                for (int x = 0; x < count; x++) {
+                    dst[x] = static_cast<unsigned char>(std::min(std::max(sum[x] * scale + 0.5f, 0.0f), 255.0f));
+                }
+            } else {
+                float* dst = output + static_cast<size_t>(n) * columns + block;
+                #pragma omp simd
+                for (int x = 0; x < count; x++) dst[x] = sum[x] * scale;
+            }
+        }
+    }
+}
+
+ProcessingMetrics CPUBlurProcessor::processImageBox(const unsigned char* input_data, unsigned char* output_data,
+                                                    int width, int height) {
+    /*
+    Approximate Gaussian, same passes as the OpenCL engine: BOX_PASSES box
+    filters on the transposed image, then as many along the columns.
+    */
+    ProcessingMetrics metrics = {};
+    int radii[BOX_PASSES];
+    GaussianBlurProcessor::boxRadii(sigma, radii);
+    std::vector<float> buffers[2];
+    buffers[0].resize(static_cast<size_t>(width) * height);
+    buffers[1].resize(static_cast<size_t>(width) * height);
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    int current = 0;
+    transpose(input_data, buffers[current].data(), width, height);
+    for (int p = 0; p < BOX_PASSES; p++) {
+        boxColumns(buffers[current].data(), buffers[1 - current].data(), NULL, height, width, radii[p]);
+        current = 1 - current;
+    }
+    transpose(buffers[current].data(), buffers[1 - current].data(), height, width);
+    current = 1 - current;
+    for (int p = 0; p < BOX_PASSES; p++) {
+        bool last = (p == BOX_PASSES - 1);
+        boxColumns(buffers[current].data(), buffers[1 - current].data(), last ? output_data : NULL,
+                   width, height, radii[p]);
+        current = 1 - current;
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    metrics.memory_used = (buffers[0].size() + buffers[1].size()) * sizeof(float);
+    metrics.approximation_rms_error = GaussianBlurProcessor::boxApproximationError(sigma);
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processImageCustom(const unsigned char* input_data, unsigned char* output_data,
+                                                       int width, int height) {
+    if (fft_break_even_area == 0 || width != fft_measured_width || height != fft_measured_height) {
+        measureFFTBreakEven(width, height);
+    }
+    bool use_fft = static_cast<long>(custom_kernel_width) * custom_kernel_height >= fft_break_even_area;
+    ProcessingMetrics metrics = processImageConvolution(input_data, output_data, width, height,
+                                                        custom_kernel, custom_kernel_width, custom_kernel_height, use_fft);
+    metrics.algorithm = use_fft ? BLUR_FFT : BLUR_DIRECT;
+    return metrics;
+}
+
+void CPUBlurProcessor::measureFFTBreakEven(int width, int height) {
+    // Same benchmark as GaussianBlurProcessor::measureFFTBreakEven
+    std::vector<unsigned char> input(static_cast<size_t>(width) * height, 0);
+    std::vector<unsigned char> output(input.size());
+
+    fft_break_even_area = 0;
+    for (int radius = 1; radius <= FFT_BREAK_EVEN_MAX_RADIUS && fft_break_even_area == 0; radius *= 2) {
+        int size = 2 * radius + 1;
+        std::vector<float> weights(size * size, 1.0f / (size * size));
+
+        double best[2] = {0, 0};
+        for (int use_fft = 0; use_fft < 2; use_fft++) {
+            for (int run = 0; run < 2; run++) {
+                ProcessingMetrics m = processImageConvolution(input.data(), output.data(), width, height,
+                                                              weights, size, size, use_fft != 0);
+                if (run == 0 || m.total_processing_time < best[use_fft]) best[use_fft] = m.total_processing_time;
+            }
+        }
+        if (best[1] < best[0]) fft_break_even_area = static_cast<long>(size) * size;
+    }
+    if (fft_break_even_area == 0) {
+        fft_break_even_area = static_cast<long>(2 * FFT_BREAK_EVEN_MAX_RADIUS + 1) * (2 * FFT_BREAK_EVEN_MAX_RADIUS + 1);
+    }
+    fft_measured_width = width;
+    fft_measured_height = height;
+
+    std::cout << "CPU FFT break-even: " << fft_break_even_area << " kernel taps" << std::endl;
+}
+
+void CPUBlurProcessor::fft2D(std::complex<float>* tile, int size, float direction){
+    /*
+    In-place radix-2 transform of a size x size tile (size a power of two),
+    rows then columns. direction is -1 forward, +1 inverse (unscaled).
+    */
+    for (int columns = 0; columns < 2; columns++) {
+        const int stride = columns ? size : 1;
+        const int line_step = columns ? 1 : size;
+
+        for (int l = 0; l < size; l++) {
+            std::complex<float>* line = tile + static_cast<size_t>(l) * line_step;
+
+            for (int i = 1, j = 0; i < size; i++) {
+                int bit = size >> 1;
+                for (; j & bit; bit >>= 1) j ^= bit;
+                j ^= bit;
+                if (i < j) std::swap(line[i * stride], line[j * stride]);
+            }
+
+            for (int half_span = 1; half_span < size; half_span *= 2) {
+                const float angle = direction * static_cast<float>(M_PI) / half_span;
+                const std::complex<float> step(cosf(angle), sinf(angle));
+                for (int start = 0; start < size; start += 2 * half_span) {
+                    std::complex<float> w(1.0f, 0.0f);
+                    for (int k = 0; k < half_span; k++) {
+                        std::complex<float>& a = line[(start + k) * stride];
+                        std::complex<float>& b = line[(start + k + half_span) * stride];
+                        std::complex<float> wb = w * b;
+                        b = a - wb;
+                        a += wb;
+                        w *= step;
+                    }
+                }
+            }
+        }
+    }
+}
+
+ProcessingMetrics CPUBlurProcessor::processImageConvolution(const unsigned char* input_data,
+                                                            unsigned char* output_data,
+                                                            int width, int height,
+                                                            const std::vector<float>& weights,
+                                                            int kernel_width, int kernel_height,
+                                                            bool use_fft) {
+    /*
+    Convolution by an arbitrary kernel on the image extended by the kernel
+    radii following the border mode (copy is handled as clamp), directly or by
+    overlap-add FFT with the tiles of the OpenCL engine. The tile rows are
+    processed even ones then odd ones, so the threads never add to the same
+    pixels.
+    */
+    ProcessingMetrics metrics = {};
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const int radius_x = kernel_width / 2;
+    const int radius_y = kernel_height / 2;
+    const int extended_width = width + 2 * radius_x;
+    const int extended_height = height + 2 * radius_y;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<float> extended(static_cast<size_t>(extended_width) * extended_height);
+    #pragma omp parallel for schedule(static)
+    for (int ey = 0; ey < extended_height; ey++) {
+        int y = GaussianBlurProcessor::remapCoordinate(ey - radius_y, height, mode);
+        for (int ex = 0; ex < extended_width; ex++) {
+            int x = GaussianBlurProcessor::remapCoordinate(ex - radius_x, width, mode);
+            extended[static_cast<size_t>(ey) * extended_width + ex] =
+                (x < 0 || y < 0) ? border_constant : input_data[static_cast<size_t>(y) * width + x];
+        }
+    }
+    metrics.memory_used = extended.size() * sizeof(float);
+
+    if (!use_fft) {
+        #pragma omp parallel
+        {
+            std::vector<float> sum(width);
+
+            #pragma omp for schedule(static)
+            for (int y = 0; y < height; y++) {
+                std::fill(sum.begin(), sum.end(), 0.0f);
+                for (int j = 0; j < kernel_height; j++) {
+                    const float* row = extended.data() + static_cast<size_t>(y + j) * extended_width;
+                    for (int i = 0; i < kernel_width; i++) {
+                        const float weight = weights[j * kernel_width + i];
+                        const float* source = row + i;
+                        #pragma omp simd
+                        for (int x = 0; x < width; x++) sum[x] += weight * source[x];
+                    }
+                }
+                unsigned char* output = output_data + static_cast<size_t>(y) * width;
+                for (int x = 0; x < width; x++) {
+                    output[x] = static_cast<unsigned char>(std::min(std::max(sum[x] + 0.5f, 0.0f), 255.0f));
+                }
+            }
+        }
+    } else {
+        const int tile_size = GaussianBlurProcessor::fftTileSize(kernel_width, kernel_height);
+        const size_t tile_area = static_cast<size_t>(tile_size) * tile_size;
+        const int block_x = tile_size - kernel_width + 1;
+        const int block_y = tile_size - kernel_height + 1;
+        const int tiles_x = (extended_width + block_x - 1) / block_x;
+        const int tiles_y = (extended_height + block_y - 1) / block_y;
+        const float scale = 1.0f / tile_area;
+
+        // Spectrum of the flipped kernel, same orientation as the direct path
+        std::vector<std::complex<float> > spectrum(tile_area);
+        for (int j = 0; j < kernel_height; j++) {
+            for (int i = 0; i < kernel_width; i++) {
+                spectrum[static_cast<size_t>(j) * tile_size + i] =
+                    weights[(kernel_height - 1 - j) * kernel_width + (kernel_width - 1 - i)];
+            }
+        }
+        fft2D(spectrum.data(), tile_size, -1.0f);
+
+        // Result on the extended grid, pixel (x, y) is at (x + radius_x, y + radius_y)
+        std::vector<float> result(static_cast<size_t>(extended_width) * extended_height, 0.0f);
+        metrics.memory_used += spectrum.size() * sizeof(std::complex<float>) + result.size() * sizeof(float);
+
+        for (int parity = 0; parity < 2; parity++) {
+            #pragma omp parallel
+            {
+                std::vector<std::complex<float> > tile(tile_area);
+
+                #pragma omp for schedule(dynamic)
+                for (int by = parity; by < tiles_y; by += 2) {
+                    for (int bx = 0; bx < tiles_x; bx++) {
+                        std::fill(tile.begin(), tile.end(), std::complex<float>(0.0f, 0.0f));
+                        for (int j = 0; j < block_y && by * block_y + j < extended_height; j++) {
+                            const float* row = extended.data() +
+                                static_cast<size_t>(by * block_y + j) * extended_width + bx * block_x;
+                            for (int i = 0; i < block_x && bx * block_x + i < extended_width; i++) {
+                                tile[static_cast<size_t>(j) * tile_size + i] = row[i];
+                            }
+                        }
+
+                        fft2D(tile.data(), tile_size, -1.0f);
+                        for (size_t i = 0; i < tile_area; i++) tile[i] *= spectrum[i];
+                        fft2D(tile.data(), tile_size, 1.0f);
+
+                        // Sample p of the tile goes to the extended coordinate b * block - radius + p
+                        for (int j = 0; j < tile_size; j++) {
+                            int ey = by * block_y - radius_y + j;
+                            if (ey < 0 || ey >= extended_height) continue;
+                            float* row = result.data() + static_cast<size_t>(ey) * extended_width;
+                            for (int i = 0; i < tile_size; i++) {
+                                int ex = bx * block_x - radius_x + i;
+                                if (ex < 0 || ex >= extended_width) continue;
+                                row[ex] += tile[static_cast<size_t>(j) * tile_size + i].real() * scale;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; y++) {
+            const float* row = result.data() + static_cast<size_t>(y + radius_y) * extended_width + radius_x;
+            unsigned char* output = output_data + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; x++) {
+                output[x] = static_cast<unsigned char>(std::min(std::max(row[x] + 0.5f, 0.0f), 255.0f));
+            }
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+void CPUBlurProcessor::firColumns(const float* input, float* output, unsigned char* byte_output,
+                                  int columns, int length, const std::vector<float>& weights,
+                                  const unsigned char* original, const UnsharpMask* unsharp) const {
+    /*
+    1D convolution down every column, blocks of IIR_COLUMN_BLOCK columns as
+    in boxColumns. The rows outside the buffer follow the border mode (copy
+    is handled as clamp). With unsharp the bytes are the sharpened original
+    (same layout as byte_output), as in fir_unsharp_columns.
+    */
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const int radius = static_cast<int>(weights.size() / 2);
+
+    #pragma omp parallel for schedule(static)
+    for (int block = 0; block < columns; block += IIR_COLUMN_BLOCK) {
+        const int count = std::min(IIR_COLUMN_BLOCK, columns - block);
+        float sum[IIR_COLUMN_BLOCK];
+        float constant_row[IIR_COLUMN_BLOCK];
+        std::fill(constant_row, constant_row + count, static_cast<float>(border_constant));
+
+        for (int n = 0; n < length; n++) {
+            std::fill(sum, sum + count, 0.0f);
+            for (int k = -radius; k <= radius; k++) {
+                int row = GaussianBlurProcessor::remapCoordinate(n + k, length, mode);
+                const float* in = (row < 0) ? constant_row : input + static_cast<size_t>(row) * columns + block;
+                const float weight = weights[k + radius];
+                #pragma omp simd
+                for (int x = 0; x < count; x++) sum[x] += weight * in[x];
+            }
+
+            if (unsharp) {
+                unsigned char* dst = byte_output + static_cast<size_t>(n) * columns + block;
+                const unsigned char* src = original + static_cast<size_t>(n) * columns + block;
+                for (int x = 0; x < count; x++) {
+                    float value = src[x];
+                    float difference = value - sum[x];
+                    if (std::fabs(difference) >= unsharp->threshold) value += unsharp->amount * difference;
+                    dst[x] = static_cast<unsigned char>(std::min(std::max(value + 0.5f, 0.0f), 255.0f));
+                }
+            } else if (byte_output) {
+                unsigned char* dst = byte_output + static_cast<size_t>(n) * columns + block;
+                #pragma omp simd
+                for (int x = 0; x < count; x++) {
+                    dst[x] = static_cast<unsigned char>(std::min(std::max(sum[x] + 0.5f, 0.0f), 255.0f));
+                }
+            } else {
+                std::copy(sum, sum + count, output + static_cast<size_t>(n) * columns + block);
+            }
+        }
+    }
+}
+
+ProcessingMetrics CPUBlurProcessor::processImageSeparable(const unsigned char* input_data, unsigned char* output_data,
+                                                          int width, int height, const UnsharpMask* unsharp) {
+    // Same passes as the OpenCL engine: rows on the transposed image, then columns (sharpening with unsharp)
+    ProcessingMetrics metrics = {};
+    std::vector<float> line = GaussianBlurProcessor::create_separable_kernel(sigma);
+    std::vector<float> transposed(static_cast<size_t>(width) * height);
+    std::vector<float> image(static_cast<size_t>(width) * height);
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    transpose(input_data, image.data(), width, height);
+    firColumns(image.data(), transposed.data(), NULL, height, width, line);
+    transpose(transposed.data(), image.data(), height, width);
+    firColumns(image.data(), NULL, output_data, width, height, line, input_data, unsharp);
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    metrics.memory_used = (transposed.size() + image.size()) * sizeof(float);
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::buildPyramid(const unsigned char* input_data, int width, int height,
+                                                 int num_levels, std::vector<unsigned char>& pyramid,
+                                                 std::vector<PyramidLevel>& levels){
+    /*
+    Host twin of GaussianBlurProcessor::buildPyramid(), same layout and bytes.
+    Each output row sums its PYRAMID_TAPS source rows into a float row
+    (vectorized along the row), then the row is filtered and decimated.
+    Copy is handled as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const float* weights = GaussianBlurProcessor::pyramidWeights();
+    const int half = PYRAMID_TAPS / 2;
+
+    levels = GaussianBlurProcessor::pyramidLayout(width, height, num_levels);
+    const PyramidLevel& last = levels.back();
+    pyramid.resize(last.offset + static_cast<size_t>(last.width) * last.height);
+    metrics.memory_used = pyramid.size();
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::copy(input_data, input_data + static_cast<size_t>(width) * height, pyramid.data());
+    for (size_t l = 1; l < levels.size(); l++) {
+        const PyramidLevel& src = levels[l - 1];
+        const PyramidLevel& dst = levels[l];
+        const unsigned char* source = pyramid.data() + src.offset;
+        unsigned char* output = pyramid.data() + dst.offset;
+
+        #pragma omp parallel
+        {
+            // Source row filtered vertically, with half columns of border on each side
+            std::vector<float> columns(src.width + 2 * half);
+            const float constant_value = border_constant;
+
+            #pragma omp for schedule(static)
+            for (int y = 0; y < dst.height; y++) {
+                const unsigned char* rows[PYRAMID_TAPS];
+                for (int j = 0; j < PYRAMID_TAPS; j++) {
+                    int sy = GaussianBlurProcessor::remapCoordinate(2 * y + j - half, src.height, mode);
+                    rows[j] = (sy < 0) ? NULL : source + static_cast<size_t>(sy) * src.width;
+                }
+
+                float* line = columns.data() + half;
+                std::fill(line, line + src.width, 0.0f);
+                for (int j = 0; j < PYRAMID_TAPS; j++) {
+                    const float weight = weights[j];
+                    const unsigned char* row = rows[j];
+                    if (row) {
+                        #pragma omp simd
+                        for (int x = 0; x < src.width; x++) line[x] += weight * row[x];
+                    } else {
+                        #pragma omp simd
+                        for (int x = 0; x < src.width; x++) line[x] += weight * constant_value;
+                    }
+                }
+
+                // Border columns: remapped, or the constant filtered vertically
+                for (int k = 1; k <= half; k++) {
+                    int left = GaussianBlurProcessor::remapCoordinate(-k, src.width, mode);
+                    int right = GaussianBlurProcessor::remapCoordinate(src.width - 1 + k, src.width, mode);
+                    float constant_column = 0.0f;
+                    for (int j = 0; j < PYRAMID_TAPS; j++) constant_column += weights[j] * constant_value;
+                    line[-k] = (left < 0) ? constant_column : line[left];
+                    line[src.width - 1 + k] = (right < 0) ? constant_column : line[right];
+                }
+
+                unsigned char* out = output + static_cast<size_t>(y) * dst.width;
+                #pragma omp simd
+                for (int x = 0; x < dst.width; x++) {
+                    const float* taps = line + 2 * x - half;
+                    float sum = 0.0f;
+                    for (int i = 0; i < PYRAMID_TAPS; i++) sum += weights[i] * taps[i];
+                    out[x] = static_cast<unsigned char>(std::min(std::max(sum + 0.5f, 0.0f), 255.0f));
+                }
+            }
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::detectEdges(const unsigned char* input_data, unsigned char* output_data,
+                                                int width, int height, float low_threshold, float high_threshold){
+    /*
+    Host twin of GaussianBlurProcessor::detectEdges(). The device sqrt and
+    contractions are not correctly rounded, so a pixel whose magnitude is
+    within an ulp of a threshold may get another label there. The Sobel
+    pass works on three padded rows so its loop over the row vectorizes; the
+    hysteresis is a flood fill from the strong edges instead of repeated
+    propagation steps, which reaches the same fixed point. Copy is handled
+    as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    metrics.algorithm = BLUR_SEPARABLE;
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<float> line = GaussianBlurProcessor::create_separable_kernel(sigma);
+    std::vector<float> transposed(pixels), smoothed(pixels), magnitude(pixels);
+    std::vector<unsigned char> direction(pixels);
+    metrics.memory_used = 3 * pixels * sizeof(float) + pixels;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    transpose(input_data, smoothed.data(), width, height);
+    firColumns(smoothed.data(), transposed.data(), NULL, height, width, line);
+    transpose(transposed.data(), smoothed.data(), height, width);
+    firColumns(smoothed.data(), magnitude.data(), NULL, width, height, line);
+    smoothed.swap(magnitude);
+
+    #pragma omp parallel
+    {
+        // Rows y - 1, y, y + 1 with one column of border on each side
+        std::vector<float> padded(3 * static_cast<size_t>(width + 2));
+        std::vector<float> gx(width), gy(width);
+
+        #pragma omp for schedule(static)
+        for (int y = 0; y < height; y++) {
+            for (int j = 0; j < 3; j++) {
+                float* row = padded.data() + j * static_cast<size_t>(width + 2);
+                int sy = GaussianBlurProcessor::remapCoordinate(y + j - 1, height, mode);
+                if (sy < 0) {
+                    std::fill(row, row + width + 2, static_cast<float>(border_constant));
+                    continue;
+                }
+                const float* source = smoothed.data() + static_cast<size_t>(sy) * width;
+                int left = GaussianBlurProcessor::remapCoordinate(-1, width, mode);
+                int right = GaussianBlurProcessor::remapCoordinate(width, width, mode);
+                std::copy(source, source + width, row + 1);
+                row[0] = (left < 0) ? border_constant : source[left];
+                row[width + 1] = (right < 0) ? border_constant : source[right];
+            }
+
+            const float* top = padded.data();
+            const float* middle = top + width + 2;
+            const float* bottom = middle + width + 2;
+            #pragma omp simd
+            for (int x = 0; x < width; x++) {
+                gx[x] = (top[x + 2] + 2.0f * middle[x + 2] + bottom[x + 2]) - (top[x] + 2.0f * middle[x] + bottom[x]);
+                gy[x] = (bottom[x] + 2.0f * bottom[x + 1] + bottom[x + 2]) - (top[x] + 2.0f * top[x + 1] + top[x + 2]);
+                magnitude[static_cast<size_t>(y) * width + x] = std::sqrt(gx[x] * gx[x] + gy[x] * gy[x]);
+            }
+            for (int x = 0; x < width; x++) {
+                float ax = std::fabs(gx[x]), ay = std::fabs(gy[x]);
+                unsigned char sector;
+                if (ay <= ax * TAN_22_5) sector = 0;
+                else if (ax <= ay * TAN_22_5) sector = 2;
+                else sector = (gx[x] * gy[x] > 0.0f) ? 1 : 3;
+                direction[static_cast<size_t>(y) * width + x] = sector;
+            }
+        }
+    }
+
+    // Non-maximum suppression and double threshold
+    static const int dx[4] = {1, 1, 0, -1};
+    static const int dy[4] = {0, 1, 1, 1};
+    std::vector<int> strong;
+    #pragma omp parallel
+    {
+        std::vector<int> local;
+        #pragma omp for schedule(static)
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t i = static_cast<size_t>(y) * width + x;
+                int sector = direction[i];
+                float m = magnitude[i];
+                int ax = x + dx[sector], ay = y + dy[sector];
+                int bx = x - dx[sector], by = y - dy[sector];
+                float after = (ax >= 0 && ax < width && ay < height) ? magnitude[static_cast<size_t>(ay) * width + ax] : 0.0f;
+                float before = (bx >= 0 && bx < width && by >= 0) ? magnitude[static_cast<size_t>(by) * width + bx] : 0.0f;
+
+                unsigned char label = 0;
+                if (m > before && m >= after && m >= low_threshold) {
+                    label = (m >= high_threshold) ? EDGE_STRONG : EDGE_WEAK;
+                    if (label == EDGE_STRONG) local.push_back(static_cast<int>(i));
+                }
+                output_data[i] = label;
+            }
+        }
+        #pragma omp critical
+        strong.insert(strong.end(), local.begin(), local.end());
+    }
+
+    // Hysteresis: the weak edges 8-connected to a strong one become strong
+    while (!strong.empty()) {
+        int i = strong.back();
+        strong.pop_back();
+        int x = i % width, y = i / width;
+        for (int j = std::max(y - 1, 0); j <= std::min(y + 1, height - 1); j++) {
+            for (int k = std::max(x - 1, 0); k <= std::min(x + 1, width - 1); k++) {
+                size_t n = static_cast<size_t>(j) * width + k;
+                if (output_data[n] == EDGE_WEAK) {
+                    output_data[n] = EDGE_STRONG;
+                    strong.push_back(static_cast<int>(n));
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < pixels; i++) {
+        if (output_data[i] != EDGE_STRONG) output_data[i] = 0;
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processBilateral(const unsigned char* input_data, unsigned char* output_data,
+                                                     int width, int height, double spatial_sigma, double range_sigma){
+    /*
+    Host twin of GaussianBlurProcessor::processBilateral(), same grid and
+    passes. The splat walks the image once (rows of cells in parallel), the
+    grid is blurred by firColumns between transposes.
+    */
+    ProcessingMetrics metrics = {};
+    metrics.algorithm = BLUR_SEPARABLE;
+    const BilateralGrid grid = GaussianBlurProcessor::bilateralGrid(width, height, spatial_sigma, range_sigma);
+    const size_t plane = static_cast<size_t>(grid.width) * grid.height;
+    std::vector<float> cells(2 * plane * grid.depth, 0.0f), work(cells.size());
+    std::vector<float> line = GaussianBlurProcessor::create_separable_kernel(BILATERAL_GRID_SIGMA);
+    metrics.memory_used = 2 * cells.size() * sizeof(float);
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    // [z][c][y][x], a thread owns the rows of cells it splats into
+    #pragma omp parallel for schedule(dynamic)
+    for (int cy = grid.padding; cy < grid.height - grid.padding; cy++) {
+        for (int y = 0; y < height; y++) {
+            if (static_cast<int>(y * grid.spatial_scale + 0.5f) + grid.padding != cy) continue;
+            const unsigned char* row = input_data + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; x++) {
+                int cx = static_cast<int>(x * grid.spatial_scale + 0.5f) + grid.padding;
+                float value = row[x];
+                int z = static_cast<int>(value * grid.range_scale + 0.5f) + grid.padding;
+                size_t cell = static_cast<size_t>(cy) * grid.width + cx;
+                cells[2 * z * plane + cell] += value;
+                cells[(2 * z + 1) * plane + cell] += 1.0f;
+            }
+        }
+    }
+
+    // The padding keeps every tap inside the grid, the border mode does not matter
+    const int rows_zcy = grid.depth * 2 * grid.height;
+    const int rows_xzc = grid.width * grid.depth * 2;
+    firColumns(cells.data(), work.data(), NULL, static_cast<int>(2 * plane), grid.depth, line);
+    transpose(work.data(), cells.data(), grid.width, rows_zcy);
+    firColumns(cells.data(), work.data(), NULL, rows_zcy, grid.width, line);
+    transpose(work.data(), cells.data(), grid.height, rows_xzc);
+    firColumns(cells.data(), work.data(), NULL, rows_xzc, grid.height, line);
+
+    // Trilinear slicing of the [y][x][z] (value, weight) grid
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        float fy = y * grid.spatial_scale + grid.padding;
+        int iy = static_cast<int>(fy);
+        float wy = fy - iy;
+        for (int x = 0; x < width; x++) {
+            float value = input_data[static_cast<size_t>(y) * width + x];
+            float fx = x * grid.spatial_scale + grid.padding;
+            float fz = value * grid.range_scale + grid.padding;
+            int ix = static_cast<int>(fx), iz = static_cast<int>(fz);
+            float wx = fx - ix, wz = fz - iz;
+
+            float sum = 0.0f, weight_sum = 0.0f;
+            for (int dy = 0; dy <= 1; dy++) {
+                for (int dx = 0; dx <= 1; dx++) {
+                    const float* column = work.data() +
+                        2 * ((static_cast<size_t>(iy + dy) * grid.width + ix + dx) * grid.depth + iz);
+                    float weight = (dy ? wy : 1.0f - wy) * (dx ? wx : 1.0f - wx);
+                    sum += weight * ((1.0f - wz) * column[0] + wz * column[2]);
+                    weight_sum += weight * ((1.0f - wz) * column[1] + wz * column[3]);
+                }
+            }
+            float result = (weight_sum > 0.0f) ? sum / weight_sum + 0.5f : value;
+            output_data[static_cast<size_t>(y) * width + x] =
+                static_cast<unsigned char>(std::min(std::max(result, 0.0f), 255.0f));
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processMedian(const unsigned char* input_data, unsigned char* output_data,
+                                                  int width, int height, int radius){
+    /*
+    Median in constant time per pixel whatever the radius (Perreault and
+    Hebert): every column keeps the histogram of its 2 radius + 1 rows,
+    updated by one removal and one addition when the window moves down,
+    and the window histogram moves right by adding one column histogram and
+    subtracting another. Both are split in 16 coarse and 256 fine bins, the
+    median is found in at most 32 steps. The image is padded once following
+    the border mode (copy as clamp), stripes of MEDIAN_STRIPE columns run in
+    parallel.
+    */
+    ProcessingMetrics metrics = {};
+    if (radius < 1) {
+        fprintf(stderr, "The median radius must be at least 1\n");
+        exit(EXIT_FAILURE);
+    }
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const int padded_width = width + 2 * radius;
+    const int padded_height = height + 2 * radius;
+    const int window = 2 * radius + 1;
+    const unsigned int half = static_cast<unsigned int>(window) * window / 2;
+    std::vector<unsigned char> padded(static_cast<size_t>(padded_width) * padded_height);
+    metrics.memory_used = padded.size();
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < padded_height; y++) {
+        int sy = GaussianBlurProcessor::remapCoordinate(y - radius, height, mode);
+        unsigned char* row = padded.data() + static_cast<size_t>(y) * padded_width;
+        for (int x = 0; x < padded_width; x++) {
+            int sx = GaussianBlurProcessor::remapCoordinate(x - radius, width, mode);
+            row[x] = (sx < 0 || sy < 0) ? border_constant : input_data[static_cast<size_t>(sy) * width + sx];
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int x0 = 0; x0 < width; x0 += MEDIAN_STRIPE) {
+        const int x1 = std::min(x0 + MEDIAN_STRIPE, width);
+        const int num_columns = x1 - x0 + 2 * radius;     // padded columns x0 .. x1 + 2 radius - 1
+        std::vector<uint16_t> fine(static_cast<size_t>(num_columns) * 256, 0);
+        std::vector<uint16_t> coarse(static_cast<size_t>(num_columns) * 16, 0);
+        uint32_t window_fine[256], window_coarse[16];
+
+        for (int y = 0; y < window; y++) {
+            const unsigned char* row = padded.data() + static_cast<size_t>(y) * padded_width + x0;
+            for (int c = 0; c < num_columns; c++) {
+                fine[c * 256 + row[c]]++;
+                coarse[c * 16 + (row[c] >> 4)]++;
+            }
+        }
+
+        for (int y = 0; y < height; y++) {
+            if (y > 0) {
+                const unsigned char* removed = padded.data() + static_cast<size_t>(y - 1) * padded_width + x0;
+                const unsigned char* added = padded.data() + static_cast<size_t>(y + 2 * radius) * padded_width + x0;
+                for (int c = 0; c < num_columns; c++) {
+                    fine[c * 256 + removed[c]]--;
+                    coarse[c * 16 + (removed[c] >> 4)]--;
+                    fine[c * 256 + added[c]]++;
+                    coarse[c * 16 + (added[c] >> 4)]++;
+                }
+            }
+
+            std::fill(window_fine, window_fine + 256, 0u);
+            std::fill(window_coarse, window_coarse + 16, 0u);
+            for (int c = 0; c < window; c++) {
+                #pragma omp simd
+                for (int v = 0; v < 256; v++) window_fine[v] += fine[c * 256 + v];
+                for (int v = 0; v < 16; v++) window_coarse[v] += coarse[c * 16 + v];
+            }
+
+            unsigned char* output = output_data + static_cast<size_t>(y) * width;
+            for (int x = x0; x < x1; x++) {
+                if (x > x0) {
+                    const uint16_t* in_fine = fine.data() + (x - x0 + 2 * radius) * 256;
+                    const uint16_t* out_fine = fine.data() + (x - x0 - 1) * 256;
+                    #pragma omp simd
+                    for (int v = 0; v < 256; v++) window_fine[v] += in_fine[v] - out_fine[v];
+                    const uint16_t* in_coarse = coarse.data() + (x - x0 + 2 * radius) * 16;
+                    const uint16_t* out_coarse = coarse.data() + (x - x0 - 1) * 16;
+                    for (int v = 0; v < 16; v++) window_coarse[v] += in_coarse[v] - out_coarse[v];
+                }
+
+                // Smallest value with more than half of the window at or below it
+                unsigned int count = 0;
+                int bin = 0;
+                while (count + window_coarse[bin] <= half) count += window_coarse[bin++];
+                int value = bin * 16;
+                while (count + window_fine[value] <= half) count += window_fine[value++];
+                output[x] = static_cast<unsigned char>(value);
+            }
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+void CPUBlurProcessor::vhgwColumns(const float* input, float* output, unsigned char* byte_output, int columns,
+                                   int length, int radius, bool dilate) const {
+    /*
+    Running minimum or maximum down every column, van Herk / Gil-Werman as
+    in vhgw_columns, on blocks of IIR_COLUMN_BLOCK columns so the three
+    comparisons per pixel vectorize along the row. The rows outside the
+    buffer follow the border mode (copy is handled as clamp).
+    */
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const int window = 2 * radius + 1;
+    const int padded = length + 2 * radius;
+
+    #pragma omp parallel
+    {
+        std::vector<float> prefix(static_cast<size_t>(padded) * IIR_COLUMN_BLOCK);
+        float running[IIR_COLUMN_BLOCK];
+        float constant_row[IIR_COLUMN_BLOCK];
+        std::fill(constant_row, constant_row + IIR_COLUMN_BLOCK, static_cast<float>(border_constant));
+
+        #pragma omp for schedule(static)
+        for (int block = 0; block < columns; block += IIR_COLUMN_BLOCK) {
+            const int count = std::min(IIR_COLUMN_BLOCK, columns - block);
+
+            for (int p = 0; p < padded; p++) {
+                int row = GaussianBlurProcessor::remapCoordinate(p - radius, length, mode);
+                const float* in = (row < 0) ? constant_row : input + static_cast<size_t>(row) * columns + block;
+                float* out = prefix.data() + static_cast<size_t>(p) * IIR_COLUMN_BLOCK;
+                if (p % window == 0) {
+                    std::copy(in, in + count, out);
+                } else if (dilate) {
+                    #pragma omp simd
+                    for (int x = 0; x < count; x++) out[x] = std::max(out[x - IIR_COLUMN_BLOCK], in[x]);
+                } else {
+                    #pragma omp simd
+                    for (int x = 0; x < count; x++) out[x] = std::min(out[x - IIR_COLUMN_BLOCK], in[x]);
+                }
+            }
+
+            for (int p = padded - 1; p >= 0; p--) {
+                int row = GaussianBlurProcessor::remapCoordinate(p - radius, length, mode);
+                const float* in = (row < 0) ? constant_row : input + static_cast<size_t>(row) * columns + block;
+                if (p % window == window - 1 || p == padded - 1) {
+                    std::copy(in, in + count, running);
+                } else if (dilate) {
+                    #pragma omp simd
+                    for (int x = 0; x < count; x++) running[x] = std::max(running[x], in[x]);
+                } else {
+                    #pragma omp simd
+                    for (int x = 0; x < count; x++) running[x] = std::min(running[x], in[x]);
+                }
+                if (p >= length) continue;
+
+                const float* tail = prefix.data() + static_cast<size_t>(p + 2 * radius) * IIR_COLUMN_BLOCK;
+                if (byte_output) {
+                    unsigned char* dst = byte_output + static_cast<size_t>(p) * columns + block;
+                    for (int x = 0; x < count; x++) {
+                        float result = dilate ? std::max(running[x], tail[x]) : std::min(running[x], tail[x]);
+                        dst[x] = static_cast<unsigned char>(result);
+                    }
+                } else {
+                    float* dst = output + static_cast<size_t>(p) * columns + block;
+                    #pragma omp simd
+                    for (int x = 0; x < count; x++) {
+                        dst[x] = dilate ? std::max(running[x], tail[x]) : std::min(running[x], tail[x]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+ProcessingMetrics CPUBlurProcessor::processMorphology(const unsigned char* input_data, unsigned char* output_data,
+                                                      int width, int height, MorphologyOp op,
+                                                      int radius_x, int radius_y){
+    // Host twin of GaussianBlurProcessor::processMorphology(), same passes on the whole image
+    ProcessingMetrics metrics = {};
+    if (radius_x < 0 || radius_y < 0) {
+        fprintf(stderr, "Morphology radii must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+    std::vector<bool> dilations;
+    if (op == MORPH_ERODE || op == MORPH_OPEN) dilations.push_back(false);
+    if (op != MORPH_ERODE) dilations.push_back(true);
+    if (op == MORPH_CLOSE) dilations.push_back(false);
+
+    std::vector<float> transposed(static_cast<size_t>(width) * height);
+    std::vector<float> image(transposed.size());
+    metrics.memory_used = (transposed.size() + image.size()) * sizeof(float);
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    transpose(input_data, image.data(), width, height);
+    for (size_t i = 0; i < dilations.size(); i++) {
+        bool last_op = (i + 1 == dilations.size());
+        vhgwColumns(image.data(), transposed.data(), NULL, height, width, radius_x, dilations[i]);
+        transpose(transposed.data(), image.data(), height, width);
+        if (last_op) {
+            vhgwColumns(image.data(), NULL, output_data, width, height, radius_y, dilations[i]);
+        } else {
+            vhgwColumns(image.data(), transposed.data(), NULL, width, height, radius_y, dilations[i]);
+            transpose(transposed.data(), image.data(), width, height);
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::summedAreaTable(const unsigned char* input_data, int width, int height,
+                                                    std::vector<cl_uint>& sums, std::vector<cl_ulong>* squares){
+    /*
+    Host twin of GaussianBlurProcessor::summedAreaTable(), same layout. The
+    rows are prefix-summed in parallel, then every row of the table adds the
+    one above it, a loop along the row that vectorizes.
+    */
+    ProcessingMetrics metrics = {};
+    const int pitch = width + 1;
+    const size_t entries = static_cast<size_t>(pitch) * (height + 1);
+    sums.assign(entries, 0);
+    if (squares) squares->assign(entries, 0);
+    metrics.memory_used = entries * (sizeof(cl_uint) + (squares ? sizeof(cl_ulong) : 0));
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = input_data + static_cast<size_t>(y) * width;
+        cl_uint* out = sums.data() + static_cast<size_t>(y + 1) * pitch;
+        cl_uint sum = 0;
+        for (int x = 0; x < width; x++) out[x + 1] = sum += row[x];
+        if (squares) {
+            cl_ulong* out_squares = squares->data() + static_cast<size_t>(y + 1) * pitch;
+            cl_ulong sum_squares = 0;
+            for (int x = 0; x < width; x++) out_squares[x + 1] = sum_squares += row[x] * row[x];
+        }
+    }
+
+    for (int y = 2; y <= height; y++) {
+        const cl_uint* above = sums.data() + static_cast<size_t>(y - 1) * pitch;
+        cl_uint* out = sums.data() + static_cast<size_t>(y) * pitch;
+        #pragma omp simd
+        for (int x = 0; x < pitch; x++) out[x] += above[x];
+        if (squares) {
+            const cl_ulong* above_squares = squares->data() + static_cast<size_t>(y - 1) * pitch;
+            cl_ulong* out_squares = squares->data() + static_cast<size_t>(y) * pitch;
+            #pragma omp simd
+            for (int x = 0; x < pitch; x++) out_squares[x] += above_squares[x];
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processLocalStatistic(const unsigned char* input_data, unsigned char* output_data,
+                                                          int width, int height, LocalStatistic statistic,
+                                                          int radius_x, int radius_y){
+    // Host twin of GaussianBlurProcessor::processLocalStatistic(), same float arithmetic as sat_statistics
+    std::vector<cl_uint> sums;
+    std::vector<cl_ulong> squares;
+    ProcessingMetrics metrics = summedAreaTable(input_data, width, height, sums,
+                                                (statistic == STAT_MEAN) ? NULL : &squares);
+    const size_t pitch = width + 1;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        const int y0 = std::max(y - radius_y, 0), y1 = std::min(y + radius_y + 1, height);
+        for (int x = 0; x < width; x++) {
+            const int x0 = std::max(x - radius_x, 0), x1 = std::min(x + radius_x + 1, width);
+            const float count = static_cast<float>((x1 - x0) * (y1 - y0));
+            cl_uint sum = sums[y1 * pitch + x1] - sums[y0 * pitch + x1] - sums[y1 * pitch + x0] + sums[y0 * pitch + x0];
+            float mean = sum / count;
+            float value = mean;
+            if (statistic != STAT_MEAN) {
+                cl_ulong sum_squares = squares[y1 * pitch + x1] - squares[y0 * pitch + x1]
+                                     - squares[y1 * pitch + x0] + squares[y0 * pitch + x0];
+                float deviation = std::sqrt(std::max(sum_squares / count - mean * mean, 0.0f));
+                value = (statistic == STAT_STDDEV) ? deviation
+                      : 128.0f + CONTRAST_SCALE * (input_data[static_cast<size_t>(y) * width + x] - mean) /
+                                 (deviation + CONTRAST_EPSILON);
+            }
+            output_data[static_cast<size_t>(y) * width + x] =
+                static_cast<unsigned char>(std::min(std::max(value + 0.5f, 0.0f), 255.0f));
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    double statistics_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.total_processing_time += statistics_time;
+    metrics.kernel_execution_time += statistics_time;
+    metrics.memory_used += static_cast<size_t>(width) * height;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processNLMeans(const unsigned char* input_data, unsigned char* output_data,
+                                                   int width, int height, int patch_radius, double sigma,
+                                                   double lambda, double alpha){
+    /*
+    Same algorithm and float arithmetic as the OpenCL engine: for every
+    offset of the search window the squared differences with the shifted
+    image are summed along the rows (sliding over 2 p + 1 columns), then
+    every pixel whose neighbour passes the pre-selection adds the weight of
+    each partial patch distance down its 2 p + 1 rows. Rows then pixels run
+    in parallel.
+    */
+    ProcessingMetrics metrics = {};
+    if (patch_radius < 0) {
+        fprintf(stderr, "NL-means needs a patch radius >= 0\n");
+        exit(EXIT_FAILURE);
+    }
+    std::vector<float> guide;
+    const double deviation = GaussianBlurProcessor::nlmeansPreselection(input_data, width, height, sigma, guide);
+    if (lambda < 0) lambda = GaussianBlurProcessor::nlmeansBandwidth(patch_radius);
+    const float h2 = static_cast<float>(-0.5 / (lambda * sigma * sigma));
+    const int search_radius = static_cast<int>(alpha * patch_radius);
+    const size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<cl_uint> row_sums(pixels);
+    std::vector<float> weighted_sum(pixels, 0.0f), weight_sum(pixels, 0.0f), max_weight(pixels, -1.0f);
+    metrics.memory_used = pixels * (sizeof(cl_uint) + 4 * sizeof(float));
+
+    auto difference = [&](int x, int y, int dx, int dy) -> cl_uint {
+        int nx = x + dx, ny = y + dy;
+        if (x < 0 || x >= width || nx < 0 || nx >= width || ny < 0 || ny >= height) return 0;
+        int d = static_cast<int>(input_data[static_cast<size_t>(ny) * width + nx]) -
+                static_cast<int>(input_data[static_cast<size_t>(y) * width + x]);
+        return d * d;
+    };
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    for (int dy = -search_radius; dy <= search_radius; dy++) {
+        for (int dx = -search_radius; dx <= search_radius; dx++) {
+            if (dx == 0 && dy == 0) continue;
+
+            #pragma omp parallel for schedule(static)
+            for (int y = 0; y < height; y++) {
+                cl_uint* sums = row_sums.data() + static_cast<size_t>(y) * width;
+                cl_uint sum = 0;
+                for (int x = -patch_radius; x < patch_radius; x++) sum += difference(x, y, dx, dy);
+                for (int x = 0; x < width; x++) {
+                    sum += difference(x + patch_radius, y, dx, dy);
+                    sums[x] = sum;
+                    sum -= difference(x - patch_radius, y, dx, dy);
+                }
+            }
+
+            #pragma omp parallel for schedule(static)
+            for (int y = 0; y < height; y++) {
+                int ny = y + dy;
+                if (ny < 0 || ny >= height) continue;
+                for (int x = 0; x < width; x++) {
+                    int nx = x + dx;
+                    size_t i = static_cast<size_t>(y) * width + x;
+                    size_t j = static_cast<size_t>(ny) * width + nx;
+                    if (nx < 0 || nx >= width || !(std::fabs(guide[i] - guide[j]) / deviation < 3.0)) continue;
+
+                    // One weight per patch row, on the distance of the rows so far, as the plugin does
+                    cl_uint distance = 0;
+                    for (int k = -patch_radius; k <= patch_radius; k++) {
+                        if (y + k >= 0 && y + k < height) distance += row_sums[i + static_cast<long>(k) * width];
+                        float w = expf(distance * h2);
+                        weighted_sum[i] += w * input_data[j];
+                        weight_sum[i] += w;
+                        max_weight[i] = std::max(max_weight[i], w);
+                    }
+                }
+            }
+        }
+    }
+
+    // The pixel itself weighs as much as its most similar neighbour, the result is truncated like the plugin's
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < pixels; i++) {
+        float sum = weight_sum[i] + max_weight[i];
+        float value = (sum != 0.0f) ? (weighted_sum[i] + max_weight[i] * input_data[i]) / sum : input_data[i];
+        output_data[i] = static_cast<unsigned char>(std::min(std::max(value, 0.0f), 255.0f));
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processBayer(const void* raw_data, int bits_per_sample, unsigned char* output_data,
+                                                 int width, int height, BayerPattern pattern, DemosaicMethod method){
+    /*
+    Host twin of GaussianBlurProcessor::processBayer(): the demosaic of
+    bayer_demosaic (float, same layout) followed by the separable passes over
+    the 3 colours at once, then the rows of the planes are gathered.
+    */
+    ProcessingMetrics metrics = {};
+    if (bits_per_sample < 1 || bits_per_sample > 16 || width < 2 || height < 2) {
+        fprintf(stderr, "Demosaic needs 1 to 16 bits per sample and at least 2 x 2 pixels\n");
+        exit(EXIT_FAILURE);
+    }
+    const bool shorts = (bits_per_sample > 8);
+    const float scale = 255.0f / ((1 << bits_per_sample) - 1);
+    const bool edge = (method == DEMOSAIC_EDGE_AWARE);
+    const size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<float> line = GaussianBlurProcessor::create_separable_kernel(sigma);
+    std::vector<float> transposed(3 * pixels), image(3 * pixels);
+    std::vector<unsigned char> planes(3 * pixels);
+    metrics.memory_used = (transposed.size() + image.size()) * sizeof(float) + planes.size();
+
+    // Mosaic reflected without repeating the edge, which keeps its parity
+    auto sample = [&](int x, int y) -> float {
+        x = (x < 0) ? -x : ((x >= width) ? 2 * width - 2 - x : x);
+        y = (y < 0) ? -y : ((y >= height) ? 2 * height - 2 - y : y);
+        size_t i = static_cast<size_t>(y) * width + x;
+        return scale * (shorts ? static_cast<const uint16_t*>(raw_data)[i] : static_cast<const unsigned char*>(raw_data)[i]);
+    };
+    auto directed = [](float left, float right, float up, float down) -> float {
+        float cx = 1.0f / (1.0f + (right - left) * (right - left));
+        float cy = 1.0f / (1.0f + (down - up) * (down - up));
+        return (cx * (left + right) + cy * (up + down)) / (2.0f * (cx + cy));
+    };
+    // Red with the parity of the red sites, blue with the inverted parity
+    auto chroma = [&](int x, int y, int px, int py) -> float {
+        if (!px && !py) return sample(x, y);
+        if (!py) return 0.5f * (sample(x - 1, y) + sample(x + 1, y));
+        if (!px) return 0.5f * (sample(x, y - 1) + sample(x, y + 1));
+        if (edge) {
+            return directed(0.5f * (sample(x - 1, y - 1) + sample(x - 1, y + 1)),
+                            0.5f * (sample(x + 1, y - 1) + sample(x + 1, y + 1)),
+                            0.5f * (sample(x - 1, y - 1) + sample(x + 1, y - 1)),
+                            0.5f * (sample(x - 1, y + 1) + sample(x + 1, y + 1)));
+        }
+        return 0.25f * (sample(x - 1, y - 1) + sample(x + 1, y - 1) + sample(x - 1, y + 1) + sample(x + 1, y + 1));
+    };
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel for schedule(static)
+    for (int x = 0; x < width; x++) {
+        const int px = (x + (pattern & 1)) & 1;
+        for (int y = 0; y < height; y++) {
+            const int py = (y + (pattern >> 1)) & 1;
+            float* pixel = transposed.data() + (static_cast<size_t>(x) * height + y) * 3;
+            pixel[0] = chroma(x, y, px, py);
+            if (px != py) {
+                pixel[1] = sample(x, y);
+            } else if (edge) {
+                pixel[1] = directed(sample(x - 1, y), sample(x + 1, y), sample(x, y - 1), sample(x, y + 1));
+            } else {
+                pixel[1] = 0.25f * (sample(x - 1, y) + sample(x + 1, y) + sample(x, y - 1) + sample(x, y + 1));
+            }
+            pixel[2] = chroma(x, y, 1 - px, 1 - py);
+        }
+    }
+
+    firColumns(transposed.data(), image.data(), NULL, 3 * height, width, line);
+    transpose(image.data(), transposed.data(), 3 * height, width);
+    firColumns(transposed.data(), NULL, planes.data(), 3 * width, height, line);
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        for (int c = 0; c < 3; c++) {
+            const unsigned char* src = planes.data() + (static_cast<size_t>(y) * 3 + c) * width;
+            std::copy(src, src + width, output_data + c * pixels + static_cast<size_t>(y) * width);
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    return metrics;
+}
+
+ProcessingMetrics CPUBlurProcessor::processResize(const unsigned char* input_data, int width, int height,
+                                                  std::vector<PyramidLevel>& sizes, std::vector<unsigned char>& outputs){
+    /*
+    Host twin of GaussianBlurProcessor::processResize(), same taps and
+    layout. The rows pass runs in parallel over the source rows, the columns
+    pass over the destination rows, vectorized along them.
+    */
+    ProcessingMetrics metrics = {};
+    size_t total = 0;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        if (sizes[s].width < 1 || sizes[s].height < 1) {
+            fprintf(stderr, "Invalid resize to %d x %d\n", sizes[s].width, sizes[s].height);
+            exit(EXIT_FAILURE);
+        }
+        sizes[s].offset = total;
+        total += static_cast<size_t>(sizes[s].width) * sizes[s].height;
+    }
+    outputs.resize(total);
+    const float constant_value = border_constant;
+    std::vector<cl_int> indices_x, indices_y;
+    std::vector<float> weights_x, weights_y, rows;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    for (size_t s = 0; s < sizes.size(); s++) {
+        const int dst_width = sizes[s].width;
+        const int dst_height = sizes[s].height;
+        const int taps_x = GaussianBlurProcessor::resizeFilter(width, dst_width, border_mode, indices_x, weights_x);
+        const int taps_y = GaussianBlurProcessor::resizeFilter(height, dst_height, border_mode, indices_y, weights_y);
+        rows.resize(static_cast<size_t>(dst_width) * height);
+        metrics.memory_used = std::max(metrics.memory_used, rows.size() * sizeof(float));
+
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; y++) {
+            const unsigned char* in = input_data + static_cast<size_t>(y) * width;
+            float* out = rows.data() + static_cast<size_t>(y) * dst_width;
+            for (int x = 0; x < dst_width; x++) {
+                float sum = 0.0f;
+                for (int k = x * taps_x; k < (x + 1) * taps_x; k++) {
+                    int i = indices_x[k];
+                    sum += weights_x[k] * ((i < 0) ? constant_value : in[i]);
+                }
+                out[x] = sum;
+            }
+        }
+
+        unsigned char* output = outputs.data() + sizes[s].offset;
+        #pragma omp parallel
+        {
+            std::vector<float> sum(dst_width);
+            std::vector<float> constant_row(dst_width, constant_value);
+            #pragma omp for schedule(static)
+            for (int y = 0; y < dst_height; y++) {
+                std::fill(sum.begin(), sum.end(), 0.0f);
+                for (int k = y * taps_y; k < (y + 1) * taps_y; k++) {
+                    int i = indices_y[k];
+                    const float* in = (i < 0) ? constant_row.data() : rows.data() + static_cast<size_t>(i) * dst_width;
+                    const float weight = weights_y[k];
+                    float* acc = sum.data();
+                    #pragma omp simd
+                    for (int x = 0; x < dst_width; x++) acc[x] += weight * in[x];
+                }
+                unsigned char* dst = output + static_cast<size_t>(y) * dst_width;
+                for (int x = 0; x < dst_width; x++) {
+                    dst[x] = static_cast<unsigned char>(std::min(std::max(sum[x] + 0.5f, 0.0f), 255.0f));
+                }
+            }
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.kernel_execution_time = metrics.total_processing_time;
+    metrics.memory_used += total;
+    return metrics;
+}
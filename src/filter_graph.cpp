@@ -0,0 +1,433 @@
+#include "../include/filter_graph.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+FilterGraph::FilterGraph()
+    : context(NULL), commands(NULL), device(NULL), program(NULL), pool_buffer_size(0),
+      input_node(-1), input_channels(1), output_node(-1), border_mode(BORDER_CLAMP), border_constant(0),
+      num_slots(0) {}
+
+FilterGraph::~FilterGraph(){
+    releaseKernels();
+    for (size_t i = 0; i < pool.size(); i++) clReleaseMemObject(pool[i]);
+    if (program) clReleaseProgram(program);
+    if (commands) clReleaseCommandQueue(commands);
+    if (context) clReleaseContext(context);
+}
+
+void FilterGraph::initializeOpenCL(const GaussianBlurProcessor& processor) {
+    // Shares the context and queue of the processor, retained for the lifetime of the graph
+    device = processor.getDevice();
+    context = processor.getContext();
+    commands = processor.getCommandQueue();
+    clRetainContext(context);
+    clRetainCommandQueue(commands);
+}
+
+void FilterGraph::setBorderMode(BorderMode mode, unsigned char constant_value){
+    // Copy has no meaning inside a chain, it is handled as clamp
+    border_mode = (mode == BORDER_COPY) ? BORDER_CLAMP : mode;
+    border_constant = constant_value;
+}
+
+int FilterGraph::addNode(FilterOp op, int a, int b, double p0, double p1){
+    int id = static_cast<int>(nodes.size());
+    if (a >= id || b >= id || (op != OP_INPUT && a < 0)) {
+        fprintf(stderr, "Filter graph nodes must refer to earlier nodes\n");
+        exit(EXIT_FAILURE);
+    }
+    Node node = {op, {a, b}, {p0, p1}};
+    nodes.push_back(node);
+    return id;
+}
+
+int FilterGraph::input(int channels){
+    if (input_node >= 0 || (channels != 1 && channels != 3)) {
+        fprintf(stderr, "Filter graph takes a single input of 1 or 3 channels\n");
+        exit(EXIT_FAILURE);
+    }
+    input_channels = channels;
+    input_node = addNode(OP_INPUT, -1, -1, 0, 0);
+    return input_node;
+}
+
+int FilterGraph::grayscale(int source){
+    if (source < 0 || source >= static_cast<int>(nodes.size()) || nodes[source].op != OP_INPUT) {
+        fprintf(stderr, "Grayscale applies to the input node\n");
+        exit(EXIT_FAILURE);
+    }
+    return addNode(OP_GRAYSCALE, source, -1, 0, 0);
+}
+
+int FilterGraph::blur(int source, double sigma){
+    return addNode(OP_BLUR, source, -1, sigma, 0);
+}
+
+int FilterGraph::unsharp(int source, int blurred, float amount){
+    if (blurred < 0) {
+        fprintf(stderr, "Unsharp needs a blurred node\n");
+        exit(EXIT_FAILURE);
+    }
+    return addNode(OP_UNSHARP, source, blurred, amount, 0);
+}
+
+int FilterGraph::threshold(int source, float level){
+    return addNode(OP_THRESHOLD, source, -1, level, 0);
+}
+
+int FilterGraph::linear(int source, float gain, float bias){
+    return addNode(OP_LINEAR, source, -1, gain, bias);
+}
+
+void FilterGraph::setOutput(int node){
+    if (node < 0 || node >= static_cast<int>(nodes.size())) {
+        fprintf(stderr, "Unknown filter graph node\n");
+        exit(EXIT_FAILURE);
+    }
+    output_node = node;
+}
+
+std::string FilterGraph::literal(double value){
+    std::ostringstream text;
+    text << std::showpoint << std::setprecision(9) << static_cast<float>(value) << "f";
+    return text.str();
+}
+
+void FilterGraph::referencedBlurs(int node, std::vector<bool>& used) const {
+    // Blurs read by the expression of node, the pointwise nodes being inlined
+    if (node < 0) return;
+    if (nodes[node].op == OP_BLUR) {
+        used[node] = true;
+        return;
+    }
+    referencedBlurs(nodes[node].inputs[0], used);
+    referencedBlurs(nodes[node].inputs[1], used);
+}
+
+std::string FilterGraph::expression(int node, const std::string& x, const std::string& y, int local_blur,
+                                    const std::string& indent, std::string& statements,
+                                    std::vector<bool>& emitted) const {
+    /*
+    OpenCL expression of the value of node at (x, y), coordinates inside the
+    image. Operands read more than once are declared beforehand in
+    statements, so that the source stays linear in the number of nodes.
+    */
+    const Node& n = nodes[node];
+    std::string index = "((" + y + ") * width + (" + x + "))";
+    switch (n.op) {
+        case OP_INPUT:
+            return "(float)in0[" + index + "]";
+        case OP_GRAYSCALE:
+            if (input_channels == 1) return "(float)in0[" + index + "]";
+            return "(0.299f * in0[" + index + "] + 0.587f * in0[width * height + " + index +
+                   "] + 0.114f * in0[2 * width * height + " + index + "])";
+        case OP_BLUR: {
+            if (node == local_blur) return "v";
+            int b = static_cast<int>(std::find(blurs.begin(), blurs.end(), node) - blurs.begin());
+            std::ostringstream text;
+            text << "b" << b << "[" << index << "]";
+            return text.str();
+        }
+        case OP_UNSHARP: {
+            std::string a = temporary(n.inputs[0], x, y, local_blur, indent, statements, emitted);
+            std::string b = temporary(n.inputs[1], x, y, local_blur, indent, statements, emitted);
+            return "(" + a + " + " + literal(n.parameters[0]) + " * (" + a + " - " + b + "))";
+        }
+        case OP_THRESHOLD:
+            return "((" + expression(n.inputs[0], x, y, local_blur, indent, statements, emitted) + ") >= " +
+                   literal(n.parameters[0]) + " ? 255.0f : 0.0f)";
+        default:
+            return "((" + expression(n.inputs[0], x, y, local_blur, indent, statements, emitted) + ") * " +
+                   literal(n.parameters[0]) + " + " + literal(n.parameters[1]) + ")";
+    }
+}
+
+std::string FilterGraph::temporary(int node, const std::string& x, const std::string& y, int local_blur,
+                                   const std::string& indent, std::string& statements,
+                                   std::vector<bool>& emitted) const {
+    // Name of the variable t<node> holding the value of node, declared on first use
+    std::ostringstream name;
+    name << "t" << node;
+    if (!emitted[node]) {
+        std::string value = expression(node, x, y, local_blur, indent, statements, emitted);
+        statements += indent + "float " + name.str() + " = " + value + ";\n";
+        emitted[node] = true;
+    }
+    return name.str();
+}
+
+void FilterGraph::plan(){
+    /*
+    Launches of the live nodes and lifetime of their buffers. Blur i runs at
+    steps 2 i (rows, into its logical buffer 2 i) and 2 i + 1 (columns, into
+    2 i + 1 unless it is the last blur, whose columns pass also produces the
+    output). The logical buffers get pool slots greedily: a slot is free again
+    after the last step reading it.
+    */
+    if (input_node < 0 || output_node < 0) {
+        fprintf(stderr, "Filter graph needs an input and an output\n");
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<bool> live(nodes.size(), false);
+    live[output_node] = true;
+    for (int i = output_node; i >= 0; i--) {
+        if (!live[i]) continue;
+        for (int k = 0; k < 2; k++) {
+            if (nodes[i].inputs[k] >= 0) live[nodes[i].inputs[k]] = true;
+        }
+    }
+
+    blurs.clear();
+    for (int i = 0; i <= output_node; i++) {
+        if (live[i] && nodes[i].op == OP_BLUR) blurs.push_back(i);
+    }
+
+    steps.clear();
+    int num_blurs = static_cast<int>(blurs.size());
+    for (int i = 0; i < num_blurs; i++) {
+        bool last = (i == num_blurs - 1);
+        Step rows = {blurs[i], true, false, false};
+        Step columns = {blurs[i], false, !last, last};
+        steps.push_back(rows);
+        steps.push_back(columns);
+    }
+    if (num_blurs == 0) {
+        Step output = {-1, false, false, true};
+        steps.push_back(output);
+    }
+
+    first_step.assign(2 * num_blurs, -1);
+    last_step.assign(2 * num_blurs, -1);
+    for (int i = 0; i < num_blurs; i++) {
+        first_step[2 * i] = 2 * i;
+        last_step[2 * i] = 2 * i + 1;
+        if (steps[2 * i + 1].store) first_step[2 * i + 1] = 2 * i + 1;
+    }
+    for (int s = 0; s < static_cast<int>(steps.size()); s++) {
+        std::vector<bool> used(nodes.size(), false);
+        if (steps[s].rows) {
+            referencedBlurs(nodes[steps[s].blur].inputs[0], used);
+        } else if (steps[s].fused_output) {
+            referencedBlurs(output_node, used);
+        }
+        for (int i = 0; i < num_blurs; i++) {
+            if (used[blurs[i]] && blurs[i] != steps[s].blur) last_step[2 * i + 1] = s;
+        }
+    }
+
+    slots.assign(2 * num_blurs, -1);
+    std::vector<int> free_slots;
+    num_slots = 0;
+    for (int s = 0; s < static_cast<int>(steps.size()); s++) {
+        for (int l = 0; l < 2 * num_blurs; l++) {
+            if (slots[l] >= 0 && last_step[l] == s - 1) free_slots.push_back(slots[l]);
+        }
+        for (int l = 0; l < 2 * num_blurs; l++) {
+            if (first_step[l] != s) continue;
+            if (free_slots.empty()) {
+                slots[l] = num_slots++;
+            } else {
+                slots[l] = free_slots.back();
+                free_slots.pop_back();
+            }
+        }
+    }
+}
+
+std::string FilterGraph::generateSource(){
+    plan();
+    std::ostringstream source;
+    source << "#define BORDER_MODE " << border_mode << "\n"
+           << "#define BORDER_CONSTANT_VALUE " << literal(border_constant) << "\n\n"
+           << "// Twin of remap_coordinate() in gaussian_kernel.cl\n"
+           << "int remap_coordinate(int i, int n){\n"
+           << "    if (i >= 0 && i < n) return i;\n"
+           << "    switch (BORDER_MODE){\n"
+           << "        case " << BORDER_CLAMP << ": return clamp(i, 0, n - 1);\n"
+           << "        case " << BORDER_MIRROR << ": return clamp((i < 0) ? -i - 1 : 2 * n - i - 1, 0, n - 1);\n"
+           << "        case " << BORDER_WRAP << ": return ((i % n) + n) % n;\n"
+           << "        default: return -1;\n"
+           << "    }\n"
+           << "}\n\n";
+
+    for (size_t i = 0; i < blurs.size(); i++) {
+        std::vector<float> line = GaussianBlurProcessor::create_separable_kernel(nodes[blurs[i]].parameters[0]);
+        source << "constant float weights" << i << "[" << line.size() << "] = {";
+        for (size_t k = 0; k < line.size(); k++) source << (k ? ", " : "") << literal(line[k]);
+        source << "};\n";
+    }
+
+    std::ostringstream parameters;
+    parameters << "global const uchar* in0, global uchar* out, global float* tmp";
+    for (size_t i = 0; i < blurs.size(); i++) parameters << ", global float* b" << i;
+    parameters << ", int width, int height";
+
+    for (size_t s = 0; s < steps.size(); s++) {
+        const Step& step = steps[s];
+        int b = static_cast<int>(s / 2);
+        int radius = (step.blur >= 0)
+            ? static_cast<int>(GaussianBlurProcessor::create_separable_kernel(nodes[step.blur].parameters[0]).size() / 2)
+            : 0;
+
+        source << "\n__kernel void step" << s << "(" << parameters.str() << "){\n"
+               << "    int x = get_global_id(0);\n"
+               << "    int y = get_global_id(1);\n"
+               << "    if (x >= width || y >= height) return;\n";
+        std::string statements;
+        std::vector<bool> emitted(nodes.size(), false);
+        if (step.blur < 0) {
+            std::string value = expression(output_node, "x", "y", -1, "    ", statements, emitted);
+            source << statements << "    out[y * width + x] = convert_uchar_sat_rte(" << value << ");\n";
+        } else if (step.rows) {
+            std::string value = expression(nodes[step.blur].inputs[0], "sx", "y", -1, "            ",
+                                           statements, emitted);
+            source << "    float v = 0.0f;\n"
+                   << "    for (int k = -" << radius << "; k <= " << radius << "; k++){\n"
+                   << "        int sx = remap_coordinate(x + k, width);\n"
+                   << "        float value = BORDER_CONSTANT_VALUE;\n"
+                   << "        if (sx >= 0) {\n"
+                   << statements
+                   << "            value = " << value << ";\n"
+                   << "        }\n"
+                   << "        v += weights" << b << "[k + " << radius << "] * value;\n"
+                   << "    }\n"
+                   << "    tmp[y * width + x] = v;\n";
+        } else {
+            source << "    float v = 0.0f;\n"
+                   << "    for (int k = -" << radius << "; k <= " << radius << "; k++){\n"
+                   << "        int sy = remap_coordinate(y + k, height);\n"
+                   << "        float value = (sy < 0) ? BORDER_CONSTANT_VALUE : tmp[sy * width + x];\n"
+                   << "        v += weights" << b << "[k + " << radius << "] * value;\n"
+                   << "    }\n";
+            if (step.store) source << "    b" << b << "[y * width + x] = v;\n";
+            if (step.fused_output) {
+                std::string value = expression(output_node, "x", "y", step.blur, "    ", statements, emitted);
+                source << statements << "    out[y * width + x] = convert_uchar_sat_rte(" << value << ");\n";
+            }
+        }
+        source << "}\n";
+    }
+    return source.str();
+}
+
+void FilterGraph::releaseKernels(){
+    for (size_t i = 0; i < kernels.size(); i++) clReleaseKernel(kernels[i]);
+    kernels.clear();
+}
+
+void FilterGraph::buildProgram(){
+    // The program is only rebuilt when the graph (or the border mode) changed
+    std::string source = generateSource();
+    if (program && source == program_source) return;
+
+    releaseKernels();
+    if (program) clReleaseProgram(program);
+    program_source = source;
+
+    cl_int err;
+    const char* text = program_source.c_str();
+    size_t length = program_source.size();
+    program = clCreateProgramWithSource(context, 1, &text, &length, &err);
+    GaussianBlurProcessor::check_error(err, "Creating filter graph program");
+    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        size_t len;
+        char buffer[2048];
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
+        printf("Build error: %s\n", buffer);
+        exit(-1);
+    }
+
+    for (size_t s = 0; s < steps.size(); s++) {
+        char name[32];
+        snprintf(name, sizeof(name), "step%d", static_cast<int>(s));
+        kernels.push_back(clCreateKernel(program, name, &err));
+        GaussianBlurProcessor::check_error(err, "Creating filter graph kernel");
+    }
+}
+
+ProcessingMetrics FilterGraph::run(const unsigned char* input_data, unsigned char* output_data, int width, int height){
+    ProcessingMetrics metrics = {};
+    buildProgram();
+
+    cl_int err;
+    size_t pixels = static_cast<size_t>(width) * height;
+    size_t float_size = pixels * sizeof(float);
+    size_t input_size = pixels * input_channels;
+
+    // Pool of intermediate buffers, kept from one run to the next of the same size
+    if (pool_buffer_size != float_size) {
+        for (size_t i = 0; i < pool.size(); i++) clReleaseMemObject(pool[i]);
+        pool.clear();
+        pool_buffer_size = float_size;
+    }
+    while (static_cast<int>(pool.size()) < num_slots) {
+        pool.push_back(clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err));
+        GaussianBlurProcessor::check_error(err, "Creating filter graph buffer");
+    }
+
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    GaussianBlurProcessor::check_error(err, "Creating input buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, pixels, NULL, &err);
+    GaussianBlurProcessor::check_error(err, "Creating output buffer");
+    metrics.memory_used = input_size + pixels + num_slots * float_size;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    cl_event write_event, read_event;
+    std::vector<cl_event> kernel_events(steps.size());
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, input_size, input_data, 0, NULL, &write_event);
+    GaussianBlurProcessor::check_error(err, "Writing input buffer");
+
+    int num_blurs = static_cast<int>(blurs.size());
+    cl_mem no_buffer = NULL;
+    for (size_t s = 0; s < steps.size(); s++) {
+        cl_kernel k = kernels[s];
+        int step = static_cast<int>(s);
+        cl_mem tmp = (steps[s].blur >= 0) ? pool[slots[s / 2 * 2]] : no_buffer;
+        err = clSetKernelArg(k, 0, sizeof(cl_mem), &input_buffer);
+        err |= clSetKernelArg(k, 1, sizeof(cl_mem), &output_buffer);
+        err |= clSetKernelArg(k, 2, sizeof(cl_mem), &tmp);
+        for (int i = 0; i < num_blurs; i++) {
+            // Only the results alive at this step are bound
+            int l = 2 * i + 1;
+            bool alive = slots[l] >= 0 && first_step[l] <= step && last_step[l] >= step;
+            err |= clSetKernelArg(k, 3 + i, sizeof(cl_mem), alive ? &pool[slots[l]] : &no_buffer);
+        }
+        err |= clSetKernelArg(k, 3 + num_blurs, sizeof(int), &width);
+        err |= clSetKernelArg(k, 4 + num_blurs, sizeof(int), &height);
+        GaussianBlurProcessor::check_error(err, "Setting filter graph kernel arguments");
+
+        size_t global_size[2] = {static_cast<size_t>(width), static_cast<size_t>(height)};
+        cl_event wait = (s == 0) ? write_event : kernel_events[s - 1];
+        err = clEnqueueNDRangeKernel(commands, k, 2, NULL, global_size, NULL, 1, &wait, &kernel_events[s]);
+        GaussianBlurProcessor::check_error(err, "Enqueuing filter graph kernel");
+    }
+
+    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, pixels, output_data,
+                              1, &kernel_events.back(), &read_event);
+    GaussianBlurProcessor::check_error(err, "Reading output buffer");
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = GaussianBlurProcessor::getEventExecutionTime(write_event) + GaussianBlurProcessor::getEventExecutionTime(read_event);
+    for (size_t s = 0; s < steps.size(); s++) {
+        metrics.kernel_execution_time += GaussianBlurProcessor::getEventExecutionTime(kernel_events[s]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+    metrics.algorithm = BLUR_SEPARABLE;
+
+    clReleaseEvent(write_event);
+    for (size_t s = 0; s < steps.size(); s++) {
+        clReleaseEvent(kernel_events[s]);
+    }
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
@@ -2,15 +2,79 @@
 #include <math.h>
 #include <chrono>
 
-#define DIM 3 
+#define VECTOR_PADDING 16   // bytes read past the slice by the widest vector kernel
+#define TRANSPOSE_TILE 16   // work-group side of the transpose kernels
+#define REGION_FIELDS 5     // ints per region in the table of the region kernels (see gaussian_kernel.cl)
+#define BATCH_FIELDS 4      // ints per image in the table of the batch kernel
 
-GaussianBlurProcessor::GaussianBlurProcessor(bool boolean){
-    gaussian_kernel = create_gaussian_matrix(1.0);
+GaussianBlurProcessor::GaussianBlurProcessor(bool boolean)
+    : context(NULL), commands(NULL), program(NULL), kernel(NULL), border_kernel(NULL),
+      image_kernel(NULL), vector_kernel(NULL), fixed_point_kernel(NULL), transpose_uchar_kernel(NULL),
+      transpose_float_kernel(NULL), iir_kernel(NULL), box_kernel(NULL), fir_kernel(NULL), unsharp_kernel(NULL),
+      convolve_kernel(NULL),
+      fft_load_kernel(NULL), fft_stage_kernel(NULL), fft_multiply_kernel(NULL), fft_gather_kernel(NULL),
+      region_rows_kernel(NULL), region_columns_kernel(NULL), batch_kernel(NULL),
+      pyramid_kernel(NULL), scale_space_kernel(NULL), vhgw_kernel(NULL),
+      sat_rows_kernel(NULL), sat_columns_kernel(NULL), sat_statistics_kernel(NULL),
+      nlmeans_rows_kernel(NULL), nlmeans_columns_kernel(NULL), nlmeans_finish_kernel(NULL),
+      demosaic_kernel(NULL), resize_rows_kernel(NULL), resize_columns_kernel(NULL), bilateral_splat_kernel(NULL),
+      bilateral_slice_kernel(NULL), fir_sobel_kernel(NULL), canny_suppress_kernel(NULL),
+      canny_hysteresis_kernel(NULL), canny_finish_kernel(NULL), device(NULL) {
+    setSigma(1.0);
+    algorithm = BLUR_DIRECT;
+    predicted_time = 0;
     first_gpu = boolean;
+    border_mode = BORDER_COPY;
+    border_constant = 0;
+    kernel_path = PATH_BUFFER;
+    image_support = false;
+    image2d_max_width = image2d_max_height = 0;
+    vector_width = 4;
+    local_size[0] = local_size[1] = 16;
+    custom_kernel_width = custom_kernel_height = 0;
+    fft_break_even_area = 0;
+    fft_measured_width = fft_measured_height = 0;
+    region_x = region_y = region_width = region_height = 0;
 } 
 
 GaussianBlurProcessor::~GaussianBlurProcessor(){
     if (kernel) clReleaseKernel(kernel);
+    if (border_kernel) clReleaseKernel(border_kernel);
+    if (image_kernel) clReleaseKernel(image_kernel);
+    if (vector_kernel) clReleaseKernel(vector_kernel);
+    if (fixed_point_kernel) clReleaseKernel(fixed_point_kernel);
+    if (transpose_uchar_kernel) clReleaseKernel(transpose_uchar_kernel);
+    if (transpose_float_kernel) clReleaseKernel(transpose_float_kernel);
+    if (iir_kernel) clReleaseKernel(iir_kernel);
+    if (box_kernel) clReleaseKernel(box_kernel);
+    if (fir_kernel) clReleaseKernel(fir_kernel);
+    if (unsharp_kernel) clReleaseKernel(unsharp_kernel);
+    if (convolve_kernel) clReleaseKernel(convolve_kernel);
+    if (fft_load_kernel) clReleaseKernel(fft_load_kernel);
+    if (fft_stage_kernel) clReleaseKernel(fft_stage_kernel);
+    if (fft_multiply_kernel) clReleaseKernel(fft_multiply_kernel);
+    if (fft_gather_kernel) clReleaseKernel(fft_gather_kernel);
+    if (region_rows_kernel) clReleaseKernel(region_rows_kernel);
+    if (region_columns_kernel) clReleaseKernel(region_columns_kernel);
+    if (batch_kernel) clReleaseKernel(batch_kernel);
+    if (pyramid_kernel) clReleaseKernel(pyramid_kernel);
+    if (scale_space_kernel) clReleaseKernel(scale_space_kernel);
+    if (vhgw_kernel) clReleaseKernel(vhgw_kernel);
+    if (sat_rows_kernel) clReleaseKernel(sat_rows_kernel);
+    if (sat_columns_kernel) clReleaseKernel(sat_columns_kernel);
+    if (sat_statistics_kernel) clReleaseKernel(sat_statistics_kernel);
+    if (nlmeans_rows_kernel) clReleaseKernel(nlmeans_rows_kernel);
+    if (nlmeans_columns_kernel) clReleaseKernel(nlmeans_columns_kernel);
+    if (nlmeans_finish_kernel) clReleaseKernel(nlmeans_finish_kernel);
+    if (demosaic_kernel) clReleaseKernel(demosaic_kernel);
+    if (resize_rows_kernel) clReleaseKernel(resize_rows_kernel);
+    if (resize_columns_kernel) clReleaseKernel(resize_columns_kernel);
+    if (bilateral_splat_kernel) clReleaseKernel(bilateral_splat_kernel);
+    if (bilateral_slice_kernel) clReleaseKernel(bilateral_slice_kernel);
+    if (fir_sobel_kernel) clReleaseKernel(fir_sobel_kernel);
+    if (canny_suppress_kernel) clReleaseKernel(canny_suppress_kernel);
+    if (canny_hysteresis_kernel) clReleaseKernel(canny_hysteresis_kernel);
+    if (canny_finish_kernel) clReleaseKernel(canny_finish_kernel);
     if (program) clReleaseProgram (program);
     if (commands) clReleaseCommandQueue (commands);
     if (context) clReleaseContext (context);
@@ -56,7 +120,9 @@ void GaussianBlurProcessor::initializeOpenCL(cl_device_id device) {
     check_error(err, "Creating program");
     free(sourceCode);
 
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    char build_options[64];
+    snprintf(build_options, sizeof(build_options), "-D DIM=%d -D FIXED_POINT_SHIFT=%d", DIM, FIXED_POINT_SHIFT);
+    err = clBuildProgram(program, 0, NULL, build_options, NULL, NULL);
     if (err != CL_SUCCESS) {
         size_t len;
         char buffer[2048];
@@ -68,6 +134,535 @@ void GaussianBlurProcessor::initializeOpenCL(cl_device_id device) {
 
     kernel = clCreateKernel(program, "gaussian_blur", &err);
     check_error(err, "Creating kernel");
+
+    border_kernel = clCreateKernel(program, "gaussian_blur_border", &err);
+    check_error(err, "Creating border kernel");
+
+    fixed_point_kernel = clCreateKernel(program, "gaussian_blur_fixed", &err);
+    check_error(err, "Creating fixed-point kernel");
+
+    transpose_uchar_kernel = clCreateKernel(program, "transpose_uchar_float", &err);
+    check_error(err, "Creating transpose kernel");
+    transpose_float_kernel = clCreateKernel(program, "transpose_float", &err);
+    check_error(err, "Creating transpose kernel");
+    iir_kernel = clCreateKernel(program, "iir_gaussian_columns", &err);
+    check_error(err, "Creating IIR kernel");
+    box_kernel = clCreateKernel(program, "box_columns", &err);
+    check_error(err, "Creating box kernel");
+    fir_kernel = clCreateKernel(program, "fir_columns", &err);
+    check_error(err, "Creating FIR kernel");
+    unsharp_kernel = clCreateKernel(program, "fir_unsharp_columns", &err);
+    check_error(err, "Creating unsharp kernel");
+
+    convolve_kernel = clCreateKernel(program, "convolve_direct", &err);
+    check_error(err, "Creating convolution kernel");
+    fft_load_kernel = clCreateKernel(program, "fft_load_tiles", &err);
+    check_error(err, "Creating FFT kernel");
+    fft_stage_kernel = clCreateKernel(program, "fft_stage", &err);
+    check_error(err, "Creating FFT kernel");
+    fft_multiply_kernel = clCreateKernel(program, "fft_multiply", &err);
+    check_error(err, "Creating FFT kernel");
+    fft_gather_kernel = clCreateKernel(program, "fft_gather", &err);
+    check_error(err, "Creating FFT kernel");
+    region_rows_kernel = clCreateKernel(program, "region_blur_rows", &err);
+    check_error(err, "Creating region kernel");
+    region_columns_kernel = clCreateKernel(program, "region_blur_columns", &err);
+    check_error(err, "Creating region kernel");
+    batch_kernel = clCreateKernel(program, "gaussian_blur_batch", &err);
+    check_error(err, "Creating batch kernel");
+    pyramid_kernel = clCreateKernel(program, "pyramid_reduce", &err);
+    check_error(err, "Creating pyramid kernel");
+    scale_space_kernel = clCreateKernel(program, "scale_space_outputs", &err);
+    check_error(err, "Creating scale-space kernel");
+    vhgw_kernel = clCreateKernel(program, "vhgw_columns", &err);
+    check_error(err, "Creating morphology kernel");
+    sat_rows_kernel = clCreateKernel(program, "sat_rows", &err);
+    check_error(err, "Creating summed-area table kernel");
+    sat_columns_kernel = clCreateKernel(program, "sat_columns", &err);
+    check_error(err, "Creating summed-area table kernel");
+    sat_statistics_kernel = clCreateKernel(program, "sat_statistics", &err);
+    check_error(err, "Creating statistics kernel");
+    nlmeans_rows_kernel = clCreateKernel(program, "nlmeans_rows", &err);
+    check_error(err, "Creating NL-means kernel");
+    nlmeans_columns_kernel = clCreateKernel(program, "nlmeans_columns", &err);
+    check_error(err, "Creating NL-means kernel");
+    nlmeans_finish_kernel = clCreateKernel(program, "nlmeans_finish", &err);
+    check_error(err, "Creating NL-means kernel");
+    demosaic_kernel = clCreateKernel(program, "bayer_demosaic", &err);
+    check_error(err, "Creating demosaic kernel");
+    resize_rows_kernel = clCreateKernel(program, "resize_rows", &err);
+    check_error(err, "Creating resize kernel");
+    resize_columns_kernel = clCreateKernel(program, "resize_columns", &err);
+    check_error(err, "Creating resize kernel");
+    bilateral_splat_kernel = clCreateKernel(program, "bilateral_splat", &err);
+    check_error(err, "Creating bilateral kernel");
+    bilateral_slice_kernel = clCreateKernel(program, "bilateral_slice", &err);
+    check_error(err, "Creating bilateral kernel");
+    fir_sobel_kernel = clCreateKernel(program, "fir_sobel_columns", &err);
+    check_error(err, "Creating edge kernel");
+    canny_suppress_kernel = clCreateKernel(program, "canny_suppress", &err);
+    check_error(err, "Creating edge kernel");
+    canny_hysteresis_kernel = clCreateKernel(program, "canny_hysteresis", &err);
+    check_error(err, "Creating edge kernel");
+    canny_finish_kernel = clCreateKernel(program, "canny_finish", &err);
+    check_error(err, "Creating edge kernel");
+
+    // Coarsening factor of the vector kernel, from the preferred char vector width
+    cl_uint preferred_char_width = 1;
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR, sizeof(preferred_char_width),
+                    &preferred_char_width, NULL);
+    vector_width = (preferred_char_width >= 16) ? 16 : (preferred_char_width >= 8) ? 8 : 4;
+
+    char vector_kernel_name[32];
+    snprintf(vector_kernel_name, sizeof(vector_kernel_name), "gaussian_blur_vec%d", vector_width);
+    vector_kernel = clCreateKernel(program, vector_kernel_name, &err);
+    check_error(err, "Creating vector kernel");
+
+    // The sampler based variant is only compiled (__IMAGE_SUPPORT__) and created when the device handles images
+    cl_bool has_images = CL_FALSE;
+    clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(has_images), &has_images, NULL);
+    image_support = (has_images == CL_TRUE);
+    if (image_support) {
+        // CL_R is not part of the formats every OpenCL 1.2 device has to support
+        cl_uint num_formats = 0;
+        clGetSupportedImageFormats(context, CL_MEM_READ_ONLY, CL_MEM_OBJECT_IMAGE2D, 0, NULL, &num_formats);
+        std::vector<cl_image_format> formats(num_formats);
+        clGetSupportedImageFormats(context, CL_MEM_READ_ONLY, CL_MEM_OBJECT_IMAGE2D, num_formats,
+                                   formats.data(), NULL);
+        image_support = false;
+        for (cl_uint f = 0; f < num_formats; f++) {
+            if (formats[f].image_channel_order == CL_R && formats[f].image_channel_data_type == CL_UNSIGNED_INT8) {
+                image_support = true;
+            }
+        }
+    }
+    if (image_support) {
+        clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(image2d_max_width), &image2d_max_width, NULL);
+        clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(image2d_max_height), &image2d_max_height, NULL);
+
+        image_kernel = clCreateKernel(program, "gaussian_blur_image", &err);
+        check_error(err, "Creating image kernel");
+    }
+}
+
+void GaussianBlurProcessor::setSigma(double sigma){
+    this->sigma = sigma;
+    gaussian_kernel = create_gaussian_matrix(sigma);
+    fixed_point_error = quantizeKernel(gaussian_kernel, fixed_gaussian_kernel);
+}
+
+void GaussianBlurProcessor::setAlgorithm(BlurAlgorithm algorithm, double predicted_time){
+    this->algorithm = algorithm;
+    this->predicted_time = predicted_time;
+}
+
+BlurAlgorithm GaussianBlurProcessor::getAlgorithm() const {
+    return algorithm;
+}
+
+std::string GaussianBlurProcessor::getDeviceKey() const {
+    return deviceKey();
+}
+
+cl_device_id GaussianBlurProcessor::getDevice() const {
+    return device;
+}
+
+cl_context GaussianBlurProcessor::getContext() const {
+    return context;
+}
+
+cl_command_queue GaussianBlurProcessor::getCommandQueue() const {
+    return commands;
+}
+
+cl_program GaussianBlurProcessor::getProgram() const {
+    return program;
+}
+
+void GaussianBlurProcessor::iirCoefficients(double sigma, float coefficients[4]){
+    /*
+    Young and van Vliet (1995) recursive Gaussian, valid from sigma = 0.5.
+    coefficients = {B, b1 / b0, b2 / b0, b3 / b0}
+    */
+    sigma = std::max(sigma, 0.5);
+    double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330
+                              : 3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * sigma);
+    double q2 = q * q, q3 = q2 * q;
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+    double b2 = -(1.4281 * q2 + 1.26661 * q3);
+    double b3 = 0.422205 * q3;
+
+    coefficients[0] = static_cast<float>(1.0 - (b1 + b2 + b3) / b0);
+    coefficients[1] = static_cast<float>(b1 / b0);
+    coefficients[2] = static_cast<float>(b2 / b0);
+    coefficients[3] = static_cast<float>(b3 / b0);
+}
+
+void GaussianBlurProcessor::boxRadii(double sigma, int radii[BOX_PASSES]){
+    /*
+    Box widths whose composition has the variance of the Gaussian (Kovesi):
+    the m first boxes get the odd width wl just below the ideal one, the
+    others wl + 2.
+    */
+    const int n = BOX_PASSES;
+    double ideal = sqrt(12.0 * sigma * sigma / n + 1.0);
+    int wl = static_cast<int>(floor(ideal));
+    if (wl % 2 == 0) wl--;
+    int wu = wl + 2;
+    int m = static_cast<int>(floor((12.0 * sigma * sigma - n * wl * wl - 4.0 * n * wl - 3.0 * n)
+                                   / (-4.0 * wl - 4.0) + 0.5));
+    for (int i = 0; i < n; i++) {
+        radii[i] = ((i < m) ? wl : wu) / 2;
+    }
+}
+
+double GaussianBlurProcessor::boxApproximationError(double sigma){
+    /*
+    RMS difference between the 2D impulse responses of the box composition
+    and of the sampled Gaussian, relative to the peak of the Gaussian.
+    */
+    int radii[BOX_PASSES];
+    boxRadii(sigma, radii);
+
+    std::vector<double> box(1, 1.0);
+    for (int p = 0; p < BOX_PASSES; p++) {
+        int w = 2 * radii[p] + 1;
+        std::vector<double> next(box.size() + w - 1, 0.0);
+        for (size_t i = 0; i < box.size(); i++) {
+            for (int k = 0; k < w; k++) {
+                next[i + k] += box[i] / w;
+            }
+        }
+        box.swap(next);
+    }
+
+    int box_radius = static_cast<int>(box.size() / 2);
+    int support = std::max(box_radius, static_cast<int>(ceil(IIR_HALO_SIGMAS * sigma)));
+    std::vector<double> gauss(2 * support + 1), approx(2 * support + 1, 0.0);
+    double sum = 0.0;
+    for (int x = -support; x <= support; x++) {
+        gauss[x + support] = exp(-x * x / (2.0 * sigma * sigma));
+        sum += gauss[x + support];
+        if (abs(x) <= box_radius) approx[x + support] = box[x + box_radius];
+    }
+    for (size_t i = 0; i < gauss.size(); i++) gauss[i] /= sum;
+
+    double squares = 0.0;
+    for (size_t y = 0; y < gauss.size(); y++) {
+        for (size_t x = 0; x < gauss.size(); x++) {
+            double d = approx[y] * approx[x] - gauss[y] * gauss[x];
+            squares += d * d;
+        }
+    }
+    double peak = gauss[support] * gauss[support];
+    return sqrt(squares / (gauss.size() * gauss.size())) / peak;
+}
+
+void GaussianBlurProcessor::setCustomKernel(const std::vector<float>& weights, int kernel_width, int kernel_height){
+    /*
+    Convolve by an arbitrary kernel (odd sizes, row-major weights) instead of
+    the Gaussian, until clearCustomKernel().
+    */
+    if (kernel_width % 2 == 0 || kernel_height % 2 == 0 ||
+        weights.size() != static_cast<size_t>(kernel_width) * kernel_height) {
+        fprintf(stderr, "Custom kernel must have odd sizes and kernel_width * kernel_height weights\n");
+        exit(EXIT_FAILURE);
+    }
+    custom_kernel = weights;
+    custom_kernel_width = kernel_width;
+    custom_kernel_height = kernel_height;
+}
+
+void GaussianBlurProcessor::clearCustomKernel(){
+    custom_kernel.clear();
+    custom_kernel_width = custom_kernel_height = 0;
+}
+
+long GaussianBlurProcessor::getFFTBreakEven() const {
+    return fft_break_even_area;
+}
+
+void GaussianBlurProcessor::setRegion(int x, int y, int width, int height){
+    /*
+    Only compute the rectangle [x, x + width) x [y, y + height) of the image
+    passed to processImage(), instead of this device's half. The halo around
+    it is read from the image, so tiles stitch without seams; the pixels
+    outside of the rectangle are left untouched in the output.
+    */
+    region_x = x;
+    region_y = y;
+    region_width = width;
+    region_height = height;
+}
+
+void GaussianBlurProcessor::clearRegion(){
+    region_x = region_y = region_width = region_height = 0;
+}
+
+int GaussianBlurProcessor::tileHalo() const {
+    // Pixels read on each side of a region by the current filter
+    if (!custom_kernel.empty()) {
+        return std::max(custom_kernel_width, custom_kernel_height) / 2;
+    }
+    switch (algorithm) {
+        case BLUR_IIR:
+            return static_cast<int>(ceil(IIR_HALO_SIGMAS * sigma));
+        case BLUR_BOX: {
+            int radii[BOX_PASSES];
+            boxRadii(sigma, radii);
+            int halo = 0;
+            for (int p = 0; p < BOX_PASSES; p++) halo += radii[p];
+            return halo;
+        }
+        case BLUR_SEPARABLE:
+        case BLUR_FFT:
+            return static_cast<int>(create_separable_kernel(sigma).size() / 2);
+        default:
+            return RADIUS;
+    }
+}
+
+void GaussianBlurProcessor::bytesPerPixel(size_t& largest_buffer, size_t& total) const {
+    /*
+    Device memory per uploaded pixel of the current filter: the FFT keeps two
+    complex tile buffers whose tiles overlap at most 2x in each direction, the
+    line-based engines two float buffers, the direct blur the bytes only.
+    */
+    bool fft = !custom_kernel.empty() || algorithm == BLUR_FFT;
+    if (fft) {
+        largest_buffer = 4 * sizeof(cl_float2);
+        total = 2 * largest_buffer + 2;
+    } else if (algorithm == BLUR_DIRECT) {
+        largest_buffer = 1;
+        total = 2;
+    } else {
+        largest_buffer = sizeof(float);
+        total = 2 * sizeof(float) + 2;
+    }
+}
+
+size_t GaussianBlurProcessor::maxTilePixels() const {
+    // Largest region (halo included) whose buffers fit the device limits
+    cl_ulong max_alloc = 0, global_memory = 0;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_memory), &global_memory, NULL);
+
+    size_t largest_buffer, total;
+    bytesPerPixel(largest_buffer, total);
+    double pixels = std::min(static_cast<double>(max_alloc) / largest_buffer,
+                             TILE_MEMORY_FRACTION * global_memory / total);
+    return static_cast<size_t>(pixels);
+}
+
+int GaussianBlurProcessor::fftTileSize(int kernel_width, int kernel_height){
+    // At least twice the kernel, so that blocks are larger than the overlaps
+    int tile = FFT_MIN_TILE;
+    while (tile < 2 * std::max(kernel_width, kernel_height)) tile *= 2;
+    return tile;
+}
+
+void GaussianBlurProcessor::setKernelPath(KernelPath path){
+    kernel_path = path;
+}
+
+KernelPath GaussianBlurProcessor::getKernelPath() const {
+    return kernel_path;
+}
+
+const char* GaussianBlurProcessor::kernelPathName(KernelPath path){
+    switch (path) {
+        case PATH_IMAGE: return "image2d";
+        case PATH_VECTOR: return "vector";
+        case PATH_FIXED: return "fixed-point";
+        default: return "buffer";
+    }
+}
+
+const char* GaussianBlurProcessor::borderModeName(BorderMode mode){
+    switch (mode) {
+        case BORDER_CLAMP: return "clamp";
+        case BORDER_MIRROR: return "mirror";
+        case BORDER_WRAP: return "wrap";
+        case BORDER_CONSTANT: return "constant";
+        default: return "copy";
+    }
+}
+
+int GaussianBlurProcessor::quantizeKernel(const std::vector<float>& weights, std::vector<cl_ushort>& fixed_weights){
+    /*
+    Scale the weights to 2^FIXED_POINT_SHIFT keeping their sum exact (largest
+    remainder rounding) and return the maximum error in LSB against the float
+    path, or -1 when the 16-bit accumulator could overflow.
+    */
+    const int scale = 1 << FIXED_POINT_SHIFT;
+    if (255 * scale + scale / 2 > 65535) return -1;
+
+    std::vector<double> remainders(weights.size());
+    fixed_weights.resize(weights.size());
+    int total = 0;
+    for (size_t i = 0; i < weights.size(); i++) {
+        double scaled = weights[i] * scale;
+        fixed_weights[i] = static_cast<cl_ushort>(floor(scaled));
+        remainders[i] = scaled - fixed_weights[i];
+        total += fixed_weights[i];
+    }
+
+    int deficit = scale - total;
+    if (deficit < 0 || deficit > static_cast<int>(weights.size())) return -1;
+    for (int d = 0; d < deficit; d++) {
+        size_t largest = 0;
+        for (size_t i = 1; i < remainders.size(); i++) {
+            if (remainders[i] > remainders[largest]) largest = i;
+        }
+        fixed_weights[largest]++;
+        remainders[largest] = -1.0;
+    }
+
+    double positive = 0.0, negative = 0.0;
+    for (size_t i = 0; i < weights.size(); i++) {
+        double e = weights[i] - static_cast<double>(fixed_weights[i]) / scale;
+        if (e > 0) positive += e;
+        else negative -= e;
+    }
+    // the fixed-point result is within e + 0.5 of the float sum, the truncated float one within 1
+    return static_cast<int>(floor(255.0 * std::max(positive, negative) + 0.5)) + 1;
+}
+
+bool GaussianBlurProcessor::fixedPointAvailable() const {
+    return fixed_point_error >= 0 && fixed_point_error <= FIXED_POINT_MAX_ERROR;
+}
+
+int GaussianBlurProcessor::fixedPointErrorBound() const {
+    return fixed_point_error;
+}
+
+bool GaussianBlurProcessor::imagePathAvailable(int width, int rows) const {
+    /*
+    The sampler does the column border handling, which rules out the modes it
+    cannot express: copy, and constant with a value other than the border
+    colour (0).
+    */
+    if (!image_support) return false;
+    if (border_mode == BORDER_COPY) return false;
+    if (border_mode == BORDER_CONSTANT && border_constant != 0) return false;
+    return static_cast<size_t>(width) <= image2d_max_width && static_cast<size_t>(rows) <= image2d_max_height;
+}
+
+std::string GaussianBlurProcessor::deviceKey() const {
+    char device_name[128];
+    char driver_version[64];
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver_version), driver_version, NULL);
+    return std::string(device_name) + " / " + driver_version;
+}
+
+TuningEntry GaussianBlurProcessor::autoTune(const unsigned char* input_data, unsigned char* output_data,
+                                            int width, int height, TuningDatabase& database, int runs) {
+    /*
+    Pick the kernel path and work-group size for this device and image size
+    class and border mode. A configuration found in the database is applied
+    directly if this device can still launch it, otherwise every candidate is
+    benchmarked on the sample image (transfers and kernels, from the profiling
+    events) and the winner replaces the entry.
+    */
+    std::string device_key = deviceKey();
+    std::string size_class = TuningDatabase::sizeClass(width, height) + " " + borderModeName(border_mode);
+
+    TuningEntry best;
+    if (database.lookup(device_key, size_class, best) && best.kernel_path >= PATH_BUFFER &&
+        best.kernel_path <= PATH_FIXED &&
+        launchConfigValid(static_cast<KernelPath>(best.kernel_path), best.local_size, width, height)) {
+        kernel_path = static_cast<KernelPath>(best.kernel_path);
+        local_size[0] = best.local_size[0];
+        local_size[1] = best.local_size[1];
+        return best;
+    }
+
+    std::vector<KernelPath> paths;
+    paths.push_back(PATH_BUFFER);
+    paths.push_back(PATH_VECTOR);
+    if (imagePathAvailable(width, height)) paths.push_back(PATH_IMAGE);
+    if (fixedPointAvailable()) paths.push_back(PATH_FIXED);
+
+    static const size_t candidates[][2] = {
+        {8, 8}, {16, 8}, {16, 16}, {32, 4}, {32, 8}, {32, 16}, {64, 1}, {64, 4}, {128, 1}, {256, 1}
+    };
+
+    best.time = -1.0;
+    for (size_t p = 0; p < paths.size(); p++) {
+        kernel_path = paths[p];
+
+        for (size_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+            if (!launchConfigValid(kernel_path, candidates[c], width, height)) continue;
+
+            local_size[0] = candidates[c][0];
+            local_size[1] = candidates[c][1];
+            processImage(input_data, output_data, width, height); // warm-up
+
+            double time = 0.0;
+            for (int run = 0; run < runs; run++) {
+                ProcessingMetrics metrics = processImage(input_data, output_data, width, height);
+                time += metrics.memory_transfer_time + metrics.kernel_execution_time;
+            }
+            time /= runs;
+
+            if (best.time < 0.0 || time < best.time) {
+                best.kernel_path = kernel_path;
+                best.local_size[0] = local_size[0];
+                best.local_size[1] = local_size[1];
+                best.time = time;
+            }
+        }
+    }
+
+    kernel_path = static_cast<KernelPath>(best.kernel_path);
+    local_size[0] = best.local_size[0];
+    local_size[1] = best.local_size[1];
+    database.store(device_key, size_class, best);
+    return best;
+}
+
+cl_sampler GaussianBlurProcessor::createBorderSampler(){
+    cl_addressing_mode addressing;
+    switch (border_mode) {
+        case BORDER_MIRROR: addressing = CL_ADDRESS_MIRRORED_REPEAT; break;
+        case BORDER_WRAP: addressing = CL_ADDRESS_REPEAT; break;
+        case BORDER_CONSTANT: addressing = CL_ADDRESS_CLAMP; break;
+        default: addressing = CL_ADDRESS_CLAMP_TO_EDGE; break;
+    }
+
+    // Repeat modes are only defined for normalized coordinates
+    cl_int err;
+    cl_sampler sampler = clCreateSampler(context, CL_TRUE, addressing, CL_FILTER_NEAREST, &err);
+    check_error(err, "Creating sampler");
+    return sampler;
+}
+
+void GaussianBlurProcessor::setBorderMode(BorderMode mode, unsigned char constant_value){
+    border_mode = mode;
+    border_constant = constant_value;
+}
+
+int GaussianBlurProcessor::remapCoordinate(int i, int n, BorderMode mode){
+    /*
+    Host twin of remap_coordinate() in gaussian_kernel.cl, used to pick the
+    rows of the halo. Returns -1 when the constant value has to be used.
+    */
+    if (i >= 0 && i < n) return i;
+
+    switch (mode){
+        case BORDER_CLAMP:
+            return std::min(std::max(i, 0), n - 1);
+        case BORDER_MIRROR:
+            i = (i < 0) ? -i - 1 : 2 * n - i - 1;
+            return std::min(std::max(i, 0), n - 1);
+        case BORDER_WRAP:
+            return ((i % n) + n) % n;
+        default:
+            return -1;
+    }
 }
 
 std::vector<float> GaussianBlurProcessor::create_gaussian_matrix(double sigma){
@@ -97,6 +692,30 @@ std::vector<float> GaussianBlurProcessor::create_gaussian_matrix(double sigma){
     return result;
 }
 
+std::vector<float> GaussianBlurProcessor::create_separable_kernel(double sigma){
+    // Normalized 1D Gaussian truncated at GAUSSIAN_TRUNCATE_SIGMAS sigmas
+    int radius = static_cast<int>(ceil(GAUSSIAN_TRUNCATE_SIGMAS * sigma));
+    std::vector<float> result(2 * radius + 1);
+    double sum = 0.0;
+    for (int i = -radius; i <= radius; i++) {
+        sum += exp(-(i * i) / (2 * sigma * sigma));
+    }
+    for (int i = -radius; i <= radius; i++) {
+        result[i + radius] = static_cast<float>(exp(-(i * i) / (2 * sigma * sigma)) / sum);
+    }
+    return result;
+}
+
+std::vector<float> GaussianBlurProcessor::outerProduct(const std::vector<float>& line){
+    std::vector<float> result(line.size() * line.size());
+    for (size_t j = 0; j < line.size(); j++) {
+        for (size_t i = 0; i < line.size(); i++) {
+            result[j * line.size() + i] = line[j] * line[i];
+        }
+    }
+    return result;
+}
+
 void GaussianBlurProcessor::printDeviceInfo() {
     cl_ulong global_mem_size;
     cl_ulong local_mem_size;
@@ -140,39 +759,406 @@ double GaussianBlurProcessor::calculateGPUOccupancy(size_t global_work_items, si
 }
 
 
-ProcessingMetrics GaussianBlurProcessor::processImage(const unsigned char* input_data, 
-                                                    unsigned char* output_data,
-                                                    int width, int height) {
-    ProcessingMetrics metrics = {};  // Initialisation à zéro de toutes les métriques
-    cl_event write_event, kernel_event, read_event;
+void GaussianBlurProcessor::enqueueWriteRows(cl_mem target, bool is_image, int dst_row, int num_rows,
+                                             int width, const unsigned char* src, int src_pitch, cl_event* event) {
+    // src_pitch is the host row length, larger than width when a region is uploaded
+    cl_int err;
+    if (is_image) {
+        size_t origin[3] = {0, static_cast<size_t>(dst_row), 0};
+        size_t region[3] = {static_cast<size_t>(width), static_cast<size_t>(num_rows), 1};
+        err = clEnqueueWriteImage(commands, target, CL_FALSE, origin, region, src_pitch, 0, src, 0, NULL, event);
+    } else if (src_pitch != width) {
+        size_t buffer_origin[3] = {0, static_cast<size_t>(dst_row), 0};
+        size_t host_origin[3] = {0, 0, 0};
+        size_t region[3] = {static_cast<size_t>(width), static_cast<size_t>(num_rows), 1};
+        err = clEnqueueWriteBufferRect(commands, target, CL_FALSE, buffer_origin, host_origin, region,
+                                       width, 0, src_pitch, 0, src, 0, NULL, event);
+    } else {
+        size_t row_size = width * sizeof(unsigned char);
+        err = clEnqueueWriteBuffer(commands, target, CL_FALSE, dst_row * row_size, num_rows * row_size,
+                                   src, 0, NULL, event);
+    }
+    check_error(err, "Writing rows to input memory object");
+}
+
+void GaussianBlurProcessor::writeSliceWithHalo(cl_mem buffer, bool is_image, const unsigned char* input_data,
+                                               int image_width, const SliceColumns& columns, int height,
+                                               int start_row, int rows, int halo_top, int halo_bottom,
+                                               BorderMode mode, std::vector<unsigned char>& constant_row,
+                                               std::vector<cl_event>& events) {
+    /*
+    Upload the rows [start_row - halo_top, start_row + rows + halo_bottom) of the
+    image, restricted to the columns of the slice. Rows of the image (neighbouring
+    slice included) are copied as is, the ones outside of it are picked following
+    mode, so the kernels see the same data however the image was split between
+    the devices. constant_row must stay alive until the writes are completed.
+    */
+    cl_event event;
+    int first = start_row - halo_top;
+    int last = start_row + rows + halo_bottom;
+    const unsigned char* source = input_data + columns.left;
+
+    // Rows inside the image are evenly spaced on the host, one write is enough
+    int inside_first = std::max(first, 0);
+    int inside_last = std::min(last, height);
+    enqueueWriteRows(buffer, is_image, inside_first - first, inside_last - inside_first, columns.width,
+                     source + static_cast<size_t>(inside_first) * image_width, image_width, &event);
+    events.push_back(event);
+
+    constant_row.assign(columns.width, border_constant);
+    for (int r = first; r < last; r++) {
+        if (r >= 0 && r < height) continue;
+
+        int src = remapCoordinate(r, height, mode);
+        const unsigned char* src_row = (src < 0) ? constant_row.data()
+                                                 : source + static_cast<size_t>(src) * image_width;
+        enqueueWriteRows(buffer, is_image, r - first, 1, columns.width, src_row, columns.width, &event);
+        events.push_back(event);
+    }
+}
+
+void GaussianBlurProcessor::enqueueReadSlice(cl_mem output_buffer, unsigned char* output_data, int image_width,
+                                             const SliceColumns& columns, int start_row, int rows,
+                                             cl_uint num_wait, const cl_event* wait, cl_event* event) {
+    // Blocking read of the columns kept, the halo columns computed by the kernels are dropped
     cl_int err;
+    if (columns.out_width == image_width) {
+        err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0,
+                                  static_cast<size_t>(rows) * image_width * sizeof(unsigned char),
+                                  output_data + static_cast<size_t>(start_row) * image_width,
+                                  num_wait, wait, event);
+    } else {
+        size_t buffer_origin[3] = {static_cast<size_t>(columns.out_offset), 0, 0};
+        size_t host_origin[3] = {static_cast<size_t>(columns.left + columns.out_offset),
+                                 static_cast<size_t>(start_row), 0};
+        size_t region[3] = {static_cast<size_t>(columns.out_width), static_cast<size_t>(rows), 1};
+        err = clEnqueueReadBufferRect(commands, output_buffer, CL_TRUE, buffer_origin, host_origin, region,
+                                      columns.width, 0, image_width, 0, output_data, num_wait, wait, event);
+    }
+    check_error(err, "Reading output buffer");
+}
 
+void GaussianBlurProcessor::getSlice(int height, int& start_row, int& rows) const {
+    if (region_width > 0) {
+        start_row = region_y;
+        rows = region_height;
+        return;
+    }
+
+    // The first GPU takes the upper half of the image, the second one the rest
     int GPU_height = height / 2;
     int remainder = height % 2;
 
-    int start_height, current_height;
     if (first_gpu) {
-        start_height = 0;
-        current_height = GPU_height;
+        start_row = 0;
+        rows = GPU_height;
     } else {
-        start_height = GPU_height;
-        current_height = GPU_height + remainder;
+        start_row = GPU_height;
+        rows = GPU_height + remainder;
+    }
+}
+
+GaussianBlurProcessor::SliceColumns GaussianBlurProcessor::getSliceColumns(int image_width, int halo) const {
+    /*
+    Whole rows unless a narrower region is set. Its halo columns are real
+    pixels, so the kernels process the buffer as an image of its own width:
+    the border policy only applies at the true edges of the image, and the
+    wrong values next to the other edges of the buffer fall in the halo.
+    Wrapping needs the opposite edge of the rows, whole rows are uploaded.
+    */
+    SliceColumns columns;
+    if (region_width == 0 || region_width == image_width || border_mode == BORDER_WRAP) {
+        columns.left = 0;
+        columns.width = image_width;
+        columns.out_offset = (region_width == 0) ? 0 : region_x;
+        columns.out_width = (region_width == 0) ? image_width : region_width;
+        return columns;
+    }
+    columns.left = std::max(region_x - halo, 0);
+    int right = std::min(region_x + region_width + halo, image_width);
+    columns.width = right - columns.left;
+    columns.out_offset = region_x - columns.left;
+    columns.out_width = region_width;
+    return columns;
+}
+
+GaussianBlurProcessor::SliceLayout GaussianBlurProcessor::computeSliceLayout(int width, int height,
+                                                                             int start_row, int rows) const {
+    SliceLayout layout;
+    layout.start_row = start_row;
+    layout.rows = rows;
+
+    // Halo rows: the neighbouring slice is always uploaded, rows outside the
+    // image are only synthesized when the border mode needs them.
+    int rows_above = start_row;
+    int rows_below = height - (start_row + rows);
+    layout.halo_top = (border_mode == BORDER_COPY) ? std::min(RADIUS, rows_above) : RADIUS;
+    layout.halo_bottom = (border_mode == BORDER_COPY) ? std::min(RADIUS, rows_below) : RADIUS;
+    layout.input_rows = rows + layout.halo_top + layout.halo_bottom;
+
+    // Pixels whose neighbourhood is not fully uploaded go to the border kernel
+    layout.top_rows = std::min(RADIUS - layout.halo_top, rows);
+    layout.bottom_start = std::max(rows - (RADIUS - layout.halo_bottom), layout.top_rows);
+    if (width <= 2 * RADIUS) {
+        layout.top_rows = layout.bottom_start = rows;
+    }
+    return layout;
+}
+
+size_t GaussianBlurProcessor::roundUp(size_t value, size_t multiple){
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+const size_t* GaussianBlurProcessor::localSizeFor(cl_kernel k) const {
+    /*
+    Tuned work-group size, or NULL (runtime choice) when the kernel cannot be
+    launched with it on this device.
+    */
+    size_t kernel_max;
+    size_t max_work_item_sizes[3];
+    clGetKernelWorkGroupInfo(k, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_max), &kernel_max, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_work_item_sizes), max_work_item_sizes, NULL);
+    if (local_size[0] == 0 || local_size[1] == 0 || local_size[0] * local_size[1] > kernel_max) return NULL;
+    if (local_size[0] > max_work_item_sizes[0] || local_size[1] > max_work_item_sizes[1]) return NULL;
+    return local_size;
+}
+
+bool GaussianBlurProcessor::launchConfigValid(KernelPath path, const size_t local[2], int width, int height) const {
+    /*
+    Whether the main kernel of a path can run on this device with the given
+    work-group size. Used for the tuner candidates and for the entries read
+    back from the tuning database, which may come from another device or
+    driver.
+    */
+    if (path == PATH_IMAGE && !imagePathAvailable(width, height)) return false;
+    if (path == PATH_FIXED && !fixedPointAvailable()) return false;
+    if (local[0] == 0 || local[1] == 0) return false;
+
+    cl_kernel main_kernel = (path == PATH_IMAGE) ? image_kernel
+                          : (path == PATH_VECTOR) ? vector_kernel
+                          : (path == PATH_FIXED) ? fixed_point_kernel : kernel;
+    size_t max_work_group_size, kernel_max;
+    size_t max_work_item_sizes[3];
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group_size), &max_work_group_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_work_item_sizes), max_work_item_sizes, NULL);
+    clGetKernelWorkGroupInfo(main_kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_max), &kernel_max, NULL);
+
+    if (local[0] * local[1] > std::min(max_work_group_size, kernel_max)) return false;
+    return local[0] <= max_work_item_sizes[0] && local[1] <= max_work_item_sizes[1];
+}
+
+cl_uint GaussianBlurProcessor::enqueueBlurKernels(cl_mem input_buffer, bool use_image, cl_mem output_buffer,
+                                                  cl_mem kernel_buffer, cl_mem fixed_kernel_buffer,
+                                                  cl_mem dim_buffer, int width,
+                                                  const SliceLayout& layout,
+                                                  const std::vector<cl_event>& wait_events,
+                                                  cl_event* kernel_events, cl_sampler* sampler,
+                                                  size_t* work_items) {
+    /*
+    Enqueue the kernels blurring one uploaded slice. Global sizes are padded
+    to a multiple of the work-group size, the kernels skip the extra
+    work-items. The fixed-point interior kernel is used when
+    fixed_kernel_buffer is given. Returns the number of events written to
+    kernel_events.
+    */
+    cl_int err;
+    cl_uint num_kernel_events = 0;
+    const size_t* local = NULL;
+    size_t global_size[2];
+
+    if (use_image) {
+        // Sampler path: one launch over the whole slice, the columns outside
+        // the image are handled by the sampler addressing mode and the rows
+        // by the halo.
+        *sampler = createBorderSampler();
+        err = clSetKernelArg(image_kernel, 0, sizeof(cl_mem), &input_buffer);
+        err |= clSetKernelArg(image_kernel, 1, sizeof(cl_sampler), sampler);
+        err |= clSetKernelArg(image_kernel, 2, sizeof(cl_mem), &output_buffer);
+        err |= clSetKernelArg(image_kernel, 3, sizeof(cl_mem), &kernel_buffer);
+        err |= clSetKernelArg(image_kernel, 4, sizeof(cl_mem), &dim_buffer);
+        check_error(err, "Setting image kernel arguments");
+
+        local = localSizeFor(image_kernel);
+        global_size[0] = local ? roundUp(width, local[0]) : width;
+        global_size[1] = local ? roundUp(layout.rows, local[1]) : layout.rows;
+        *work_items = global_size[0] * global_size[1];
+
+        err = clEnqueueNDRangeKernel(commands, image_kernel, 2, NULL, global_size, local,
+                                    wait_events.size(), wait_events.data(),
+                                    &kernel_events[num_kernel_events++]);
+        check_error(err, "Enqueuing image kernel");
+        return num_kernel_events;
+    }
+
+    // Interior pass, branch-free apart from the padding test
+    int x_end = width - RADIUS;
+    int y_end = layout.bottom_start;
+    size_t interior_width = static_cast<size_t>(std::max(width - 2 * RADIUS, 0));
+    size_t interior_rows = static_cast<size_t>(layout.bottom_start - layout.top_rows);
+    size_t global_offset[2] = {static_cast<size_t>(RADIUS), static_cast<size_t>(layout.top_rows)};
+    *work_items = 0;
+
+    if (kernel_path == PATH_VECTOR) {
+        // vector_width pixels per work-item, the columns left over on the
+        // right go to the scalar kernel
+        int vector_count = interior_width / vector_width;
+        size_t vector_offset[2] = {0, static_cast<size_t>(layout.top_rows)};
+
+        err = clSetKernelArg(vector_kernel, 0, sizeof(cl_mem), &input_buffer);
+        err |= clSetKernelArg(vector_kernel, 1, sizeof(cl_mem), &output_buffer);
+        err |= clSetKernelArg(vector_kernel, 2, sizeof(cl_mem), &kernel_buffer);
+        err |= clSetKernelArg(vector_kernel, 3, sizeof(cl_mem), &dim_buffer);
+        err |= clSetKernelArg(vector_kernel, 4, sizeof(int), &vector_count);
+        err |= clSetKernelArg(vector_kernel, 5, sizeof(int), &y_end);
+        check_error(err, "Setting vector kernel arguments");
+
+        if (vector_count > 0 && interior_rows > 0) {
+            local = localSizeFor(vector_kernel);
+            global_size[0] = local ? roundUp(vector_count, local[0]) : vector_count;
+            global_size[1] = local ? roundUp(interior_rows, local[1]) : interior_rows;
+            *work_items += global_size[0] * global_size[1];
+
+            err = clEnqueueNDRangeKernel(commands, vector_kernel, 2, vector_offset, global_size, local,
+                                        wait_events.size(), wait_events.data(),
+                                        &kernel_events[num_kernel_events++]);
+            check_error(err, "Enqueuing vector kernel");
+        }
+        global_offset[0] += vector_count * vector_width;
+        interior_width -= vector_count * vector_width;
+    }
+
+    cl_kernel interior_kernel = fixed_kernel_buffer ? fixed_point_kernel : kernel;
+    cl_mem interior_weights = fixed_kernel_buffer ? fixed_kernel_buffer : kernel_buffer;
+    err = clSetKernelArg(interior_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(interior_kernel, 1, sizeof(cl_mem), &output_buffer);
+    err |= clSetKernelArg(interior_kernel, 2, sizeof(cl_mem), &interior_weights);
+    err |= clSetKernelArg(interior_kernel, 3, sizeof(cl_mem), &dim_buffer);
+    err |= clSetKernelArg(interior_kernel, 4, sizeof(int), &x_end);
+    err |= clSetKernelArg(interior_kernel, 5, sizeof(int), &y_end);
+    check_error(err, "Setting kernel arguments");
+
+    if (interior_width > 0 && interior_rows > 0) {
+        // The vector tail is narrower than a work-group, let the runtime choose
+        local = (kernel_path == PATH_VECTOR) ? NULL : localSizeFor(interior_kernel);
+        global_size[0] = local ? roundUp(interior_width, local[0]) : interior_width;
+        global_size[1] = local ? roundUp(interior_rows, local[1]) : interior_rows;
+        *work_items += global_size[0] * global_size[1];
+
+        err = clEnqueueNDRangeKernel(commands, interior_kernel, 2, global_offset, global_size, local,
+                                    wait_events.size(), wait_events.data(),
+                                    &kernel_events[num_kernel_events++]);
+        check_error(err, "Enqueuing kernel");
+    }
+
+    // Border pass over the remaining frame
+    int border_mode_arg = border_mode;
+    cl_uchar constant_arg = border_constant;
+    err = clSetKernelArg(border_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(border_kernel, 1, sizeof(cl_mem), &output_buffer);
+    err |= clSetKernelArg(border_kernel, 2, sizeof(cl_mem), &kernel_buffer);
+    err |= clSetKernelArg(border_kernel, 3, sizeof(cl_mem), &dim_buffer);
+    err |= clSetKernelArg(border_kernel, 4, sizeof(int), &layout.top_rows);
+    err |= clSetKernelArg(border_kernel, 5, sizeof(int), &layout.bottom_start);
+    err |= clSetKernelArg(border_kernel, 6, sizeof(int), &border_mode_arg);
+    err |= clSetKernelArg(border_kernel, 7, sizeof(cl_uchar), &constant_arg);
+    check_error(err, "Setting border kernel arguments");
+
+    size_t border_size = static_cast<size_t>(layout.top_rows) * width
+                       + static_cast<size_t>(layout.bottom_start - layout.top_rows) * 2 * RADIUS
+                       + static_cast<size_t>(layout.rows - layout.bottom_start) * width;
+
+    if (border_size > 0) {
+        err = clEnqueueNDRangeKernel(commands, border_kernel, 1, NULL, &border_size, NULL,
+                                    wait_events.size(), wait_events.data(),
+                                    &kernel_events[num_kernel_events++]);
+        check_error(err, "Enqueuing border kernel");
+    }
+    return num_kernel_events;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processImage(const unsigned char* input_data,
+                                                    unsigned char* output_data,
+                                                    int width, int height) {
+    if (!custom_kernel.empty()) {
+        return processImageCustom(input_data, output_data, width, height);
     }
 
-    std::vector<int> dim = {current_height, width};
+    ProcessingMetrics metrics;
+    switch (algorithm) {
+        case BLUR_IIR:
+            metrics = processImageIIR(input_data, output_data, width, height);
+            break;
+        case BLUR_BOX:
+            metrics = processImageBox(input_data, output_data, width, height);
+            break;
+        case BLUR_SEPARABLE:
+            metrics = processImageSeparable(input_data, output_data, width, height);
+            break;
+        case BLUR_FFT: {
+            std::vector<float> line = create_separable_kernel(sigma);
+            int size = static_cast<int>(line.size());
+            metrics = processImageConvolution(input_data, output_data, width, height,
+                                              outerProduct(line), size, size, true);
+            break;
+        }
+        default:
+            metrics = processImageDirect(input_data, output_data, width, height);
+            break;
+    }
+    metrics.algorithm = algorithm;
+    metrics.predicted_time = predicted_time;
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processUnsharp(const unsigned char* input_data, unsigned char* output_data,
+                                                        int width, int height, const UnsharpMask& unsharp) {
+    // Always the separable engine: the sigma of setSigma() gives the radius of the mask
+    ProcessingMetrics metrics = processImageSeparable(input_data, output_data, width, height, &unsharp);
+    metrics.algorithm = BLUR_SEPARABLE;
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processImageDirect(const unsigned char* input_data, 
+                                                          unsigned char* output_data,
+                                                          int image_width, int height) {
+    ProcessingMetrics metrics = {};  // Initialisation à zéro de toutes les métriques
+    std::vector<cl_event> write_events;
+    cl_event kernel_events[3], read_event;
+    cl_int err;
+
+    int start_height, current_height;
+    getSlice(height, start_height, current_height);
+
+    SliceColumns columns = getSliceColumns(image_width, RADIUS);
+    int width = columns.width;
+    SliceLayout layout = computeSliceLayout(width, height, start_height, current_height);
+    std::vector<int> dim = {current_height, width, layout.halo_top, layout.input_rows};
 
     // Calcul précis de la mémoire utilisée
     size_t buffer_size = current_height * width * sizeof(unsigned char);
+    size_t input_buffer_size = layout.input_rows * width * sizeof(unsigned char);
     size_t gaussian_buffer_size = gaussian_kernel.size() * sizeof(float);
     size_t dim_buffer_size = dim.size() * sizeof(int);
     
-    metrics.memory_used = buffer_size * 2 + // input et output buffers
+    metrics.memory_used = input_buffer_size + buffer_size + // input et output buffers
                          gaussian_buffer_size + // kernel gaussien
                          dim_buffer_size;  // buffer des dimensions
 
     // Création des buffers avec gestion d'erreurs
-    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, buffer_size, NULL, &err);
-    check_error(err, "Creating input buffer");
+    bool use_image = (kernel_path == PATH_IMAGE) && imagePathAvailable(width, layout.input_rows);
+    cl_mem input_buffer;
+    if (use_image) {
+        cl_image_format format = {CL_R, CL_UNSIGNED_INT8};
+        cl_image_desc desc = {};
+        desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+        desc.image_width = width;
+        desc.image_height = layout.input_rows;
+        input_buffer = clCreateImage(context, CL_MEM_READ_ONLY, &format, &desc, NULL, &err);
+        check_error(err, "Creating input image");
+    } else {
+        input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_buffer_size + VECTOR_PADDING, NULL, &err);
+        check_error(err, "Creating input buffer");
+    }
     
     cl_mem kernel_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 
                                         gaussian_buffer_size, gaussian_kernel.data(), &err);
@@ -181,6 +1167,16 @@ ProcessingMetrics GaussianBlurProcessor::processImage(const unsigned char* input
     cl_mem dim_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 
                                      dim_buffer_size, dim.data(), &err);
     check_error(err, "Creating dim buffer");
+
+    // Fixed-point weights, only when the error bound allows it
+    cl_mem fixed_kernel_buffer = NULL;
+    if (kernel_path == PATH_FIXED && fixedPointAvailable()) {
+        size_t fixed_buffer_size = fixed_gaussian_kernel.size() * sizeof(cl_ushort);
+        fixed_kernel_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                             fixed_buffer_size, fixed_gaussian_kernel.data(), &err);
+        check_error(err, "Creating fixed-point kernel buffer");
+        metrics.memory_used += fixed_buffer_size;
+    }
     
     cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, buffer_size, NULL, &err);
     check_error(err, "Creating output buffer");
@@ -188,54 +1184,2533 @@ ProcessingMetrics GaussianBlurProcessor::processImage(const unsigned char* input
     // Mesure du temps avec des événements
     auto cpu_start = std::chrono::high_resolution_clock::now();
 
-    err = clEnqueueWriteBuffer(commands, input_buffer, CL_TRUE, 0, buffer_size,
-                              input_data + (start_height * width), 0, NULL, &write_event);
-    check_error(err, "Writing to input buffer");
-
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_buffer);
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output_buffer);
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &kernel_buffer);
-    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &dim_buffer);
-    check_error(err, "Setting kernel arguments");
-
-    size_t global_size[2] = {static_cast<size_t>(width), static_cast<size_t>(current_height)};
-    size_t local_size[2] = {16, 16};
+    std::vector<unsigned char> constant_row;
+    writeSliceWithHalo(input_buffer, use_image, input_data, image_width, columns, height, start_height, current_height,
+                       layout.halo_top, layout.halo_bottom, border_mode, constant_row, write_events);
 
-    err = clEnqueueNDRangeKernel(commands, kernel, 2, NULL, global_size, local_size,
-                                0, NULL, &kernel_event);
-    check_error(err, "Enqueuing kernel");
+    cl_sampler sampler = NULL;
+    size_t work_items = 0;
+    cl_uint num_kernel_events = enqueueBlurKernels(input_buffer, use_image, output_buffer, kernel_buffer,
+                                                   fixed_kernel_buffer, dim_buffer, width, layout, write_events, kernel_events,
+                                                   &sampler, &work_items);
 
-    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, buffer_size,
-                             output_data + (start_height * width), 
-                             0, NULL, &read_event);
-    check_error(err, "Reading output buffer");
+    enqueueReadSlice(output_buffer, output_data, image_width, columns, start_height, current_height,
+                     num_kernel_events, kernel_events, &read_event);
 
     clFinish(commands);
     auto cpu_end = std::chrono::high_resolution_clock::now();
 
     // Calcul des temps d'exécution
-    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(read_event);
-    metrics.kernel_execution_time = getEventExecutionTime(kernel_event);
+    for (size_t i = 0; i < write_events.size(); i++) {
+        metrics.memory_transfer_time += getEventExecutionTime(write_events[i]);
+    }
+    metrics.memory_transfer_time += getEventExecutionTime(read_event);
+    for (cl_uint i = 0; i < num_kernel_events; i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
     metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
     metrics.overhead_time = metrics.total_processing_time - 
                           (metrics.memory_transfer_time + metrics.kernel_execution_time);
     
     // Calcul de l'occupation GPU
-    metrics.gpu_occupancy = calculateGPUOccupancy(global_size[0] * global_size[1], 
-                                                local_size[0] * local_size[1]);
+    metrics.gpu_occupancy = calculateGPUOccupancy(work_items, local_size[0] * local_size[1]);
 
     // Nettoyage
-    clReleaseEvent(write_event);
-    clReleaseEvent(kernel_event);
+    for (size_t i = 0; i < write_events.size(); i++) {
+        clReleaseEvent(write_events[i]);
+    }
+    for (cl_uint i = 0; i < num_kernel_events; i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
     clReleaseEvent(read_event);
+    if (sampler) clReleaseSampler(sampler);
     clReleaseMemObject(input_buffer);
     clReleaseMemObject(output_buffer);
     clReleaseMemObject(kernel_buffer);
     clReleaseMemObject(dim_buffer);
+    if (fixed_kernel_buffer) clReleaseMemObject(fixed_kernel_buffer);
+
+    return metrics;
+}
+
+void GaussianBlurProcessor::enqueueTranspose(cl_kernel transpose, cl_mem input, cl_mem output,
+                                             int width, int height, cl_uint num_wait, const cl_event* wait,
+                                             cl_event* event) {
+    cl_int err;
+    err = clSetKernelArg(transpose, 0, sizeof(cl_mem), &input);
+    err |= clSetKernelArg(transpose, 1, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(transpose, 2, sizeof(int), &width);
+    err |= clSetKernelArg(transpose, 3, sizeof(int), &height);
+    check_error(err, "Setting transpose kernel arguments");
+
+    size_t local[2] = {TRANSPOSE_TILE, TRANSPOSE_TILE};
+    size_t global[2] = {roundUp(width, TRANSPOSE_TILE), roundUp(height, TRANSPOSE_TILE)};
+    err = clEnqueueNDRangeKernel(commands, transpose, 2, NULL, global, local, num_wait, wait, event);
+    check_error(err, "Enqueuing transpose kernel");
+}
+
+void GaussianBlurProcessor::enqueueIIR(cl_mem data, cl_mem output, int columns, int length, int pad,
+                                       int out_start, int out_rows, cl_event wait, cl_event* event) {
+    cl_int err;
+    float c[4];
+    iirCoefficients(sigma, c);
+    cl_float4 coefficients;
+    for (int i = 0; i < 4; i++) coefficients.s[i] = c[i];
+    int use_constant = (border_mode == BORDER_CONSTANT);
+    float constant_value = border_constant;
+
+    err = clSetKernelArg(iir_kernel, 0, sizeof(cl_mem), &data);
+    err |= clSetKernelArg(iir_kernel, 1, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(iir_kernel, 2, sizeof(int), &columns);
+    err |= clSetKernelArg(iir_kernel, 3, sizeof(int), &length);
+    err |= clSetKernelArg(iir_kernel, 4, sizeof(int), &pad);
+    err |= clSetKernelArg(iir_kernel, 5, sizeof(int), &out_start);
+    err |= clSetKernelArg(iir_kernel, 6, sizeof(int), &out_rows);
+    err |= clSetKernelArg(iir_kernel, 7, sizeof(cl_float4), &coefficients);
+    err |= clSetKernelArg(iir_kernel, 8, sizeof(int), &use_constant);
+    err |= clSetKernelArg(iir_kernel, 9, sizeof(float), &constant_value);
+    check_error(err, "Setting IIR kernel arguments");
+
+    size_t global_size = columns;
+    err = clEnqueueNDRangeKernel(commands, iir_kernel, 1, NULL, &global_size, NULL, 1, &wait, event);
+    check_error(err, "Enqueuing IIR kernel");
+}
+
+ProcessingMetrics GaussianBlurProcessor::processImageIIR(const unsigned char* input_data,
+                                                         unsigned char* output_data,
+                                                         int image_width, int height) {
+    /*
+    Recursive Gaussian of the slice: rows pass on the transposed slice, then
+    columns pass writing the bytes. The halo of IIR_HALO_SIGMAS sigmas lets the
+    recursions settle before the rows of the slice, the rows are padded by as
+    many columns for the anticausal start. Mirror and wrap are only honoured
+    by the halo rows, the columns are extended as clamp. Copying the border
+    pixels makes no sense for an infinite response, copy is handled as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    std::vector<cl_event> write_events;
+    cl_event kernel_events[4], read_event;
+    cl_int err;
+
+    int start_row, rows;
+    getSlice(height, start_row, rows);
+
+    int halo = static_cast<int>(ceil(IIR_HALO_SIGMAS * sigma));
+    SliceColumns columns = getSliceColumns(image_width, halo);
+    int width = columns.width;
+    int input_rows = rows + 2 * halo;
+    BorderMode halo_mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+
+    size_t input_size = input_rows * width * sizeof(unsigned char);
+    size_t float_size = input_rows * width * sizeof(float);
+    size_t transposed_size = input_rows * (width + halo) * sizeof(float);
+    size_t output_size = rows * width * sizeof(unsigned char);
+    metrics.memory_used = input_size + transposed_size + float_size + output_size;
+
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem transposed_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, transposed_size, NULL, &err);
+    check_error(err, "Creating transposed buffer");
+    cl_mem float_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+    check_error(err, "Creating float buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output_size, NULL, &err);
+    check_error(err, "Creating output buffer");
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> constant_row;
+    writeSliceWithHalo(input_buffer, false, input_data, image_width, columns, height, start_row, rows,
+                       halo, halo, halo_mode, constant_row, write_events);
+
+    // Rows pass: the transposed slice is (width + halo) x input_rows, its columns are the rows
+    cl_mem no_output = NULL;
+    enqueueTranspose(transpose_uchar_kernel, input_buffer, transposed_buffer, width, input_rows,
+                     write_events.size(), write_events.data(), &kernel_events[0]);
+    enqueueIIR(transposed_buffer, no_output, input_rows, width, halo, 0, 0, kernel_events[0], &kernel_events[1]);
+
+    // Columns pass on the slice back in row-major order, only the rows of the slice are stored
+    enqueueTranspose(transpose_float_kernel, transposed_buffer, float_buffer, input_rows, width,
+                     1, &kernel_events[1], &kernel_events[2]);
+    enqueueIIR(float_buffer, output_buffer, width, input_rows, 0, halo, rows, kernel_events[2], &kernel_events[3]);
+
+    enqueueReadSlice(output_buffer, output_data, image_width, columns, start_row, rows,
+                     1, &kernel_events[3], &read_event);
+
+    clFinish(commands);
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        metrics.memory_transfer_time += getEventExecutionTime(write_events[i]);
+    }
+    metrics.memory_transfer_time += getEventExecutionTime(read_event);
+    for (int i = 0; i < 4; i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(iir_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(width, work_group_size);
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        clReleaseEvent(write_events[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(transposed_buffer);
+    clReleaseMemObject(float_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+void GaussianBlurProcessor::enqueueBox(cl_mem input, cl_mem output, cl_mem byte_output, int columns, int length,
+                                       int radius, int out_start, int out_rows, BorderMode mode,
+                                       cl_event wait, cl_event* event) {
+    cl_int err;
+    int mode_value = mode;
+    float constant_value = border_constant;
+
+    err = clSetKernelArg(box_kernel, 0, sizeof(cl_mem), &input);
+    err |= clSetKernelArg(box_kernel, 1, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(box_kernel, 2, sizeof(cl_mem), &byte_output);
+    err |= clSetKernelArg(box_kernel, 3, sizeof(int), &columns);
+    err |= clSetKernelArg(box_kernel, 4, sizeof(int), &length);
+    err |= clSetKernelArg(box_kernel, 5, sizeof(int), &radius);
+    err |= clSetKernelArg(box_kernel, 6, sizeof(int), &out_start);
+    err |= clSetKernelArg(box_kernel, 7, sizeof(int), &out_rows);
+    err |= clSetKernelArg(box_kernel, 8, sizeof(int), &mode_value);
+    err |= clSetKernelArg(box_kernel, 9, sizeof(float), &constant_value);
+    check_error(err, "Setting box kernel arguments");
+
+    size_t global_size = columns;
+    err = clEnqueueNDRangeKernel(commands, box_kernel, 1, NULL, &global_size, NULL, 1, &wait, event);
+    check_error(err, "Enqueuing box kernel");
+}
+
+ProcessingMetrics GaussianBlurProcessor::processImageBox(const unsigned char* input_data,
+                                                         unsigned char* output_data,
+                                                         int image_width, int height) {
+    /*
+    Approximate Gaussian of the slice: BOX_PASSES box filters along the rows
+    of the transposed slice, then as many along the columns, ping-ponging
+    between two float buffers. The halo is the sum of the radii, so the rows
+    are exact for every border mode. Along the rows the border policy is
+    applied at each pass (copy is handled as clamp).
+    */
+    ProcessingMetrics metrics = {};
+    std::vector<cl_event> write_events;
+    const int num_kernels = 2 * BOX_PASSES + 2;
+    cl_event kernel_events[num_kernels], read_event;
+    cl_int err;
+
+    int start_row, rows;
+    getSlice(height, start_row, rows);
+
+    int radii[BOX_PASSES];
+    boxRadii(sigma, radii);
+    int halo = 0;
+    for (int p = 0; p < BOX_PASSES; p++) halo += radii[p];
+    SliceColumns columns = getSliceColumns(image_width, halo);
+    int width = columns.width;
+    int input_rows = rows + 2 * halo;
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+
+    size_t input_size = input_rows * width * sizeof(unsigned char);
+    size_t float_size = input_rows * width * sizeof(float);
+    size_t output_size = rows * width * sizeof(unsigned char);
+    metrics.memory_used = input_size + 2 * float_size + output_size;
+    metrics.approximation_rms_error = boxApproximationError(sigma);
+
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem float_buffers[2];
+    for (int i = 0; i < 2; i++) {
+        float_buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+        check_error(err, "Creating float buffer");
+    }
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output_size, NULL, &err);
+    check_error(err, "Creating output buffer");
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> constant_row;
+    writeSliceWithHalo(input_buffer, false, input_data, image_width, columns, height, start_row, rows,
+                       halo, halo, mode, constant_row, write_events);
+
+    // Rows passes on the transposed slice (width x input_rows), the result ends in float_buffers[1]
+    cl_mem no_buffer = NULL;
+    int k = 0, current = 0;
+    enqueueTranspose(transpose_uchar_kernel, input_buffer, float_buffers[0], width, input_rows,
+                     write_events.size(), write_events.data(), &kernel_events[k]);
+    for (int p = 0; p < BOX_PASSES; p++, k++) {
+        enqueueBox(float_buffers[current], float_buffers[1 - current], no_buffer, input_rows, width,
+                   radii[p], 0, 0, mode, kernel_events[k], &kernel_events[k + 1]);
+        current = 1 - current;
+    }
+
+    // Columns passes on the slice back in row-major order, the last one writes the bytes
+    enqueueTranspose(transpose_float_kernel, float_buffers[current], float_buffers[1 - current], input_rows, width,
+                     1, &kernel_events[k], &kernel_events[k + 1]);
+    k++;
+    current = 1 - current;
+    for (int p = 0; p < BOX_PASSES; p++, k++) {
+        bool last = (p == BOX_PASSES - 1);
+        enqueueBox(float_buffers[current], float_buffers[1 - current], last ? output_buffer : no_buffer,
+                   width, input_rows, radii[p], halo, last ? rows : 0, mode, kernel_events[k], &kernel_events[k + 1]);
+        current = 1 - current;
+    }
+
+    enqueueReadSlice(output_buffer, output_data, image_width, columns, start_row, rows,
+                     1, &kernel_events[k], &read_event);
+
+    clFinish(commands);
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        metrics.memory_transfer_time += getEventExecutionTime(write_events[i]);
+    }
+    metrics.memory_transfer_time += getEventExecutionTime(read_event);
+    for (int i = 0; i < num_kernels; i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(box_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(width, work_group_size);
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        clReleaseEvent(write_events[i]);
+    }
+    for (int i = 0; i < num_kernels; i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(float_buffers[0]);
+    clReleaseMemObject(float_buffers[1]);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processImageCustom(const unsigned char* input_data,
+                                                            unsigned char* output_data,
+                                                            int width, int height) {
+    // The break-even is measured on the first job of each image size, on the
+    // first tile only when tiling (the edge tiles are smaller)
+    if (region_width > 0) {
+        if (fft_break_even_area == 0) measureFFTBreakEven(region_width, region_height);
+    } else if (fft_break_even_area == 0 || width != fft_measured_width || height != fft_measured_height) {
+        measureFFTBreakEven(width, height);
+    }
+    bool use_fft = static_cast<long>(custom_kernel_width) * custom_kernel_height >= fft_break_even_area;
+    ProcessingMetrics metrics = processImageConvolution(input_data, output_data, width, height,
+                                                        custom_kernel, custom_kernel_width, custom_kernel_height, use_fft);
+    metrics.algorithm = use_fft ? BLUR_FFT : BLUR_DIRECT;
+    return metrics;
+}
+
+void GaussianBlurProcessor::measureFFTBreakEven(int width, int height) {
+    /*
+    Time the direct and the FFT convolutions on an image of the job size for
+    growing square kernels. The break-even is the area of the first kernel for
+    which the FFT wins; the FFT cost hardly depends on the kernel, so past
+    FFT_BREAK_EVEN_MAX_RADIUS it is assumed to win.
+    */
+    std::vector<unsigned char> input(static_cast<size_t>(width) * height, 0);
+    std::vector<unsigned char> output(input.size());
+    int saved_region[4] = {region_x, region_y, region_width, region_height};
+    clearRegion();
+
+    fft_break_even_area = 0;
+    for (int radius = 1; radius <= FFT_BREAK_EVEN_MAX_RADIUS && fft_break_even_area == 0; radius *= 2) {
+        int size = 2 * radius + 1;
+        std::vector<float> weights(size * size, 1.0f / (size * size));
+
+        double best[2] = {0, 0};
+        for (int use_fft = 0; use_fft < 2; use_fft++) {
+            for (int run = 0; run < 2; run++) {
+                ProcessingMetrics m = processImageConvolution(input.data(), output.data(), width, height,
+                                                              weights, size, size, use_fft != 0);
+                if (run == 0 || m.total_processing_time < best[use_fft]) best[use_fft] = m.total_processing_time;
+            }
+        }
+        if (best[1] < best[0]) fft_break_even_area = static_cast<long>(size) * size;
+    }
+    if (fft_break_even_area == 0) {
+        fft_break_even_area = static_cast<long>(2 * FFT_BREAK_EVEN_MAX_RADIUS + 1) * (2 * FFT_BREAK_EVEN_MAX_RADIUS + 1);
+    }
+    fft_measured_width = width;
+    fft_measured_height = height;
+    setRegion(saved_region[0], saved_region[1], saved_region[2], saved_region[3]);
+
+    std::cout << "FFT break-even: " << fft_break_even_area << " kernel taps" << std::endl;
+}
+
+cl_mem GaussianBlurProcessor::createKernelSpectrum(const std::vector<float>& weights, int kernel_width,
+                                                   int kernel_height, int tile_size, std::vector<cl_event>& events) {
+    /*
+    Transform of the kernel flipped in both directions, so that the product of
+    the spectra gives the same orientation as the direct kernels.
+    */
+    cl_int err;
+    int log2_tile = 0;
+    while ((1 << log2_tile) < tile_size) log2_tile++;
+
+    std::vector<cl_float2> tile(static_cast<size_t>(tile_size) * tile_size);
+    for (size_t i = 0; i < tile.size(); i++) {
+        tile[i].s[0] = tile[i].s[1] = 0.0f;
+    }
+    for (int j = 0; j < kernel_height; j++) {
+        for (int i = 0; i < kernel_width; i++) {
+            int rj = 0, ri = 0;
+            for (int b = 0; b < log2_tile; b++) {
+                rj |= ((j >> b) & 1) << (log2_tile - 1 - b);
+                ri |= ((i >> b) & 1) << (log2_tile - 1 - b);
+            }
+            tile[rj * tile_size + ri].s[0] = weights[(kernel_height - 1 - j) * kernel_width + (kernel_width - 1 - i)];
+        }
+    }
+
+    cl_mem spectrum = clCreateBuffer(context, CL_MEM_READ_WRITE, tile.size() * sizeof(cl_float2), NULL, &err);
+    check_error(err, "Creating kernel spectrum buffer");
+    err = clEnqueueWriteBuffer(commands, spectrum, CL_TRUE, 0, tile.size() * sizeof(cl_float2),
+                               tile.data(), 0, NULL, NULL);
+    check_error(err, "Writing kernel spectrum buffer");
+
+    enqueueFFT(spectrum, 1, tile_size, -1.0f, events);
+    return spectrum;
+}
+
+void GaussianBlurProcessor::enqueueFFT(cl_mem tiles, int num_tiles, int tile_size, float direction,
+                                       std::vector<cl_event>& events) {
+    // Rows then columns of every tile, the input being in bit-reversed order
+    cl_int err;
+    for (int columns = 0; columns < 2; columns++) {
+        for (int half_span = 1; half_span < tile_size; half_span *= 2) {
+            err = clSetKernelArg(fft_stage_kernel, 0, sizeof(cl_mem), &tiles);
+            err |= clSetKernelArg(fft_stage_kernel, 1, sizeof(int), &tile_size);
+            err |= clSetKernelArg(fft_stage_kernel, 2, sizeof(int), &half_span);
+            err |= clSetKernelArg(fft_stage_kernel, 3, sizeof(int), &columns);
+            err |= clSetKernelArg(fft_stage_kernel, 4, sizeof(float), &direction);
+            check_error(err, "Setting FFT kernel arguments");
+
+            size_t global_size[3] = {static_cast<size_t>(tile_size / 2), static_cast<size_t>(tile_size),
+                                     static_cast<size_t>(num_tiles)};
+            cl_event event;
+            err = clEnqueueNDRangeKernel(commands, fft_stage_kernel, 3, NULL, global_size, NULL,
+                                         events.empty() ? 0 : 1, events.empty() ? NULL : &events.back(), &event);
+            check_error(err, "Enqueuing FFT kernel");
+            events.push_back(event);
+        }
+    }
+}
+
+ProcessingMetrics GaussianBlurProcessor::processImageConvolution(const unsigned char* input_data,
+                                                                 unsigned char* output_data,
+                                                                 int image_width, int height,
+                                                                 const std::vector<float>& weights,
+                                                                 int kernel_width, int kernel_height,
+                                                                 bool use_fft) {
+    /*
+    Convolution of the slice by an arbitrary kernel, directly or by overlap-add
+    FFT (see gaussian_kernel.cl). The halo provides the rows, the columns are
+    extended by the kernels. Copy is handled as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    std::vector<cl_event> write_events, kernel_events;
+    cl_event read_event;
+    cl_int err;
+
+    int start_row, rows;
+    getSlice(height, start_row, rows);
+
+    int radius_x = kernel_width / 2;
+    int radius_y = kernel_height / 2;
+    SliceColumns columns = getSliceColumns(image_width, radius_x);
+    int width = columns.width;
+    int input_rows = rows + 2 * radius_y;
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    int mode_value = mode;
+
+    size_t input_size = input_rows * width * sizeof(unsigned char);
+    size_t output_size = rows * width * sizeof(unsigned char);
+    metrics.memory_used = input_size + output_size;
+
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output_size, NULL, &err);
+    check_error(err, "Creating output buffer");
+    std::vector<cl_mem> work_buffers;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> constant_row;
+    writeSliceWithHalo(input_buffer, false, input_data, image_width, columns, height, start_row, rows,
+                       radius_y, radius_y, mode, constant_row, write_events);
+
+    cl_kernel last_kernel;
+    if (!use_fft) {
+        cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                               weights.size() * sizeof(float),
+                                               const_cast<float*>(weights.data()), &err);
+        check_error(err, "Creating weights buffer");
+        work_buffers.push_back(weights_buffer);
+        metrics.memory_used += weights.size() * sizeof(float);
+
+        err = clSetKernelArg(convolve_kernel, 0, sizeof(cl_mem), &input_buffer);
+        err |= clSetKernelArg(convolve_kernel, 1, sizeof(cl_mem), &output_buffer);
+        err |= clSetKernelArg(convolve_kernel, 2, sizeof(cl_mem), &weights_buffer);
+        err |= clSetKernelArg(convolve_kernel, 3, sizeof(int), &width);
+        err |= clSetKernelArg(convolve_kernel, 4, sizeof(int), &rows);
+        err |= clSetKernelArg(convolve_kernel, 5, sizeof(int), &radius_y);
+        err |= clSetKernelArg(convolve_kernel, 6, sizeof(int), &radius_x);
+        err |= clSetKernelArg(convolve_kernel, 7, sizeof(int), &radius_y);
+        err |= clSetKernelArg(convolve_kernel, 8, sizeof(int), &mode_value);
+        err |= clSetKernelArg(convolve_kernel, 9, sizeof(cl_uchar), &border_constant);
+        check_error(err, "Setting convolution kernel arguments");
+
+        const size_t* local = localSizeFor(convolve_kernel);
+        size_t global_size[2];
+        global_size[0] = local ? roundUp(width, local[0]) : width;
+        global_size[1] = local ? roundUp(rows, local[1]) : rows;
+        cl_event event;
+        err = clEnqueueNDRangeKernel(commands, convolve_kernel, 2, NULL, global_size, local,
+                                     write_events.size(), write_events.data(), &event);
+        check_error(err, "Enqueuing convolution kernel");
+        kernel_events.push_back(event);
+        last_kernel = convolve_kernel;
+    } else {
+        int tile_size = fftTileSize(kernel_width, kernel_height);
+        int log2_tile = 0;
+        while ((1 << log2_tile) < tile_size) log2_tile++;
+        int block_x = tile_size - kernel_width + 1;
+        int block_y = tile_size - kernel_height + 1;
+        int tiles_x = (width + 2 * radius_x + block_x - 1) / block_x;
+        int tiles_y = (input_rows + block_y - 1) / block_y;
+        int num_tiles = tiles_x * tiles_y;
+        size_t tiles_size = static_cast<size_t>(num_tiles) * tile_size * tile_size * sizeof(cl_float2);
+        float scale = 1.0f / (static_cast<float>(tile_size) * tile_size);
+        metrics.memory_used += 2 * tiles_size + tile_size * tile_size * sizeof(cl_float2);
+
+        cl_mem spectrum = createKernelSpectrum(weights, kernel_width, kernel_height, tile_size, kernel_events);
+        work_buffers.push_back(spectrum);
+        cl_mem tiles[2];
+        for (int i = 0; i < 2; i++) {
+            tiles[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, tiles_size, NULL, &err);
+            check_error(err, "Creating FFT tiles buffer");
+            work_buffers.push_back(tiles[i]);
+        }
+
+        size_t tile_global[3] = {static_cast<size_t>(tile_size), static_cast<size_t>(tile_size),
+                                 static_cast<size_t>(num_tiles)};
+        cl_event event;
+
+        err = clSetKernelArg(fft_load_kernel, 0, sizeof(cl_mem), &input_buffer);
+        err |= clSetKernelArg(fft_load_kernel, 1, sizeof(cl_mem), &tiles[0]);
+        err |= clSetKernelArg(fft_load_kernel, 2, sizeof(int), &width);
+        err |= clSetKernelArg(fft_load_kernel, 3, sizeof(int), &input_rows);
+        err |= clSetKernelArg(fft_load_kernel, 4, sizeof(int), &tile_size);
+        err |= clSetKernelArg(fft_load_kernel, 5, sizeof(int), &log2_tile);
+        err |= clSetKernelArg(fft_load_kernel, 6, sizeof(int), &block_x);
+        err |= clSetKernelArg(fft_load_kernel, 7, sizeof(int), &block_y);
+        err |= clSetKernelArg(fft_load_kernel, 8, sizeof(int), &tiles_x);
+        err |= clSetKernelArg(fft_load_kernel, 9, sizeof(int), &radius_x);
+        err |= clSetKernelArg(fft_load_kernel, 10, sizeof(int), &mode_value);
+        err |= clSetKernelArg(fft_load_kernel, 11, sizeof(cl_uchar), &border_constant);
+        check_error(err, "Setting FFT load kernel arguments");
+        err = clEnqueueNDRangeKernel(commands, fft_load_kernel, 3, NULL, tile_global, NULL,
+                                     write_events.size(), write_events.data(), &event);
+        check_error(err, "Enqueuing FFT load kernel");
+        kernel_events.push_back(event);
+
+        enqueueFFT(tiles[0], num_tiles, tile_size, -1.0f, kernel_events);
+
+        err = clSetKernelArg(fft_multiply_kernel, 0, sizeof(cl_mem), &tiles[0]);
+        err |= clSetKernelArg(fft_multiply_kernel, 1, sizeof(cl_mem), &spectrum);
+        err |= clSetKernelArg(fft_multiply_kernel, 2, sizeof(cl_mem), &tiles[1]);
+        err |= clSetKernelArg(fft_multiply_kernel, 3, sizeof(int), &tile_size);
+        err |= clSetKernelArg(fft_multiply_kernel, 4, sizeof(int), &log2_tile);
+        err |= clSetKernelArg(fft_multiply_kernel, 5, sizeof(float), &scale);
+        check_error(err, "Setting FFT multiply kernel arguments");
+        err = clEnqueueNDRangeKernel(commands, fft_multiply_kernel, 3, NULL, tile_global, NULL,
+                                     1, &kernel_events.back(), &event);
+        check_error(err, "Enqueuing FFT multiply kernel");
+        kernel_events.push_back(event);
+
+        enqueueFFT(tiles[1], num_tiles, tile_size, 1.0f, kernel_events);
+
+        err = clSetKernelArg(fft_gather_kernel, 0, sizeof(cl_mem), &tiles[1]);
+        err |= clSetKernelArg(fft_gather_kernel, 1, sizeof(cl_mem), &output_buffer);
+        err |= clSetKernelArg(fft_gather_kernel, 2, sizeof(int), &width);
+        err |= clSetKernelArg(fft_gather_kernel, 3, sizeof(int), &rows);
+        err |= clSetKernelArg(fft_gather_kernel, 4, sizeof(int), &radius_y);
+        err |= clSetKernelArg(fft_gather_kernel, 5, sizeof(int), &tile_size);
+        err |= clSetKernelArg(fft_gather_kernel, 6, sizeof(int), &block_x);
+        err |= clSetKernelArg(fft_gather_kernel, 7, sizeof(int), &block_y);
+        err |= clSetKernelArg(fft_gather_kernel, 8, sizeof(int), &tiles_x);
+        err |= clSetKernelArg(fft_gather_kernel, 9, sizeof(int), &tiles_y);
+        err |= clSetKernelArg(fft_gather_kernel, 10, sizeof(int), &radius_x);
+        err |= clSetKernelArg(fft_gather_kernel, 11, sizeof(int), &radius_y);
+        check_error(err, "Setting FFT gather kernel arguments");
+
+        const size_t* local = localSizeFor(fft_gather_kernel);
+        size_t global_size[2];
+        global_size[0] = local ? roundUp(width, local[0]) : width;
+        global_size[1] = local ? roundUp(rows, local[1]) : rows;
+        err = clEnqueueNDRangeKernel(commands, fft_gather_kernel, 2, NULL, global_size, local,
+                                     1, &kernel_events.back(), &event);
+        check_error(err, "Enqueuing FFT gather kernel");
+        kernel_events.push_back(event);
+        last_kernel = fft_stage_kernel;
+    }
+
+    enqueueReadSlice(output_buffer, output_data, image_width, columns, start_row, rows,
+                     1, &kernel_events.back(), &read_event);
+
+    clFinish(commands);
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        metrics.memory_transfer_time += getEventExecutionTime(write_events[i]);
+    }
+    metrics.memory_transfer_time += getEventExecutionTime(read_event);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(last_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(width * rows, work_group_size);
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        clReleaseEvent(write_events[i]);
+    }
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
+    clReleaseEvent(read_event);
+    for (size_t i = 0; i < work_buffers.size(); i++) {
+        clReleaseMemObject(work_buffers[i]);
+    }
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+void GaussianBlurProcessor::enqueueFIR(cl_mem input, cl_mem output, cl_mem byte_output, cl_mem weights, int radius,
+                                       int columns, int length, int out_start, int out_rows, BorderMode mode,
+                                       cl_event wait, cl_event* event) {
+    cl_int err;
+    int mode_value = mode;
+    float constant_value = border_constant;
+
+    err = clSetKernelArg(fir_kernel, 0, sizeof(cl_mem), &input);
+    err |= clSetKernelArg(fir_kernel, 1, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(fir_kernel, 2, sizeof(cl_mem), &byte_output);
+    err |= clSetKernelArg(fir_kernel, 3, sizeof(cl_mem), &weights);
+    err |= clSetKernelArg(fir_kernel, 4, sizeof(int), &radius);
+    err |= clSetKernelArg(fir_kernel, 5, sizeof(int), &columns);
+    err |= clSetKernelArg(fir_kernel, 6, sizeof(int), &length);
+    err |= clSetKernelArg(fir_kernel, 7, sizeof(int), &out_start);
+    err |= clSetKernelArg(fir_kernel, 8, sizeof(int), &out_rows);
+    err |= clSetKernelArg(fir_kernel, 9, sizeof(int), &mode_value);
+    err |= clSetKernelArg(fir_kernel, 10, sizeof(float), &constant_value);
+    check_error(err, "Setting FIR kernel arguments");
+
+    size_t global_size = columns;
+    err = clEnqueueNDRangeKernel(commands, fir_kernel, 1, NULL, &global_size, NULL, 1, &wait, event);
+    check_error(err, "Enqueuing FIR kernel");
+}
+
+ProcessingMetrics GaussianBlurProcessor::processImageSeparable(const unsigned char* input_data,
+                                                               unsigned char* output_data,
+                                                               int image_width, int height,
+                                                               const UnsharpMask* unsharp) {
+    /*
+    Exact Gaussian of any sigma as two 1D passes of create_separable_kernel(),
+    on the transposed slice then along the columns, like the box engine. The
+    halo is the radius of the 1D kernel, copy is handled as clamp. With
+    unsharp the columns pass sharpens the uploaded slice in its store stage,
+    the blur itself never reaches global memory.
+    */
+    ProcessingMetrics metrics = {};
+    std::vector<cl_event> write_events;
+    cl_event kernel_events[4], read_event;
+    cl_int err;
+
+    int start_row, rows;
+    getSlice(height, start_row, rows);
+
+    std::vector<float> line = create_separable_kernel(sigma);
+    int radius = static_cast<int>(line.size() / 2);
+    SliceColumns columns = getSliceColumns(image_width, radius);
+    int width = columns.width;
+    int input_rows = rows + 2 * radius;
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+
+    size_t input_size = input_rows * width * sizeof(unsigned char);
+    size_t float_size = input_rows * width * sizeof(float);
+    size_t output_size = rows * width * sizeof(unsigned char);
+    metrics.memory_used = input_size + 2 * float_size + output_size + line.size() * sizeof(float);
+
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem float_buffers[2];
+    for (int i = 0; i < 2; i++) {
+        float_buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+        check_error(err, "Creating float buffer");
+    }
+    cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           line.size() * sizeof(float), line.data(), &err);
+    check_error(err, "Creating weights buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output_size, NULL, &err);
+    check_error(err, "Creating output buffer");
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> constant_row;
+    writeSliceWithHalo(input_buffer, false, input_data, image_width, columns, height, start_row, rows,
+                       radius, radius, mode, constant_row, write_events);
+
+    // Rows pass on the transposed slice (width x input_rows), columns pass writing the bytes
+    cl_mem no_buffer = NULL;
+    enqueueTranspose(transpose_uchar_kernel, input_buffer, float_buffers[0], width, input_rows,
+                     write_events.size(), write_events.data(), &kernel_events[0]);
+    enqueueFIR(float_buffers[0], float_buffers[1], no_buffer, weights_buffer, radius, input_rows, width,
+               0, 0, mode, kernel_events[0], &kernel_events[1]);
+    enqueueTranspose(transpose_float_kernel, float_buffers[1], float_buffers[0], input_rows, width,
+                     1, &kernel_events[1], &kernel_events[2]);
+    if (unsharp) {
+        int mode_value = mode;
+        float constant_value = border_constant;
+        err = clSetKernelArg(unsharp_kernel, 0, sizeof(cl_mem), &float_buffers[0]);
+        err |= clSetKernelArg(unsharp_kernel, 1, sizeof(cl_mem), &input_buffer);
+        err |= clSetKernelArg(unsharp_kernel, 2, sizeof(cl_mem), &output_buffer);
+        err |= clSetKernelArg(unsharp_kernel, 3, sizeof(cl_mem), &weights_buffer);
+        err |= clSetKernelArg(unsharp_kernel, 4, sizeof(int), &radius);
+        err |= clSetKernelArg(unsharp_kernel, 5, sizeof(int), &width);
+        err |= clSetKernelArg(unsharp_kernel, 6, sizeof(int), &input_rows);
+        err |= clSetKernelArg(unsharp_kernel, 7, sizeof(int), &radius);
+        err |= clSetKernelArg(unsharp_kernel, 8, sizeof(int), &rows);
+        err |= clSetKernelArg(unsharp_kernel, 9, sizeof(int), &mode_value);
+        err |= clSetKernelArg(unsharp_kernel, 10, sizeof(float), &constant_value);
+        err |= clSetKernelArg(unsharp_kernel, 11, sizeof(float), &unsharp->amount);
+        err |= clSetKernelArg(unsharp_kernel, 12, sizeof(float), &unsharp->threshold);
+        check_error(err, "Setting unsharp kernel arguments");
+
+        size_t global_size = width;
+        err = clEnqueueNDRangeKernel(commands, unsharp_kernel, 1, NULL, &global_size, NULL,
+                                     1, &kernel_events[2], &kernel_events[3]);
+        check_error(err, "Enqueuing unsharp kernel");
+    } else {
+        enqueueFIR(float_buffers[0], no_buffer, output_buffer, weights_buffer, radius, width, input_rows,
+                   radius, rows, mode, kernel_events[2], &kernel_events[3]);
+    }
+
+    enqueueReadSlice(output_buffer, output_data, image_width, columns, start_row, rows,
+                     1, &kernel_events[3], &read_event);
+
+    clFinish(commands);
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        metrics.memory_transfer_time += getEventExecutionTime(write_events[i]);
+    }
+    metrics.memory_transfer_time += getEventExecutionTime(read_event);
+    for (int i = 0; i < 4; i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(fir_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(width, work_group_size);
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        clReleaseEvent(write_events[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(float_buffers[0]);
+    clReleaseMemObject(float_buffers[1]);
+    clReleaseMemObject(weights_buffer);
+    clReleaseMemObject(output_buffer);
 
     return metrics;
 }
 
+std::vector<BlurRegion> GaussianBlurProcessor::maskRegions(const unsigned char* mask, int width, int height){
+    /*
+    Cover the non-zero pixels of the mask with REGION_MASK_BLOCK blocks, the
+    neighbouring blocks of a row of blocks being merged in one region.
+    */
+    std::vector<BlurRegion> regions;
+    for (int by = 0; by < height; by += REGION_MASK_BLOCK) {
+        int block_height = std::min(REGION_MASK_BLOCK, height - by);
+        int run_start = -1;
+        // One block past the last one closes the run reaching the right edge
+        for (int bx = 0; bx < width + REGION_MASK_BLOCK; bx += REGION_MASK_BLOCK) {
+            bool used = false;
+            for (int y = by; y < by + block_height && !used && bx < width; y++) {
+                const unsigned char* row = mask + static_cast<size_t>(y) * width;
+                for (int x = bx; x < std::min(bx + REGION_MASK_BLOCK, width); x++) {
+                    if (row[x]) {
+                        used = true;
+                        break;
+                    }
+                }
+            }
+            if (used && run_start < 0) run_start = bx;
+            if (!used && run_start >= 0) {
+                BlurRegion region = {run_start, by, std::min(bx, width) - run_start, block_height};
+                regions.push_back(region);
+                run_start = -1;
+            }
+        }
+    }
+    return regions;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processRegions(const unsigned char* input_data, unsigned char* output_data,
+                                                        int width, int height, const std::vector<BlurRegion>& regions){
+    return blurRegions(input_data, output_data, width, height, regions, NULL);
+}
+
+ProcessingMetrics GaussianBlurProcessor::processMask(const unsigned char* input_data, unsigned char* output_data,
+                                                     int width, int height, const unsigned char* mask){
+    // Only the pixels of the mask are replaced, the blocks around them only bound the work
+    return blurRegions(input_data, output_data, width, height, maskRegions(mask, width, height), mask);
+}
+
+ProcessingMetrics GaussianBlurProcessor::blurRegions(const unsigned char* input_data, unsigned char* output_data,
+                                                     int width, int height, const std::vector<BlurRegion>& regions,
+                                                     const unsigned char* mask){
+    /*
+    Gaussian blur (create_separable_kernel() weights, whatever the algorithm)
+    of some rectangles of the image. The host packs each region with its halo,
+    synthesizing the pixels outside the image following the border mode (copy
+    as clamp), so only the regions cross the bus. Two launches, rows then
+    columns, process all the regions at once; their results are composited
+    into output_data, entirely or where mask is set. The rest of output_data
+    is a copy of the input (nothing to do when blurring in place).
+    */
+    ProcessingMetrics metrics = {};
+    metrics.algorithm = BLUR_SEPARABLE;
+    if (output_data != input_data) {
+        std::copy(input_data, input_data + static_cast<size_t>(width) * height, output_data);
+    }
+
+    std::vector<float> line = create_separable_kernel(sigma);
+    int radius = static_cast<int>(line.size() / 2);
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+
+    // Regions clipped to the image and their offsets in the packed buffers
+    std::vector<BlurRegion> clipped;
+    for (size_t i = 0; i < regions.size(); i++) {
+        BlurRegion region;
+        region.x = std::max(regions[i].x, 0);
+        region.y = std::max(regions[i].y, 0);
+        region.width = std::min(regions[i].x + regions[i].width, width) - region.x;
+        region.height = std::min(regions[i].y + regions[i].height, height) - region.y;
+        if (region.width > 0 && region.height > 0) clipped.push_back(region);
+    }
+    if (clipped.empty()) return metrics;
+
+    int num_regions = static_cast<int>(clipped.size());
+    std::vector<int> table(num_regions * REGION_FIELDS);
+    long patch_total = 0, rows_total = 0, output_total = 0;
+    for (int i = 0; i < num_regions; i++) {
+        int* fields = table.data() + i * REGION_FIELDS;
+        fields[0] = static_cast<int>(patch_total);
+        fields[1] = static_cast<int>(rows_total);
+        fields[2] = static_cast<int>(output_total);
+        fields[3] = clipped[i].width;
+        fields[4] = clipped[i].height;
+        long padded_rows = clipped[i].height + 2 * radius;
+        patch_total += (clipped[i].width + 2 * radius) * padded_rows;
+        rows_total += clipped[i].width * padded_rows;
+        output_total += static_cast<long>(clipped[i].width) * clipped[i].height;
+    }
+    if (patch_total > 0x7fffffff || rows_total > 0x7fffffff) {
+        fprintf(stderr, "Regions too large for one batch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> patches(patch_total);
+    for (int i = 0; i < num_regions; i++) {
+        const BlurRegion& region = clipped[i];
+        int patch_width = region.width + 2 * radius;
+        int first_column = region.x - radius;
+        int inside_first = std::max(first_column, 0);
+        int inside_last = std::min(region.x + region.width + radius, width);
+        unsigned char* patch = patches.data() + table[i * REGION_FIELDS];
+
+        for (int py = 0; py < region.height + 2 * radius; py++) {
+            unsigned char* dst = patch + static_cast<size_t>(py) * patch_width;
+            int src_y = remapCoordinate(region.y - radius + py, height, mode);
+            if (src_y < 0) {
+                std::fill(dst, dst + patch_width, border_constant);
+                continue;
+            }
+            const unsigned char* src = input_data + static_cast<size_t>(src_y) * width;
+            std::copy(src + inside_first, src + inside_last, dst + (inside_first - first_column));
+            for (int px = 0; px < patch_width; px++) {
+                int x = first_column + px;
+                if (x >= inside_first && x < inside_last) continue;
+                int src_x = remapCoordinate(x, width, mode);
+                dst[px] = (src_x < 0) ? border_constant : src[src_x];
+            }
+        }
+    }
+
+    cl_int err;
+    cl_event write_event, kernel_events[2], read_event;
+    cl_mem patch_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, patches.size(), NULL, &err);
+    check_error(err, "Creating patch buffer");
+    cl_mem table_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                         table.size() * sizeof(int), table.data(), &err);
+    check_error(err, "Creating region table buffer");
+    cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           line.size() * sizeof(float), line.data(), &err);
+    check_error(err, "Creating weights buffer");
+    cl_mem rows_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, rows_total * sizeof(float), NULL, &err);
+    check_error(err, "Creating region rows buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output_total, NULL, &err);
+    check_error(err, "Creating output buffer");
+    metrics.memory_used = patches.size() + table.size() * sizeof(int) + line.size() * sizeof(float) +
+                          rows_total * sizeof(float) + output_total;
+
+    err = clEnqueueWriteBuffer(commands, patch_buffer, CL_FALSE, 0, patches.size(), patches.data(),
+                               0, NULL, &write_event);
+    check_error(err, "Writing patch buffer");
+
+    cl_kernel passes[2] = {region_rows_kernel, region_columns_kernel};
+    cl_mem pass_input[2] = {patch_buffer, rows_buffer};
+    cl_mem pass_output[2] = {rows_buffer, output_buffer};
+    int pass_total[2] = {static_cast<int>(rows_total), static_cast<int>(output_total)};
+    for (int p = 0; p < 2; p++) {
+        err = clSetKernelArg(passes[p], 0, sizeof(cl_mem), &pass_input[p]);
+        err |= clSetKernelArg(passes[p], 1, sizeof(cl_mem), &pass_output[p]);
+        err |= clSetKernelArg(passes[p], 2, sizeof(cl_mem), &table_buffer);
+        err |= clSetKernelArg(passes[p], 3, sizeof(cl_mem), &weights_buffer);
+        err |= clSetKernelArg(passes[p], 4, sizeof(int), &radius);
+        err |= clSetKernelArg(passes[p], 5, sizeof(int), &num_regions);
+        err |= clSetKernelArg(passes[p], 6, sizeof(int), &pass_total[p]);
+        check_error(err, "Setting region kernel arguments");
+
+        size_t global_size = pass_total[p];
+        cl_event wait = (p == 0) ? write_event : kernel_events[0];
+        err = clEnqueueNDRangeKernel(commands, passes[p], 1, NULL, &global_size, NULL, 1, &wait, &kernel_events[p]);
+        check_error(err, "Enqueuing region kernel");
+    }
+
+    std::vector<unsigned char> blurred(output_total);
+    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, output_total, blurred.data(),
+                              1, &kernel_events[1], &read_event);
+    check_error(err, "Reading output buffer");
+
+    for (int i = 0; i < num_regions; i++) {
+        const BlurRegion& region = clipped[i];
+        const unsigned char* src = blurred.data() + table[i * REGION_FIELDS + 2];
+        for (int y = 0; y < region.height; y++, src += region.width) {
+            size_t offset = static_cast<size_t>(region.y + y) * width + region.x;
+            if (!mask) {
+                std::copy(src, src + region.width, output_data + offset);
+                continue;
+            }
+            for (int x = 0; x < region.width; x++) {
+                if (mask[offset + x]) output_data[offset + x] = src[x];
+            }
+        }
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
 
+    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(read_event);
+    metrics.kernel_execution_time = getEventExecutionTime(kernel_events[0]) + getEventExecutionTime(kernel_events[1]);
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
 
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(region_columns_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(output_total, work_group_size);
 
+    clReleaseEvent(write_event);
+    clReleaseEvent(kernel_events[0]);
+    clReleaseEvent(kernel_events[1]);
+    clReleaseEvent(read_event);
+    clReleaseMemObject(patch_buffer);
+    clReleaseMemObject(table_buffer);
+    clReleaseMemObject(weights_buffer);
+    clReleaseMemObject(rows_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processBatch(const std::vector<BatchImage>& images){
+    /*
+    Direct blur (DIM x DIM matrix, border mode included) of whole images of
+    mixed sizes with one transfer each way and one launch: the images are
+    packed in one buffer and the work-groups are dealt to them through a
+    table of offsets and sizes (see gaussian_blur_batch).
+    */
+    ProcessingMetrics metrics = {};
+    metrics.algorithm = BLUR_DIRECT;
+    int num_images = static_cast<int>(images.size());
+    if (num_images == 0) return metrics;
+
+    size_t kernel_max;
+    clGetKernelWorkGroupInfo(batch_kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_max), &kernel_max, NULL);
+    size_t group_size = std::min(static_cast<size_t>(BATCH_GROUP_SIZE), kernel_max);
+
+    std::vector<int> table(num_images * BATCH_FIELDS);
+    long total_pixels = 0, total_groups = 0;
+    for (int i = 0; i < num_images; i++) {
+        long pixels = static_cast<long>(images[i].width) * images[i].height;
+        int* fields = table.data() + i * BATCH_FIELDS;
+        fields[0] = static_cast<int>(total_pixels);
+        fields[1] = images[i].width;
+        fields[2] = images[i].height;
+        fields[3] = static_cast<int>(total_groups);
+        total_pixels += pixels;
+        total_groups += (pixels + group_size - 1) / group_size;
+    }
+    if (total_pixels == 0) return metrics;     // only empty images, nothing to allocate
+    if (total_pixels > 0x7fffffff) {
+        fprintf(stderr, "Batch too large for one launch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> packed(total_pixels);
+    for (int i = 0; i < num_images; i++) {
+        std::copy(images[i].input, images[i].input + static_cast<size_t>(images[i].width) * images[i].height,
+                  packed.data() + table[i * BATCH_FIELDS]);
+    }
+
+    cl_int err;
+    cl_event write_event, kernel_event, read_event;
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, packed.size(), NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, packed.size(), NULL, &err);
+    check_error(err, "Creating output buffer");
+    cl_mem kernel_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                          gaussian_kernel.size() * sizeof(float), gaussian_kernel.data(), &err);
+    check_error(err, "Creating kernel buffer");
+    cl_mem table_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                         table.size() * sizeof(int), table.data(), &err);
+    check_error(err, "Creating batch table buffer");
+    metrics.memory_used = 2 * packed.size() + gaussian_kernel.size() * sizeof(float) + table.size() * sizeof(int);
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, packed.size(), packed.data(),
+                               0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+
+    int mode_value = border_mode;
+    err = clSetKernelArg(batch_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(batch_kernel, 1, sizeof(cl_mem), &output_buffer);
+    err |= clSetKernelArg(batch_kernel, 2, sizeof(cl_mem), &kernel_buffer);
+    err |= clSetKernelArg(batch_kernel, 3, sizeof(cl_mem), &table_buffer);
+    err |= clSetKernelArg(batch_kernel, 4, sizeof(int), &num_images);
+    err |= clSetKernelArg(batch_kernel, 5, sizeof(int), &mode_value);
+    err |= clSetKernelArg(batch_kernel, 6, sizeof(cl_uchar), &border_constant);
+    check_error(err, "Setting batch kernel arguments");
+
+    size_t global_size = total_groups * group_size;
+    err = clEnqueueNDRangeKernel(commands, batch_kernel, 1, NULL, &global_size, &group_size,
+                                 1, &write_event, &kernel_event);
+    check_error(err, "Enqueuing batch kernel");
+
+    // The packed input is not needed anymore, the results come back in its place
+    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, packed.size(), packed.data(),
+                              1, &kernel_event, &read_event);
+    check_error(err, "Reading output buffer");
+
+    for (int i = 0; i < num_images; i++) {
+        const unsigned char* src = packed.data() + table[i * BATCH_FIELDS];
+        std::copy(src, src + static_cast<size_t>(images[i].width) * images[i].height, images[i].output);
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(read_event);
+    metrics.kernel_execution_time = getEventExecutionTime(kernel_event);
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+    metrics.gpu_occupancy = calculateGPUOccupancy(global_size, group_size);
+
+    clReleaseEvent(write_event);
+    clReleaseEvent(kernel_event);
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(output_buffer);
+    clReleaseMemObject(kernel_buffer);
+    clReleaseMemObject(table_buffer);
+
+    return metrics;
+}
+
+const float* GaussianBlurProcessor::pyramidWeights(){
+    // Same weights as pyramid_weights in gaussian_kernel.cl, exact in float
+    static const float weights[PYRAMID_TAPS] = {0.0625f, 0.25f, 0.375f, 0.25f, 0.0625f};
+    return weights;
+}
+
+std::vector<PyramidLevel> GaussianBlurProcessor::pyramidLayout(int width, int height, int num_levels){
+    // Level 0 is the image, each level halves the previous one (rounded up) until 1 x 1
+    if (num_levels < 1) {
+        fprintf(stderr, "A pyramid needs at least one level\n");
+        exit(EXIT_FAILURE);
+    }
+    std::vector<PyramidLevel> levels;
+    size_t offset = 0;
+    for (int l = 0; l < num_levels; l++) {
+        PyramidLevel level = {offset, width, height};
+        levels.push_back(level);
+        offset += static_cast<size_t>(width) * height;
+        if (width == 1 && height == 1) break;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    return levels;
+}
+
+ProcessingMetrics GaussianBlurProcessor::buildPyramid(const unsigned char* input_data, int width, int height,
+                                                      int num_levels, std::vector<unsigned char>& pyramid,
+                                                      std::vector<PyramidLevel>& levels){
+    /*
+    The image is uploaded once in a buffer holding every level, each level is
+    computed from the previous one on the device by pyramid_reduce, and all
+    the new levels come back in a single read. Copy is handled as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    levels = pyramidLayout(width, height, num_levels);
+    const PyramidLevel& last = levels.back();
+    size_t total = last.offset + static_cast<size_t>(last.width) * last.height;
+    size_t base = static_cast<size_t>(width) * height;
+    pyramid.resize(total);
+    if (total > 0x7fffffff) {
+        fprintf(stderr, "Image too large for the pyramid engine\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int mode_value = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    int num_kernels = static_cast<int>(levels.size()) - 1;
+    std::vector<cl_event> kernel_events(num_kernels);
+    cl_event write_event, read_event = NULL;
+    cl_int err;
+
+    cl_mem pyramid_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, total, NULL, &err);
+    check_error(err, "Creating pyramid buffer");
+    metrics.memory_used = total;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, pyramid_buffer, CL_FALSE, 0, base, input_data, 0, NULL, &write_event);
+    check_error(err, "Writing pyramid buffer");
+
+    const size_t* local = localSizeFor(pyramid_kernel);
+    for (int l = 0; l < num_kernels; l++) {
+        const PyramidLevel& src = levels[l];
+        const PyramidLevel& dst = levels[l + 1];
+        int src_offset = static_cast<int>(src.offset);
+        int dst_offset = static_cast<int>(dst.offset);
+
+        err = clSetKernelArg(pyramid_kernel, 0, sizeof(cl_mem), &pyramid_buffer);
+        err |= clSetKernelArg(pyramid_kernel, 1, sizeof(int), &src_offset);
+        err |= clSetKernelArg(pyramid_kernel, 2, sizeof(int), &src.width);
+        err |= clSetKernelArg(pyramid_kernel, 3, sizeof(int), &src.height);
+        err |= clSetKernelArg(pyramid_kernel, 4, sizeof(int), &dst_offset);
+        err |= clSetKernelArg(pyramid_kernel, 5, sizeof(int), &dst.width);
+        err |= clSetKernelArg(pyramid_kernel, 6, sizeof(int), &dst.height);
+        err |= clSetKernelArg(pyramid_kernel, 7, sizeof(int), &mode_value);
+        err |= clSetKernelArg(pyramid_kernel, 8, sizeof(cl_uchar), &border_constant);
+        check_error(err, "Setting pyramid kernel arguments");
+
+        size_t global_size[2];
+        global_size[0] = local ? roundUp(dst.width, local[0]) : dst.width;
+        global_size[1] = local ? roundUp(dst.height, local[1]) : dst.height;
+        cl_event wait = (l == 0) ? write_event : kernel_events[l - 1];
+        err = clEnqueueNDRangeKernel(commands, pyramid_kernel, 2, NULL, global_size, local,
+                                     1, &wait, &kernel_events[l]);
+        check_error(err, "Enqueuing pyramid kernel");
+    }
+
+    std::copy(input_data, input_data + base, pyramid.data());
+    if (num_kernels > 0) {
+        err = clEnqueueReadBuffer(commands, pyramid_buffer, CL_TRUE, base, total - base, pyramid.data() + base,
+                                  1, &kernel_events[num_kernels - 1], &read_event);
+        check_error(err, "Reading pyramid buffer");
+    }
+    clFinish(commands);
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event);
+    if (read_event) metrics.memory_transfer_time += getEventExecutionTime(read_event);
+    for (int l = 0; l < num_kernels; l++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[l]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+    if (num_kernels > 0) {
+        metrics.gpu_occupancy = calculateGPUOccupancy(static_cast<size_t>(levels[1].width) * levels[1].height,
+                                                      local_size[0] * local_size[1]);
+    }
+
+    clReleaseEvent(write_event);
+    for (int l = 0; l < num_kernels; l++) {
+        clReleaseEvent(kernel_events[l]);
+    }
+    if (read_event) clReleaseEvent(read_event);
+    clReleaseMemObject(pyramid_buffer);
+
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processScaleSpace(const unsigned char* input_data, int width, int height,
+                                                           const std::vector<double>& sigmas,
+                                                           std::vector<unsigned char>& levels,
+                                                           std::vector<float>* dog){
+    /*
+    The image blurred at every sigma (increasing), stored one after the other
+    in levels, and optionally the sigmas.size() - 1 difference of Gaussians
+    planes (level i + 1 - level i) in dog. The image is uploaded once; level
+    i + 1 is level i blurred by the differential sigma
+    sqrt(sigma[i + 1]^2 - sigma[i]^2) with the separable engine, the levels
+    staying in float on the device. Everything comes back in one read per
+    output. Copy is handled as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    metrics.algorithm = BLUR_SEPARABLE;
+    int num_levels = static_cast<int>(sigmas.size());
+    for (int i = 0; i < num_levels; i++) {
+        if (sigmas[i] <= 0 || (i > 0 && sigmas[i] <= sigmas[i - 1])) {
+            fprintf(stderr, "Scale-space sigmas must be positive and increasing\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_levels == 0) return metrics;
+
+    // scale_space_outputs indexes every level and DoG plane with an int, the DoG planes being one fewer
+    size_t bytes_size = static_cast<size_t>(width) * height * num_levels;
+    if (bytes_size > 0x7fffffff) {
+        fprintf(stderr, "Image too large for the scale-space engine\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int pixels = width * height;
+    bool with_dog = (dog != NULL) && num_levels > 1;
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    size_t float_size = static_cast<size_t>(pixels) * sizeof(float);
+    size_t dog_size = with_dog ? float_size * (num_levels - 1) : 0;
+    levels.resize(bytes_size);
+    if (dog) dog->resize(dog_size / sizeof(float));
+
+    cl_int err;
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating input buffer");
+    // work[0], work[1]: transposed passes, work[2], work[3]: previous and current level
+    cl_mem work[4];
+    for (int i = 0; i < 4; i++) {
+        work[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+        check_error(err, "Creating scale-space buffer");
+    }
+    cl_mem bytes_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, bytes_size, NULL, &err);
+    check_error(err, "Creating scale-space output buffer");
+    cl_mem dog_buffer = NULL;
+    if (with_dog) {
+        dog_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, dog_size, NULL, &err);
+        check_error(err, "Creating DoG buffer");
+    }
+    metrics.memory_used = pixels + 4 * float_size + bytes_size + dog_size;
+
+    std::vector<cl_mem> weight_buffers;
+    std::vector<cl_event> kernel_events;
+    cl_event write_event, event;
+    cl_event read_events[2] = {NULL, NULL};
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, pixels, input_data, 0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+
+    cl_mem no_buffer = NULL;
+    cl_event last = write_event;
+    for (int i = 0; i < num_levels; i++) {
+        double previous_sigma = (i == 0) ? 0.0 : sigmas[i - 1];
+        std::vector<float> line = create_separable_kernel(sqrt(sigmas[i] * sigmas[i] - previous_sigma * previous_sigma));
+        int radius = static_cast<int>(line.size() / 2);
+        cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                               line.size() * sizeof(float), line.data(), &err);
+        check_error(err, "Creating weights buffer");
+        weight_buffers.push_back(weights_buffer);
+
+        // Rows pass on the transposed level, columns pass into the current level
+        if (i == 0) {
+            enqueueTranspose(transpose_uchar_kernel, input_buffer, work[0], width, height, 1, &last, &event);
+        } else {
+            enqueueTranspose(transpose_float_kernel, work[2], work[0], width, height, 1, &last, &event);
+        }
+        kernel_events.push_back(event);
+        enqueueFIR(work[0], work[1], no_buffer, weights_buffer, radius, height, width, 0, 0, mode, event, &event);
+        kernel_events.push_back(event);
+        cl_event rows_done = event;
+        enqueueTranspose(transpose_float_kernel, work[1], work[0], height, width, 1, &rows_done, &event);
+        kernel_events.push_back(event);
+        enqueueFIR(work[0], work[3], no_buffer, weights_buffer, radius, width, height, 0, 0, mode, event, &event);
+        kernel_events.push_back(event);
+
+        int byte_offset = i * pixels;
+        int dog_offset = (with_dog && i > 0) ? (i - 1) * pixels : -1;
+        err = clSetKernelArg(scale_space_kernel, 0, sizeof(cl_mem), &work[3]);
+        err |= clSetKernelArg(scale_space_kernel, 1, sizeof(cl_mem), &work[2]);
+        err |= clSetKernelArg(scale_space_kernel, 2, sizeof(cl_mem), &bytes_buffer);
+        err |= clSetKernelArg(scale_space_kernel, 3, sizeof(cl_mem), with_dog ? &dog_buffer : &no_buffer);
+        err |= clSetKernelArg(scale_space_kernel, 4, sizeof(int), &pixels);
+        err |= clSetKernelArg(scale_space_kernel, 5, sizeof(int), &byte_offset);
+        err |= clSetKernelArg(scale_space_kernel, 6, sizeof(int), &dog_offset);
+        check_error(err, "Setting scale-space kernel arguments");
+        size_t global_size = pixels;
+        err = clEnqueueNDRangeKernel(commands, scale_space_kernel, 1, NULL, &global_size, NULL, 1, &event, &last);
+        check_error(err, "Enqueuing scale-space kernel");
+        kernel_events.push_back(last);
+
+        // The current level becomes the previous one
+        std::swap(work[2], work[3]);
+    }
+
+    err = clEnqueueReadBuffer(commands, bytes_buffer, CL_FALSE, 0, bytes_size, levels.data(), 1, &last, &read_events[0]);
+    check_error(err, "Reading scale-space levels");
+    if (with_dog) {
+        err = clEnqueueReadBuffer(commands, dog_buffer, CL_FALSE, 0, dog_size, dog->data(), 1, &last, &read_events[1]);
+        check_error(err, "Reading DoG planes");
+    }
+    clFinish(commands);
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(read_events[0]);
+    if (read_events[1]) metrics.memory_transfer_time += getEventExecutionTime(read_events[1]);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(fir_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(width, work_group_size);
+
+    clReleaseEvent(write_event);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (read_events[i]) clReleaseEvent(read_events[i]);
+    }
+    for (size_t i = 0; i < weight_buffers.size(); i++) {
+        clReleaseMemObject(weight_buffers[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        clReleaseMemObject(work[i]);
+    }
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(bytes_buffer);
+    if (dog_buffer) clReleaseMemObject(dog_buffer);
+
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::detectEdges(const unsigned char* input_data, unsigned char* output_data,
+                                                     int width, int height, float low_threshold,
+                                                     float high_threshold){
+    /*
+    Canny edges (255 on the edges, 0 elsewhere) of the image blurred at the
+    current sigma. The rows pass is the separable engine's, the columns pass
+    computes the Sobel gradient in its store (fir_sobel_columns), then the
+    suppression and hysteresis kernels of gaussian_kernel.cl run: the image
+    is uploaded once and only the edges come back. The hysteresis runs
+    HYSTERESIS_BATCH steps between two reads of the change flag. Copy is
+    handled as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    metrics.algorithm = BLUR_SEPARABLE;
+    int pixels = width * height;
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    int mode_value = mode;
+    float constant_value = border_constant;
+    size_t float_size = static_cast<size_t>(pixels) * sizeof(float);
+
+    std::vector<float> line = create_separable_kernel(sigma);
+    int radius = static_cast<int>(line.size() / 2);
+
+    cl_int err;
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating input buffer");
+    // work[0], work[1]: rows pass, then work[1] holds the magnitude
+    cl_mem work[2];
+    for (int i = 0; i < 2; i++) {
+        work[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+        check_error(err, "Creating edge buffer");
+    }
+    cl_mem direction_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, pixels, NULL, &err);
+    check_error(err, "Creating direction buffer");
+    cl_mem edges_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, pixels, NULL, &err);
+    check_error(err, "Creating edges buffer");
+    cl_mem changed_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, &err);
+    check_error(err, "Creating change flag buffer");
+    cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           line.size() * sizeof(float), line.data(), &err);
+    check_error(err, "Creating weights buffer");
+    metrics.memory_used = 3 * pixels + 2 * float_size + line.size() * sizeof(float);
+
+    std::vector<cl_event> kernel_events;
+    std::vector<cl_event> transfer_events;
+    cl_event event;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, pixels, input_data, 0, NULL, &event);
+    check_error(err, "Writing input buffer");
+    transfer_events.push_back(event);
+
+    // Rows pass in work[0], in the image layout
+    cl_event last = event;
+    cl_mem no_buffer = NULL;
+    enqueueTranspose(transpose_uchar_kernel, input_buffer, work[0], width, height, 1, &last, &event);
+    kernel_events.push_back(event);
+    enqueueFIR(work[0], work[1], no_buffer, weights_buffer, radius, height, width, 0, 0, mode, event, &event);
+    kernel_events.push_back(event);
+    last = event;
+    enqueueTranspose(transpose_float_kernel, work[1], work[0], height, width, 1, &last, &event);
+    kernel_events.push_back(event);
+    last = event;
+
+    // Columns pass and gradient into work[1] and direction_buffer
+    err = clSetKernelArg(fir_sobel_kernel, 0, sizeof(cl_mem), &work[0]);
+    err |= clSetKernelArg(fir_sobel_kernel, 1, sizeof(cl_mem), &work[1]);
+    err |= clSetKernelArg(fir_sobel_kernel, 2, sizeof(cl_mem), &direction_buffer);
+    err |= clSetKernelArg(fir_sobel_kernel, 3, sizeof(cl_mem), &weights_buffer);
+    err |= clSetKernelArg(fir_sobel_kernel, 4, sizeof(int), &radius);
+    err |= clSetKernelArg(fir_sobel_kernel, 5, sizeof(int), &width);
+    err |= clSetKernelArg(fir_sobel_kernel, 6, sizeof(int), &height);
+    err |= clSetKernelArg(fir_sobel_kernel, 7, sizeof(int), &mode_value);
+    err |= clSetKernelArg(fir_sobel_kernel, 8, sizeof(float), &constant_value);
+    check_error(err, "Setting FIR Sobel kernel arguments");
+    size_t columns_size = width;
+    err = clEnqueueNDRangeKernel(commands, fir_sobel_kernel, 1, NULL, &columns_size, NULL, 1, &last, &event);
+    check_error(err, "Enqueuing FIR Sobel kernel");
+    kernel_events.push_back(event);
+    last = event;
+
+    size_t global_size[2] = {static_cast<size_t>(width), static_cast<size_t>(height)};
+
+    err = clSetKernelArg(canny_suppress_kernel, 0, sizeof(cl_mem), &work[1]);
+    err |= clSetKernelArg(canny_suppress_kernel, 1, sizeof(cl_mem), &direction_buffer);
+    err |= clSetKernelArg(canny_suppress_kernel, 2, sizeof(cl_mem), &edges_buffer);
+    err |= clSetKernelArg(canny_suppress_kernel, 3, sizeof(int), &width);
+    err |= clSetKernelArg(canny_suppress_kernel, 4, sizeof(int), &height);
+    err |= clSetKernelArg(canny_suppress_kernel, 5, sizeof(float), &low_threshold);
+    err |= clSetKernelArg(canny_suppress_kernel, 6, sizeof(float), &high_threshold);
+    check_error(err, "Setting suppression kernel arguments");
+    err = clEnqueueNDRangeKernel(commands, canny_suppress_kernel, 2, NULL, global_size, NULL, 1, &last, &event);
+    check_error(err, "Enqueuing suppression kernel");
+    kernel_events.push_back(event);
+    last = event;
+
+    err = clSetKernelArg(canny_hysteresis_kernel, 0, sizeof(cl_mem), &edges_buffer);
+    err |= clSetKernelArg(canny_hysteresis_kernel, 1, sizeof(int), &width);
+    err |= clSetKernelArg(canny_hysteresis_kernel, 2, sizeof(int), &height);
+    err |= clSetKernelArg(canny_hysteresis_kernel, 3, sizeof(cl_mem), &changed_buffer);
+    check_error(err, "Setting hysteresis kernel arguments");
+
+    cl_int changed = 1;
+    const cl_int zero = 0;
+    while (changed) {
+        err = clEnqueueWriteBuffer(commands, changed_buffer, CL_FALSE, 0, sizeof(cl_int), &zero, 1, &last, &event);
+        check_error(err, "Writing change flag");
+        transfer_events.push_back(event);
+        for (int i = 0; i < HYSTERESIS_BATCH; i++) {
+            cl_event previous = event;
+            err = clEnqueueNDRangeKernel(commands, canny_hysteresis_kernel, 2, NULL, global_size, NULL,
+                                         1, &previous, &event);
+            check_error(err, "Enqueuing hysteresis kernel");
+            kernel_events.push_back(event);
+        }
+        last = event;
+        err = clEnqueueReadBuffer(commands, changed_buffer, CL_TRUE, 0, sizeof(cl_int), &changed, 1, &last, &event);
+        check_error(err, "Reading change flag");
+        transfer_events.push_back(event);
+    }
+
+    err = clSetKernelArg(canny_finish_kernel, 0, sizeof(cl_mem), &edges_buffer);
+    err |= clSetKernelArg(canny_finish_kernel, 1, sizeof(int), &pixels);
+    check_error(err, "Setting edge kernel arguments");
+    size_t finish_size = pixels;
+    err = clEnqueueNDRangeKernel(commands, canny_finish_kernel, 1, NULL, &finish_size, NULL, 1, &last, &event);
+    check_error(err, "Enqueuing edge kernel");
+    kernel_events.push_back(event);
+    last = event;
+
+    err = clEnqueueReadBuffer(commands, edges_buffer, CL_TRUE, 0, pixels, output_data, 1, &last, &event);
+    check_error(err, "Reading edges");
+    transfer_events.push_back(event);
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < transfer_events.size(); i++) {
+        metrics.memory_transfer_time += getEventExecutionTime(transfer_events[i]);
+        clReleaseEvent(transfer_events[i]);
+    }
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+        clReleaseEvent(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(canny_suppress_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(pixels, work_group_size);
+
+    for (int i = 0; i < 2; i++) {
+        clReleaseMemObject(work[i]);
+    }
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(direction_buffer);
+    clReleaseMemObject(edges_buffer);
+    clReleaseMemObject(changed_buffer);
+    clReleaseMemObject(weights_buffer);
+
+    return metrics;
+}
+
+BilateralGrid GaussianBlurProcessor::bilateralGrid(int width, int height, double spatial_sigma, double range_sigma){
+    // Pixels round to the nearest cell; the cells read by the trilinear slicing
+    // go one past the last one, the BILATERAL_GRID_SIGMA blur adds its radius
+    BilateralGrid grid;
+    spatial_sigma = std::max(spatial_sigma, 1.0);
+    range_sigma = std::max(range_sigma, 1.0);
+    grid.padding = static_cast<int>(create_separable_kernel(BILATERAL_GRID_SIGMA).size() / 2) + 1;
+    grid.spatial_scale = static_cast<float>(1.0 / spatial_sigma);
+    grid.range_scale = static_cast<float>(1.0 / range_sigma);
+    grid.width = static_cast<int>((width - 1) * grid.spatial_scale + 0.5f) + 1 + 2 * grid.padding;
+    grid.height = static_cast<int>((height - 1) * grid.spatial_scale + 0.5f) + 1 + 2 * grid.padding;
+    grid.depth = static_cast<int>(255 * grid.range_scale + 0.5f) + 1 + 2 * grid.padding;
+    return grid;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processBilateral(const unsigned char* input_data, unsigned char* output_data,
+                                                          int width, int height, double spatial_sigma,
+                                                          double range_sigma){
+    /*
+    Edge-preserving smoothing: splat the pixels in a bilateral grid, blur
+    the grid along its three axes with the separable engine (FIR pass,
+    transpose, FIR pass, transpose, FIR pass) and slice it. The cost is the
+    one of the grid, (width / spatial_sigma) * (height / spatial_sigma) *
+    (256 / range_sigma) cells, whatever the spatial sigma.
+    */
+    ProcessingMetrics metrics = {};
+    metrics.algorithm = BLUR_SEPARABLE;
+    BilateralGrid grid = bilateralGrid(width, height, spatial_sigma, range_sigma);
+    int pixels = width * height;
+    int plane = grid.width * grid.height;
+    size_t grid_size = static_cast<size_t>(2) * plane * grid.depth * sizeof(float);
+
+    std::vector<float> line = create_separable_kernel(BILATERAL_GRID_SIGMA);
+    int radius = static_cast<int>(line.size() / 2);
+
+    cl_int err;
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem grid_buffers[2];
+    for (int i = 0; i < 2; i++) {
+        grid_buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, grid_size, NULL, &err);
+        check_error(err, "Creating grid buffer");
+    }
+    cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           line.size() * sizeof(float), line.data(), &err);
+    check_error(err, "Creating weights buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating output buffer");
+    metrics.memory_used = 2 * pixels + 2 * grid_size + line.size() * sizeof(float);
+
+    cl_event write_event, read_event;
+    cl_event kernel_events[7];
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, pixels, input_data, 0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+
+    size_t grid_global[2] = {static_cast<size_t>(grid.width), static_cast<size_t>(grid.height)};
+    err = clSetKernelArg(bilateral_splat_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(bilateral_splat_kernel, 1, sizeof(cl_mem), &grid_buffers[0]);
+    err |= clSetKernelArg(bilateral_splat_kernel, 2, sizeof(int), &width);
+    err |= clSetKernelArg(bilateral_splat_kernel, 3, sizeof(int), &height);
+    err |= clSetKernelArg(bilateral_splat_kernel, 4, sizeof(float), &grid.spatial_scale);
+    err |= clSetKernelArg(bilateral_splat_kernel, 5, sizeof(float), &grid.range_scale);
+    err |= clSetKernelArg(bilateral_splat_kernel, 6, sizeof(int), &grid.width);
+    err |= clSetKernelArg(bilateral_splat_kernel, 7, sizeof(int), &grid.height);
+    err |= clSetKernelArg(bilateral_splat_kernel, 8, sizeof(int), &grid.depth);
+    err |= clSetKernelArg(bilateral_splat_kernel, 9, sizeof(int), &grid.padding);
+    check_error(err, "Setting splat kernel arguments");
+    err = clEnqueueNDRangeKernel(commands, bilateral_splat_kernel, 2, NULL, grid_global, NULL,
+                                 1, &write_event, &kernel_events[0]);
+    check_error(err, "Enqueuing splat kernel");
+
+    // [z][c][y][x] -> along z -> [x][z][c][y] -> along x -> [y][x][z][c] -> along y.
+    // The padding keeps every tap inside the grid, the border mode does not matter.
+    cl_mem no_buffer = NULL;
+    enqueueFIR(grid_buffers[0], grid_buffers[1], no_buffer, weights_buffer, radius, 2 * plane, grid.depth,
+               0, 0, BORDER_CLAMP, kernel_events[0], &kernel_events[1]);
+    enqueueTranspose(transpose_float_kernel, grid_buffers[1], grid_buffers[0], grid.width,
+                     grid.depth * 2 * grid.height, 1, &kernel_events[1], &kernel_events[2]);
+    enqueueFIR(grid_buffers[0], grid_buffers[1], no_buffer, weights_buffer, radius, grid.depth * 2 * grid.height,
+               grid.width, 0, 0, BORDER_CLAMP, kernel_events[2], &kernel_events[3]);
+    enqueueTranspose(transpose_float_kernel, grid_buffers[1], grid_buffers[0], grid.height,
+                     grid.width * grid.depth * 2, 1, &kernel_events[3], &kernel_events[4]);
+    enqueueFIR(grid_buffers[0], grid_buffers[1], no_buffer, weights_buffer, radius, grid.width * grid.depth * 2,
+               grid.height, 0, 0, BORDER_CLAMP, kernel_events[4], &kernel_events[5]);
+
+    size_t global_size[2] = {static_cast<size_t>(width), static_cast<size_t>(height)};
+    err = clSetKernelArg(bilateral_slice_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(bilateral_slice_kernel, 1, sizeof(cl_mem), &grid_buffers[1]);
+    err |= clSetKernelArg(bilateral_slice_kernel, 2, sizeof(cl_mem), &output_buffer);
+    err |= clSetKernelArg(bilateral_slice_kernel, 3, sizeof(int), &width);
+    err |= clSetKernelArg(bilateral_slice_kernel, 4, sizeof(int), &height);
+    err |= clSetKernelArg(bilateral_slice_kernel, 5, sizeof(float), &grid.spatial_scale);
+    err |= clSetKernelArg(bilateral_slice_kernel, 6, sizeof(float), &grid.range_scale);
+    err |= clSetKernelArg(bilateral_slice_kernel, 7, sizeof(int), &grid.width);
+    err |= clSetKernelArg(bilateral_slice_kernel, 8, sizeof(int), &grid.depth);
+    err |= clSetKernelArg(bilateral_slice_kernel, 9, sizeof(int), &grid.padding);
+    check_error(err, "Setting slice kernel arguments");
+    err = clEnqueueNDRangeKernel(commands, bilateral_slice_kernel, 2, NULL, global_size, NULL,
+                                 1, &kernel_events[5], &kernel_events[6]);
+    check_error(err, "Enqueuing slice kernel");
+
+    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, pixels, output_data,
+                              1, &kernel_events[6], &read_event);
+    check_error(err, "Reading output buffer");
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(read_event);
+    for (int i = 0; i < 7; i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(bilateral_slice_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(pixels, work_group_size);
+
+    clReleaseEvent(write_event);
+    for (int i = 0; i < 7; i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(grid_buffers[0]);
+    clReleaseMemObject(grid_buffers[1]);
+    clReleaseMemObject(weights_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+void GaussianBlurProcessor::enqueueVHGW(cl_mem input, cl_mem output, cl_mem byte_output, cl_mem prefix, int radius,
+                                        int columns, int length, int out_start, int out_rows, BorderMode mode,
+                                        bool dilate, cl_event wait, cl_event* event) {
+    cl_int err;
+    int mode_value = mode;
+    float constant_value = border_constant;
+    int dilate_value = dilate ? 1 : 0;
+
+    err = clSetKernelArg(vhgw_kernel, 0, sizeof(cl_mem), &input);
+    err |= clSetKernelArg(vhgw_kernel, 1, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(vhgw_kernel, 2, sizeof(cl_mem), &byte_output);
+    err |= clSetKernelArg(vhgw_kernel, 3, sizeof(cl_mem), &prefix);
+    err |= clSetKernelArg(vhgw_kernel, 4, sizeof(int), &radius);
+    err |= clSetKernelArg(vhgw_kernel, 5, sizeof(int), &columns);
+    err |= clSetKernelArg(vhgw_kernel, 6, sizeof(int), &length);
+    err |= clSetKernelArg(vhgw_kernel, 7, sizeof(int), &out_start);
+    err |= clSetKernelArg(vhgw_kernel, 8, sizeof(int), &out_rows);
+    err |= clSetKernelArg(vhgw_kernel, 9, sizeof(int), &mode_value);
+    err |= clSetKernelArg(vhgw_kernel, 10, sizeof(float), &constant_value);
+    err |= clSetKernelArg(vhgw_kernel, 11, sizeof(int), &dilate_value);
+    check_error(err, "Setting morphology kernel arguments");
+
+    size_t global_size = columns;
+    err = clEnqueueNDRangeKernel(commands, vhgw_kernel, 1, NULL, &global_size, NULL, 1, &wait, event);
+    check_error(err, "Enqueuing morphology kernel");
+}
+
+ProcessingMetrics GaussianBlurProcessor::processMorphology(const unsigned char* input_data, unsigned char* output_data,
+                                                           int image_width, int height, MorphologyOp op,
+                                                           int radius_x, int radius_y){
+    /*
+    Erosion, dilation, opening or closing by the (2 radius_x + 1) x
+    (2 radius_y + 1) rectangle, each elementary operation being two van
+    Herk / Gil-Werman passes laid out like the separable engine (transposed
+    rows, then columns). Slicing, regions and border modes as the blur, the
+    halo covering the radius of every elementary operation. Like the CPU
+    twin, every operation applies the border mode at the image edges: the
+    halo rows are only real rows of the image, cut at its top and bottom
+    where each pass remaps them as it does the columns. Wrap keeps the
+    synthesized halo, a periodic image being its own remapping. Copy is
+    handled as clamp.
+    */
+    ProcessingMetrics metrics = {};
+    if (radius_x < 0 || radius_y < 0) {
+        fprintf(stderr, "Morphology radii must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+    // Elementary operations: true for a dilation
+    std::vector<bool> dilations;
+    if (op == MORPH_ERODE || op == MORPH_OPEN) dilations.push_back(false);
+    if (op != MORPH_ERODE) dilations.push_back(true);
+    if (op == MORPH_CLOSE) dilations.push_back(false);
+    int num_ops = static_cast<int>(dilations.size());
+
+    std::vector<cl_event> write_events, kernel_events;
+    cl_event event, read_event;
+    cl_int err;
+
+    int start_row, rows;
+    getSlice(height, start_row, rows);
+    int halo = radius_y * num_ops;
+    SliceColumns columns = getSliceColumns(image_width, radius_x * num_ops);
+    int width = columns.width;
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    int halo_top = (mode == BORDER_WRAP) ? halo : std::min(halo, start_row);
+    int halo_bottom = (mode == BORDER_WRAP) ? halo : std::min(halo, height - start_row - rows);
+    int input_rows = rows + halo_top + halo_bottom;
+
+    size_t input_size = static_cast<size_t>(input_rows) * width;
+    size_t float_size = input_size * sizeof(float);
+    size_t prefix_size = std::max(static_cast<size_t>(width + 2 * radius_x) * input_rows,
+                                  static_cast<size_t>(input_rows + 2 * radius_y) * width) * sizeof(float);
+    size_t output_size = static_cast<size_t>(rows) * width;
+    metrics.memory_used = input_size + 2 * float_size + prefix_size + output_size;
+
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem float_buffers[2];
+    for (int i = 0; i < 2; i++) {
+        float_buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+        check_error(err, "Creating float buffer");
+    }
+    cl_mem prefix_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, prefix_size, NULL, &err);
+    check_error(err, "Creating morphology buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output_size, NULL, &err);
+    check_error(err, "Creating output buffer");
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> constant_row;
+    writeSliceWithHalo(input_buffer, false, input_data, image_width, columns, height, start_row, rows,
+                       halo_top, halo_bottom, mode, constant_row, write_events);
+
+    // float_buffers[0] holds the transposed slice (width x input_rows) at the start of every operation
+    cl_mem no_buffer = NULL;
+    enqueueTranspose(transpose_uchar_kernel, input_buffer, float_buffers[0], width, input_rows,
+                     write_events.size(), write_events.data(), &event);
+    kernel_events.push_back(event);
+    for (int i = 0; i < num_ops; i++) {
+        bool last_op = (i == num_ops - 1);
+        enqueueVHGW(float_buffers[0], float_buffers[1], no_buffer, prefix_buffer, radius_x, input_rows, width,
+                    0, 0, mode, dilations[i], event, &event);
+        kernel_events.push_back(event);
+        cl_event rows_done = event;
+        enqueueTranspose(transpose_float_kernel, float_buffers[1], float_buffers[0], input_rows, width,
+                         1, &rows_done, &event);
+        kernel_events.push_back(event);
+        if (last_op) {
+            enqueueVHGW(float_buffers[0], no_buffer, output_buffer, prefix_buffer, radius_y, width, input_rows,
+                        halo_top, rows, mode, dilations[i], event, &event);
+            kernel_events.push_back(event);
+        } else {
+            enqueueVHGW(float_buffers[0], float_buffers[1], no_buffer, prefix_buffer, radius_y, width, input_rows,
+                        0, 0, mode, dilations[i], event, &event);
+            kernel_events.push_back(event);
+            cl_event columns_done = event;
+            enqueueTranspose(transpose_float_kernel, float_buffers[1], float_buffers[0], width, input_rows,
+                             1, &columns_done, &event);
+            kernel_events.push_back(event);
+        }
+    }
+
+    enqueueReadSlice(output_buffer, output_data, image_width, columns, start_row, rows, 1, &event, &read_event);
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < write_events.size(); i++) {
+        metrics.memory_transfer_time += getEventExecutionTime(write_events[i]);
+        clReleaseEvent(write_events[i]);
+    }
+    metrics.memory_transfer_time += getEventExecutionTime(read_event);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+        clReleaseEvent(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(vhgw_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(width, work_group_size);
+
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(float_buffers[0]);
+    clReleaseMemObject(float_buffers[1]);
+    clReleaseMemObject(prefix_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+void GaussianBlurProcessor::enqueueSummedAreaTable(cl_mem input, cl_mem sums, cl_mem squares, int width, int height,
+                                                   cl_event wait, std::vector<cl_event>& events) {
+    // Tables of (height + 1) x (width + 1) entries, squares may be NULL
+    cl_int err;
+    cl_event event;
+    int with_squares = (squares != NULL) ? 1 : 0;
+
+    // Power of two work-groups, as large as the kernel allows up to SAT_GROUP_SIZE
+    size_t max_group_size;
+    clGetKernelWorkGroupInfo(sat_rows_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(max_group_size), &max_group_size, NULL);
+    size_t group_size = 1;
+    while (group_size * 2 <= std::min(max_group_size, static_cast<size_t>(SAT_GROUP_SIZE))) group_size *= 2;
+
+    err = clSetKernelArg(sat_rows_kernel, 0, sizeof(cl_mem), &input);
+    err |= clSetKernelArg(sat_rows_kernel, 1, sizeof(cl_mem), &sums);
+    err |= clSetKernelArg(sat_rows_kernel, 2, sizeof(cl_mem), &squares);
+    err |= clSetKernelArg(sat_rows_kernel, 3, sizeof(int), &width);
+    err |= clSetKernelArg(sat_rows_kernel, 4, sizeof(int), &with_squares);
+    err |= clSetKernelArg(sat_rows_kernel, 5, 2 * group_size * sizeof(cl_uint), NULL);
+    err |= clSetKernelArg(sat_rows_kernel, 6, 2 * group_size * sizeof(cl_ulong), NULL);
+    check_error(err, "Setting summed-area table kernel arguments");
+    size_t rows_size = group_size * height;
+    err = clEnqueueNDRangeKernel(commands, sat_rows_kernel, 1, NULL, &rows_size, &group_size, 1, &wait, &event);
+    check_error(err, "Enqueuing summed-area table kernel");
+    events.push_back(event);
+
+    err = clSetKernelArg(sat_columns_kernel, 0, sizeof(cl_mem), &sums);
+    err |= clSetKernelArg(sat_columns_kernel, 1, sizeof(cl_mem), &squares);
+    err |= clSetKernelArg(sat_columns_kernel, 2, sizeof(int), &width);
+    err |= clSetKernelArg(sat_columns_kernel, 3, sizeof(int), &height);
+    err |= clSetKernelArg(sat_columns_kernel, 4, sizeof(int), &with_squares);
+    check_error(err, "Setting summed-area table kernel arguments");
+    size_t columns_size = width + 1;
+    cl_event rows_done = event;
+    err = clEnqueueNDRangeKernel(commands, sat_columns_kernel, 1, NULL, &columns_size, NULL, 1, &rows_done, &event);
+    check_error(err, "Enqueuing summed-area table kernel");
+    events.push_back(event);
+}
+
+ProcessingMetrics GaussianBlurProcessor::summedAreaTable(const unsigned char* input_data, int width, int height,
+                                                         std::vector<cl_uint>& sums, std::vector<cl_ulong>* squares){
+    /*
+    Summed-area tables of the image (and of its squares when squares is
+    given), (height + 1) x (width + 1) with a zero first row and column: the
+    sum of any window is four reads, the sums wrap around in 32 bits and their
+    differences stay exact.
+    */
+    ProcessingMetrics metrics = {};
+    size_t pixels = static_cast<size_t>(width) * height;
+    size_t entries = static_cast<size_t>(width + 1) * (height + 1);
+    sums.resize(entries);
+    if (squares) squares->resize(entries);
+
+    cl_int err;
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem sums_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, entries * sizeof(cl_uint), NULL, &err);
+    check_error(err, "Creating summed-area table buffer");
+    cl_mem squares_buffer = NULL;
+    if (squares) {
+        squares_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, entries * sizeof(cl_ulong), NULL, &err);
+        check_error(err, "Creating summed-area table buffer");
+    }
+    metrics.memory_used = pixels + entries * (sizeof(cl_uint) + (squares ? sizeof(cl_ulong) : 0));
+
+    std::vector<cl_event> kernel_events;
+    cl_event write_event;
+    cl_event read_events[2] = {NULL, NULL};
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, pixels, input_data, 0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+    enqueueSummedAreaTable(input_buffer, sums_buffer, squares_buffer, width, height, write_event, kernel_events);
+
+    err = clEnqueueReadBuffer(commands, sums_buffer, CL_FALSE, 0, entries * sizeof(cl_uint), sums.data(),
+                              1, &kernel_events.back(), &read_events[0]);
+    check_error(err, "Reading summed-area table");
+    if (squares) {
+        err = clEnqueueReadBuffer(commands, squares_buffer, CL_FALSE, 0, entries * sizeof(cl_ulong), squares->data(),
+                                  1, &kernel_events.back(), &read_events[1]);
+        check_error(err, "Reading summed-area table");
+    }
+    clFinish(commands);
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event);
+    for (int i = 0; i < 2; i++) {
+        if (!read_events[i]) continue;
+        metrics.memory_transfer_time += getEventExecutionTime(read_events[i]);
+        clReleaseEvent(read_events[i]);
+    }
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+        clReleaseEvent(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    clReleaseEvent(write_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(sums_buffer);
+    if (squares_buffer) clReleaseMemObject(squares_buffer);
+
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processLocalStatistic(const unsigned char* input_data,
+                                                               unsigned char* output_data, int width, int height,
+                                                               LocalStatistic statistic, int radius_x, int radius_y){
+    /*
+    Box mean, local standard deviation or local contrast normalization over
+    the (2 radius_x + 1) x (2 radius_y + 1) window, in O(1) per pixel
+    whatever its size: the tables are built on the device and only the
+    result comes back. The windows are clipped to the image, the border
+    mode does not apply.
+    */
+    ProcessingMetrics metrics = {};
+    size_t pixels = static_cast<size_t>(width) * height;
+    size_t entries = static_cast<size_t>(width + 1) * (height + 1);
+    bool with_squares = (statistic != STAT_MEAN);
+    int statistic_value = statistic;
+
+    cl_int err;
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem sums_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, entries * sizeof(cl_uint), NULL, &err);
+    check_error(err, "Creating summed-area table buffer");
+    cl_mem squares_buffer = NULL;
+    if (with_squares) {
+        squares_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, entries * sizeof(cl_ulong), NULL, &err);
+        check_error(err, "Creating summed-area table buffer");
+    }
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating output buffer");
+    metrics.memory_used = 2 * pixels + entries * (sizeof(cl_uint) + (with_squares ? sizeof(cl_ulong) : 0));
+
+    std::vector<cl_event> kernel_events;
+    cl_event write_event, read_event, event;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, pixels, input_data, 0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+    enqueueSummedAreaTable(input_buffer, sums_buffer, squares_buffer, width, height, write_event, kernel_events);
+
+    err = clSetKernelArg(sat_statistics_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(sat_statistics_kernel, 1, sizeof(cl_mem), &sums_buffer);
+    err |= clSetKernelArg(sat_statistics_kernel, 2, sizeof(cl_mem), &squares_buffer);
+    err |= clSetKernelArg(sat_statistics_kernel, 3, sizeof(cl_mem), &output_buffer);
+    err |= clSetKernelArg(sat_statistics_kernel, 4, sizeof(int), &width);
+    err |= clSetKernelArg(sat_statistics_kernel, 5, sizeof(int), &height);
+    err |= clSetKernelArg(sat_statistics_kernel, 6, sizeof(int), &radius_x);
+    err |= clSetKernelArg(sat_statistics_kernel, 7, sizeof(int), &radius_y);
+    err |= clSetKernelArg(sat_statistics_kernel, 8, sizeof(int), &statistic_value);
+    check_error(err, "Setting statistics kernel arguments");
+    size_t global_size[2] = {static_cast<size_t>(width), static_cast<size_t>(height)};
+    err = clEnqueueNDRangeKernel(commands, sat_statistics_kernel, 2, NULL, global_size, NULL,
+                                 1, &kernel_events.back(), &event);
+    check_error(err, "Enqueuing statistics kernel");
+    kernel_events.push_back(event);
+
+    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, pixels, output_data, 1, &event, &read_event);
+    check_error(err, "Reading output buffer");
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(read_event);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+        clReleaseEvent(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(sat_statistics_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(pixels, work_group_size);
+
+    clReleaseEvent(write_event);
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(sums_buffer);
+    if (squares_buffer) clReleaseMemObject(squares_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+double GaussianBlurProcessor::nlmeansBandwidth(int patch_radius){
+    // Automatic lambda of CImg's plugins/nlmeans.h for a grey image sampled at every pixel
+    const double np = (2 * patch_radius + 1) * (2 * patch_radius + 1);
+    if (np < 100) {
+        return ((((((1.1785e-12 * np - 5.1827e-10) * np + 9.5946e-08) * np -
+                   9.7798e-06) * np + 6.0756e-04) * np - 0.0248) * np + 1.9203) * np + 7.9599;
+    }
+    return (-7.2611e-04 * np + 1.3213) * np + 15.2726;
+}
+
+double GaussianBlurProcessor::nlmeansPreselection(const unsigned char* input_data, int width, int height,
+                                                  double& sigma, std::vector<float>& guide){
+    /*
+    Pre-selection of CImg's nlmeans(): a neighbour only counts when
+    |P(pixel) - P(neighbour)| / deviation < 3, P (returned in guide) being
+    the image blurred by CImg's blur(1) and the returned deviation the one of
+    noise of deviation sigma once blurred the same way. The plugin measures
+    the latter on a random noise image, here it is exact: sigma times the
+    norm of the impulse response. sigma < 0 is replaced by the plugin's
+    estimate of the noise of the image.
+    */
+    cimg_library::CImg<unsigned char> image(input_data, width, height);
+    if (sigma < 0) sigma = std::sqrt(image.variance_noise());
+    cimg_library::CImg<float> blurred = image.get_blur(1);
+    guide.assign(blurred.data(), blurred.data() + blurred.size());
+
+    cimg_library::CImg<float> impulse(65, 65, 1, 1, 0.0f);
+    impulse(32, 32) = 1.0f;
+    impulse.blur(1);
+    return sigma * std::sqrt(impulse.get_sqr().sum());
+}
+
+ProcessingMetrics GaussianBlurProcessor::processNLMeans(const unsigned char* input_data, unsigned char* output_data,
+                                                        int width, int height, int patch_radius, double sigma,
+                                                        double lambda, double alpha){
+    /*
+    NL-means denoising as CImg's nlmeans(): patches of radius patch_radius,
+    neighbours within alpha * patch_radius that pass nlmeansPreselection(),
+    weights exp(-d / (2 lambda sigma^2)) with lambda < 0 picking
+    nlmeansBandwidth() and sigma < 0 the noise estimate of the plugin. As in
+    the plugin (a commented-out brace after its centre test), every
+    neighbour adds one weight per patch row, d being the distance of the
+    rows so far, and the pixel itself gets the largest weight. The image is
+    uploaded once, every offset of the search window costs two launches:
+    rows in work-groups of NLMEANS_ROW_GROUP pixels, then one work-item per
+    pixel.
+    */
+    ProcessingMetrics metrics = {};
+    if (patch_radius < 0) {
+        fprintf(stderr, "NL-means needs a patch radius >= 0\n");
+        exit(EXIT_FAILURE);
+    }
+    std::vector<float> guide;
+    float deviation = static_cast<float>(nlmeansPreselection(input_data, width, height, sigma, guide));
+    if (lambda < 0) lambda = nlmeansBandwidth(patch_radius);
+    float h2 = static_cast<float>(-0.5 / (lambda * sigma * sigma));
+    int search_radius = static_cast<int>(alpha * patch_radius);
+    int pixels = width * height;
+    size_t float_size = static_cast<size_t>(pixels) * sizeof(float);
+
+    cl_int err;
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem guide_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, float_size, NULL, &err);
+    check_error(err, "Creating NL-means buffer");
+    cl_mem row_sums_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, pixels * sizeof(cl_uint), NULL, &err);
+    check_error(err, "Creating NL-means buffer");
+    // weighted sum, sum and maximum of the weights of every pixel
+    cl_mem accumulators[3];
+    for (int i = 0; i < 3; i++) {
+        accumulators[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+        check_error(err, "Creating NL-means buffer");
+    }
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, pixels, NULL, &err);
+    check_error(err, "Creating output buffer");
+    metrics.memory_used = 2 * pixels + pixels * sizeof(cl_uint) + 4 * float_size;
+
+    std::vector<cl_event> kernel_events;
+    cl_event write_event, guide_event, read_event, event;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, pixels, input_data, 0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+    err = clEnqueueWriteBuffer(commands, guide_buffer, CL_FALSE, 0, float_size, guide.data(), 1, &write_event,
+                               &guide_event);
+    check_error(err, "Writing NL-means buffer");
+
+    err = clSetKernelArg(nlmeans_rows_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(nlmeans_rows_kernel, 1, sizeof(cl_mem), &row_sums_buffer);
+    err |= clSetKernelArg(nlmeans_rows_kernel, 2, sizeof(int), &width);
+    err |= clSetKernelArg(nlmeans_rows_kernel, 3, sizeof(int), &height);
+    err |= clSetKernelArg(nlmeans_rows_kernel, 6, sizeof(int), &patch_radius);
+    err |= clSetKernelArg(nlmeans_columns_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(nlmeans_columns_kernel, 1, sizeof(cl_mem), &row_sums_buffer);
+    err |= clSetKernelArg(nlmeans_columns_kernel, 2, sizeof(cl_mem), &guide_buffer);
+    for (int i = 0; i < 3; i++) {
+        err |= clSetKernelArg(nlmeans_columns_kernel, 3 + i, sizeof(cl_mem), &accumulators[i]);
+    }
+    err |= clSetKernelArg(nlmeans_columns_kernel, 6, sizeof(int), &width);
+    err |= clSetKernelArg(nlmeans_columns_kernel, 7, sizeof(int), &height);
+    err |= clSetKernelArg(nlmeans_columns_kernel, 10, sizeof(int), &patch_radius);
+    err |= clSetKernelArg(nlmeans_columns_kernel, 11, sizeof(float), &h2);
+    err |= clSetKernelArg(nlmeans_columns_kernel, 12, sizeof(float), &deviation);
+    check_error(err, "Setting NL-means kernel arguments");
+
+    size_t kernel_max;
+    clGetKernelWorkGroupInfo(nlmeans_rows_kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_max), &kernel_max, NULL);
+    size_t row_group = std::min(static_cast<size_t>(NLMEANS_ROW_GROUP), kernel_max);
+    size_t rows_size[2] = {roundUp(width, row_group), static_cast<size_t>(height)};
+    err = clSetKernelArg(nlmeans_rows_kernel, 7, (row_group + 2 * patch_radius) * sizeof(cl_uint), NULL);
+    check_error(err, "Setting NL-means kernel arguments");
+    const size_t* columns_local = localSizeFor(nlmeans_columns_kernel);
+    size_t columns_size[2];
+    columns_size[0] = columns_local ? roundUp(width, columns_local[0]) : width;
+    columns_size[1] = columns_local ? roundUp(height, columns_local[1]) : height;
+    event = guide_event;
+    int first = 1;
+    for (int dy = -search_radius; dy <= search_radius; dy++) {
+        for (int dx = -search_radius; dx <= search_radius; dx++) {
+            // Without neighbours the offset (0, 0) still runs once to initialize the sums
+            if (dx == 0 && dy == 0 && search_radius > 0) continue;
+            cl_event previous;
+            if (dx || dy) {
+                err = clSetKernelArg(nlmeans_rows_kernel, 4, sizeof(int), &dx);
+                err |= clSetKernelArg(nlmeans_rows_kernel, 5, sizeof(int), &dy);
+                check_error(err, "Setting NL-means kernel arguments");
+                previous = event;
+                err = clEnqueueNDRangeKernel(commands, nlmeans_rows_kernel, 2, NULL, rows_size, &row_group,
+                                             1, &previous, &event);
+                check_error(err, "Enqueuing NL-means kernel");
+                kernel_events.push_back(event);
+            }
+
+            err = clSetKernelArg(nlmeans_columns_kernel, 8, sizeof(int), &dx);
+            err |= clSetKernelArg(nlmeans_columns_kernel, 9, sizeof(int), &dy);
+            err |= clSetKernelArg(nlmeans_columns_kernel, 13, sizeof(int), &first);
+            check_error(err, "Setting NL-means kernel arguments");
+            previous = event;
+            err = clEnqueueNDRangeKernel(commands, nlmeans_columns_kernel, 2, NULL, columns_size, columns_local,
+                                         1, &previous, &event);
+            check_error(err, "Enqueuing NL-means kernel");
+            kernel_events.push_back(event);
+            first = 0;
+        }
+    }
+
+    err = clSetKernelArg(nlmeans_finish_kernel, 0, sizeof(cl_mem), &input_buffer);
+    for (int i = 0; i < 3; i++) {
+        err |= clSetKernelArg(nlmeans_finish_kernel, 1 + i, sizeof(cl_mem), &accumulators[i]);
+    }
+    err |= clSetKernelArg(nlmeans_finish_kernel, 4, sizeof(cl_mem), &output_buffer);
+    err |= clSetKernelArg(nlmeans_finish_kernel, 5, sizeof(int), &pixels);
+    check_error(err, "Setting NL-means kernel arguments");
+    size_t global_size = pixels;
+    cl_event previous = event;
+    err = clEnqueueNDRangeKernel(commands, nlmeans_finish_kernel, 1, NULL, &global_size, NULL, 1, &previous, &event);
+    check_error(err, "Enqueuing NL-means kernel");
+    kernel_events.push_back(event);
+
+    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, pixels, output_data, 1, &event, &read_event);
+    check_error(err, "Reading output buffer");
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(guide_event) +
+                                   getEventExecutionTime(read_event);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+        clReleaseEvent(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(nlmeans_columns_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(pixels, columns_local ? columns_local[0] * columns_local[1]
+                                                                        : work_group_size);
+
+    clReleaseEvent(write_event);
+    clReleaseEvent(guide_event);
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(guide_buffer);
+    clReleaseMemObject(row_sums_buffer);
+    for (int i = 0; i < 3; i++) {
+        clReleaseMemObject(accumulators[i]);
+    }
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processBayer(const void* raw_data, int bits_per_sample,
+                                                      unsigned char* output_data, int width, int height,
+                                                      BayerPattern pattern, DemosaicMethod method){
+    /*
+    Demosaic and Gaussian blur of raw sensor data in one pipeline, the output
+    being planar RGB (3 x width x height bytes, like CImg). Samples of up to
+    8 bits are bytes, up to 16 bits native endian shorts, scaled to [0, 255].
+    Only the mosaic is uploaded (a third of the RGB bytes at 8 bits). The
+    demosaic kernel writes the transposed colours of every pixel side by
+    side, so the rows pass of the separable blur runs on it directly and
+    every colour is a separate line of both passes; the columns pass writes
+    the rows of the 3 planes side by side, read back plane by plane.
+    */
+    ProcessingMetrics metrics = {};
+    if (bits_per_sample < 1 || bits_per_sample > 16 || width < 2 || height < 2) {
+        fprintf(stderr, "Demosaic needs 1 to 16 bits per sample and at least 2 x 2 pixels\n");
+        exit(EXIT_FAILURE);
+    }
+    int sample_bytes = (bits_per_sample > 8) ? 2 : 1;
+    float scale = 255.0f / ((1 << bits_per_sample) - 1);
+    int pattern_value = pattern;
+    int edge = (method == DEMOSAIC_EDGE_AWARE);
+
+    std::vector<float> line = create_separable_kernel(sigma);
+    int radius = static_cast<int>(line.size() / 2);
+    BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    int lines = 3 * height;             // lines of the rows pass
+    int columns = 3 * width;            // lines of the columns pass
+    size_t pixels = static_cast<size_t>(width) * height;
+
+    size_t raw_size = pixels * sample_bytes;
+    size_t float_size = 3 * pixels * sizeof(float);
+    size_t output_size = 3 * pixels * sizeof(unsigned char);
+    metrics.memory_used = raw_size + 2 * float_size + output_size + line.size() * sizeof(float);
+
+    cl_int err;
+    cl_mem raw_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, raw_size, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem float_buffers[2];
+    for (int i = 0; i < 2; i++) {
+        float_buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+        check_error(err, "Creating float buffer");
+    }
+    cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           line.size() * sizeof(float), line.data(), &err);
+    check_error(err, "Creating weights buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output_size, NULL, &err);
+    check_error(err, "Creating output buffer");
+
+    cl_event write_event, kernel_events[4], read_events[3];
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, raw_buffer, CL_FALSE, 0, raw_size, raw_data, 0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+
+    err = clSetKernelArg(demosaic_kernel, 0, sizeof(cl_mem), &raw_buffer);
+    err |= clSetKernelArg(demosaic_kernel, 1, sizeof(cl_mem), &float_buffers[0]);
+    err |= clSetKernelArg(demosaic_kernel, 2, sizeof(int), &width);
+    err |= clSetKernelArg(demosaic_kernel, 3, sizeof(int), &height);
+    err |= clSetKernelArg(demosaic_kernel, 4, sizeof(int), &sample_bytes);
+    err |= clSetKernelArg(demosaic_kernel, 5, sizeof(float), &scale);
+    err |= clSetKernelArg(demosaic_kernel, 6, sizeof(int), &pattern_value);
+    err |= clSetKernelArg(demosaic_kernel, 7, sizeof(int), &edge);
+    check_error(err, "Setting demosaic kernel arguments");
+
+    const size_t* local = localSizeFor(demosaic_kernel);
+    size_t global_size[2];
+    global_size[0] = local ? roundUp(height, local[0]) : height;
+    global_size[1] = local ? roundUp(width, local[1]) : width;
+    err = clEnqueueNDRangeKernel(commands, demosaic_kernel, 2, NULL, global_size, local,
+                                 1, &write_event, &kernel_events[0]);
+    check_error(err, "Enqueuing demosaic kernel");
+
+    // Rows pass on the 3 height lines of width samples, then the columns of the 3 planes side by side
+    cl_mem no_buffer = NULL;
+    enqueueFIR(float_buffers[0], float_buffers[1], no_buffer, weights_buffer, radius, lines, width,
+               0, 0, mode, kernel_events[0], &kernel_events[1]);
+    enqueueTranspose(transpose_float_kernel, float_buffers[1], float_buffers[0], lines, width,
+                     1, &kernel_events[1], &kernel_events[2]);
+    enqueueFIR(float_buffers[0], no_buffer, output_buffer, weights_buffer, radius, columns, height,
+               0, height, mode, kernel_events[2], &kernel_events[3]);
+
+    for (int c = 0; c < 3; c++) {
+        size_t buffer_origin[3] = {static_cast<size_t>(c) * width, 0, 0};
+        size_t host_origin[3] = {0, 0, 0};
+        size_t region[3] = {static_cast<size_t>(width), static_cast<size_t>(height), 1};
+        err = clEnqueueReadBufferRect(commands, output_buffer, (c == 2) ? CL_TRUE : CL_FALSE, buffer_origin,
+                                      host_origin, region, columns, 0, width, 0, output_data + c * pixels,
+                                      1, &kernel_events[3], &read_events[c]);
+        check_error(err, "Reading output buffer");
+    }
+
+    clFinish(commands);
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event);
+    for (int c = 0; c < 3; c++) {
+        metrics.memory_transfer_time += getEventExecutionTime(read_events[c]);
+    }
+    for (int i = 0; i < 4; i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    size_t work_group_size;
+    clGetKernelWorkGroupInfo(fir_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(work_group_size), &work_group_size, NULL);
+    metrics.gpu_occupancy = calculateGPUOccupancy(columns, work_group_size);
+
+    clReleaseEvent(write_event);
+    for (int i = 0; i < 4; i++) {
+        clReleaseEvent(kernel_events[i]);
+    }
+    for (int c = 0; c < 3; c++) {
+        clReleaseEvent(read_events[c]);
+    }
+    clReleaseMemObject(raw_buffer);
+    clReleaseMemObject(float_buffers[0]);
+    clReleaseMemObject(float_buffers[1]);
+    clReleaseMemObject(weights_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
+
+int GaussianBlurProcessor::resizeFilter(int src_size, int dst_size, BorderMode mode, std::vector<cl_int>& indices,
+                                        std::vector<float>& weights){
+    /*
+    Taps of one axis of a resize, shared by the OpenCL and CPU engines. Output
+    sample i is centred on the source coordinate (i + 0.5) scale - 0.5 and
+    weights the source samples by a Gaussian of RESIZE_SIGMA * max(scale, 1)
+    source pixels truncated at GAUSSIAN_TRUNCATE_SIGMAS, normalized: the
+    antialiasing blur when shrinking, a smooth interpolation when enlarging.
+    A table per output sample covers every phase of the polyphase filter
+    whatever the scale. The indices follow the border mode (copy as clamp),
+    -1 standing for the constant. Returns the taps per output sample.
+    */
+    if (mode == BORDER_COPY) mode = BORDER_CLAMP;
+    const double scale = static_cast<double>(src_size) / dst_size;
+    const double sigma = RESIZE_SIGMA * std::max(scale, 1.0);
+    const double support = GAUSSIAN_TRUNCATE_SIGMAS * sigma;
+    const int taps = static_cast<int>(ceil(2 * support)) + 1;
+
+    indices.resize(static_cast<size_t>(dst_size) * taps);
+    weights.resize(indices.size());
+    for (int i = 0; i < dst_size; i++) {
+        double centre = (i + 0.5) * scale - 0.5;
+        int first = static_cast<int>(ceil(centre - support));
+        double sum = 0;
+        for (int k = 0; k < taps; k++) {
+            double d = first + k - centre;
+            double w = exp(-d * d / (2 * sigma * sigma));
+            indices[i * taps + k] = remapCoordinate(first + k, src_size, mode);
+            weights[i * taps + k] = static_cast<float>(w);
+            sum += w;
+        }
+        for (int k = 0; k < taps; k++) {
+            weights[i * taps + k] = static_cast<float>(weights[i * taps + k] / sum);
+        }
+    }
+    return taps;
+}
+
+ProcessingMetrics GaussianBlurProcessor::processResize(const unsigned char* input_data, int width, int height,
+                                                       std::vector<PyramidLevel>& sizes,
+                                                       std::vector<unsigned char>& outputs){
+    /*
+    Antialiased resize of one image to every size given (width and height of
+    the entries, their offsets are filled in): the image is uploaded once,
+    each size costs a rows and a columns pass of resizeFilter() taps, which
+    blur and resample at once, and all the outputs come back in a single
+    read. The taps of every size are uploaded together.
+    */
+    ProcessingMetrics metrics = {};
+    if (sizes.empty()) return metrics;
+
+    size_t total = 0;
+    size_t float_size = 0;
+    std::vector<cl_int> indices, size_indices;
+    std::vector<float> weights, size_weights;
+    std::vector<int> taps_x(sizes.size()), taps_y(sizes.size());
+    std::vector<int> table_x(sizes.size()), table_y(sizes.size());
+    for (size_t s = 0; s < sizes.size(); s++) {
+        if (sizes[s].width < 1 || sizes[s].height < 1) {
+            fprintf(stderr, "Invalid resize to %d x %d\n", sizes[s].width, sizes[s].height);
+            exit(EXIT_FAILURE);
+        }
+        sizes[s].offset = total;
+        total += static_cast<size_t>(sizes[s].width) * sizes[s].height;
+        float_size = std::max(float_size, static_cast<size_t>(sizes[s].width) * height * sizeof(float));
+
+        table_x[s] = static_cast<int>(indices.size());
+        taps_x[s] = resizeFilter(width, sizes[s].width, border_mode, size_indices, size_weights);
+        indices.insert(indices.end(), size_indices.begin(), size_indices.end());
+        weights.insert(weights.end(), size_weights.begin(), size_weights.end());
+        table_y[s] = static_cast<int>(indices.size());
+        taps_y[s] = resizeFilter(height, sizes[s].height, border_mode, size_indices, size_weights);
+        indices.insert(indices.end(), size_indices.begin(), size_indices.end());
+        weights.insert(weights.end(), size_weights.begin(), size_weights.end());
+    }
+    if (total > 0x7fffffff) {
+        fprintf(stderr, "Outputs too large for the resize engine\n");
+        exit(EXIT_FAILURE);
+    }
+    outputs.resize(total);
+
+    size_t input_size = static_cast<size_t>(width) * height;
+    size_t table_size = indices.size() * sizeof(cl_int);
+    metrics.memory_used = input_size + float_size + 2 * table_size + total;
+    float constant_value = border_constant;
+    cl_int err;
+
+    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    check_error(err, "Creating input buffer");
+    cl_mem float_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, float_size, NULL, &err);
+    check_error(err, "Creating float buffer");
+    cl_mem indices_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           table_size, indices.data(), &err);
+    check_error(err, "Creating resize taps buffer");
+    cl_mem weights_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           weights.size() * sizeof(float), weights.data(), &err);
+    check_error(err, "Creating resize taps buffer");
+    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, total, NULL, &err);
+    check_error(err, "Creating output buffer");
+
+    std::vector<cl_event> kernel_events;
+    cl_event write_event, read_event, event;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    err = clEnqueueWriteBuffer(commands, input_buffer, CL_FALSE, 0, input_size, input_data, 0, NULL, &write_event);
+    check_error(err, "Writing input buffer");
+
+    // The float rows are reused by every size, the passes are chained
+    event = write_event;
+    // Each pass is checked against its own kernel's work-group limit
+    const size_t* rows_local = localSizeFor(resize_rows_kernel);
+    const size_t* columns_local = localSizeFor(resize_columns_kernel);
+    for (size_t s = 0; s < sizes.size(); s++) {
+        const PyramidLevel& dst = sizes[s];
+        int output_offset = static_cast<int>(dst.offset);
+
+        err = clSetKernelArg(resize_rows_kernel, 0, sizeof(cl_mem), &input_buffer);
+        err |= clSetKernelArg(resize_rows_kernel, 1, sizeof(cl_mem), &float_buffer);
+        err |= clSetKernelArg(resize_rows_kernel, 2, sizeof(cl_mem), &indices_buffer);
+        err |= clSetKernelArg(resize_rows_kernel, 3, sizeof(cl_mem), &weights_buffer);
+        err |= clSetKernelArg(resize_rows_kernel, 4, sizeof(int), &table_x[s]);
+        err |= clSetKernelArg(resize_rows_kernel, 5, sizeof(int), &taps_x[s]);
+        err |= clSetKernelArg(resize_rows_kernel, 6, sizeof(int), &width);
+        err |= clSetKernelArg(resize_rows_kernel, 7, sizeof(int), &height);
+        err |= clSetKernelArg(resize_rows_kernel, 8, sizeof(int), &dst.width);
+        err |= clSetKernelArg(resize_rows_kernel, 9, sizeof(float), &constant_value);
+        check_error(err, "Setting resize kernel arguments");
+
+        size_t global_size[2];
+        global_size[0] = rows_local ? roundUp(dst.width, rows_local[0]) : dst.width;
+        global_size[1] = rows_local ? roundUp(height, rows_local[1]) : height;
+        cl_event previous = event;
+        err = clEnqueueNDRangeKernel(commands, resize_rows_kernel, 2, NULL, global_size, rows_local,
+                                     1, &previous, &event);
+        check_error(err, "Enqueuing resize kernel");
+        kernel_events.push_back(event);
+
+        err = clSetKernelArg(resize_columns_kernel, 0, sizeof(cl_mem), &float_buffer);
+        err |= clSetKernelArg(resize_columns_kernel, 1, sizeof(cl_mem), &output_buffer);
+        err |= clSetKernelArg(resize_columns_kernel, 2, sizeof(cl_mem), &indices_buffer);
+        err |= clSetKernelArg(resize_columns_kernel, 3, sizeof(cl_mem), &weights_buffer);
+        err |= clSetKernelArg(resize_columns_kernel, 4, sizeof(int), &table_y[s]);
+        err |= clSetKernelArg(resize_columns_kernel, 5, sizeof(int), &taps_y[s]);
+        err |= clSetKernelArg(resize_columns_kernel, 6, sizeof(int), &dst.width);
+        err |= clSetKernelArg(resize_columns_kernel, 7, sizeof(int), &dst.height);
+        err |= clSetKernelArg(resize_columns_kernel, 8, sizeof(int), &output_offset);
+        err |= clSetKernelArg(resize_columns_kernel, 9, sizeof(float), &constant_value);
+        check_error(err, "Setting resize kernel arguments");
+
+        global_size[0] = columns_local ? roundUp(dst.width, columns_local[0]) : dst.width;
+        global_size[1] = columns_local ? roundUp(dst.height, columns_local[1]) : dst.height;
+        previous = event;
+        err = clEnqueueNDRangeKernel(commands, resize_columns_kernel, 2, NULL, global_size, columns_local,
+                                     1, &previous, &event);
+        check_error(err, "Enqueuing resize kernel");
+        kernel_events.push_back(event);
+    }
+
+    err = clEnqueueReadBuffer(commands, output_buffer, CL_TRUE, 0, total, outputs.data(), 1, &event, &read_event);
+    check_error(err, "Reading output buffer");
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = getEventExecutionTime(write_event) + getEventExecutionTime(read_event);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += getEventExecutionTime(kernel_events[i]);
+        clReleaseEvent(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+    metrics.gpu_occupancy = calculateGPUOccupancy(static_cast<size_t>(sizes[0].width) * height,
+                                                  rows_local ? rows_local[0] * rows_local[1] : 1);
+
+    clReleaseEvent(write_event);
+    clReleaseEvent(read_event);
+    clReleaseMemObject(input_buffer);
+    clReleaseMemObject(float_buffer);
+    clReleaseMemObject(indices_buffer);
+    clReleaseMemObject(weights_buffer);
+    clReleaseMemObject(output_buffer);
+
+    return metrics;
+}
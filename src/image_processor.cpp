@@ -1,8 +1,17 @@
 #include "../include/image_processor.h"
+#include "../include/stream_blur_processor.h"
+#include "../include/filter_graph.h"
+#include <atomic>
+#include <cmath>
+#include <omp.h>
 
 using namespace cimg_library;
 
-ImageProcessor::ImageProcessor() : processors{GaussianBlurProcessor(true), GaussianBlurProcessor(false)} {}
+const int ImageProcessor::MIN_BAND_ROWS;     // odr-used by std::min()
+
+ImageProcessor::ImageProcessor() : processors{GaussianBlurProcessor(true), GaussianBlurProcessor(false)},
+    planner(tuning_database), auto_blur(false), auto_sigma(1.0), border_mode(BORDER_COPY), border_constant(0),
+    morphology(false), morphology_op(MORPH_ERODE), morphology_radius{0, 0}, median(false), median_radius(1) {}
 
 ImageProcessor::~ImageProcessor(){}
 
@@ -27,36 +36,255 @@ void ImageProcessor::loadAndReplicateImage(const char* filename){
     std::cout << "Total size: " << (all_images_data.size() / (1024.0 * 1024.0)) << " MiB" << std::endl;
 }
 
-GlobalMetrics ImageProcessor::processImagesWithOpenCL() {
-    GlobalMetrics global_metrics = {0};
+void ImageProcessor::setBorderMode(BorderMode mode, unsigned char constant_value){
+    border_mode = mode;
+    border_constant = constant_value;
+    for (int gpu = 0; gpu < 2; gpu++) {
+        processors[gpu].setBorderMode(mode, constant_value);
+        medians[gpu].setBorderMode(mode, constant_value);
+    }
+    cpu_processor.setBorderMode(mode, constant_value);
+}
+
+void ImageProcessor::setBlur(double sigma, BlurAlgorithm algorithm){
+    morphology = false;
+    median = false;
+    for (int gpu = 0; gpu < 2; gpu++) {
+        processors[gpu].setSigma(sigma);
+        processors[gpu].setAlgorithm(algorithm);
+    }
+    cpu_processor.setSigma(sigma);
+    cpu_processor.setAlgorithm(algorithm);
+}
+
+void ImageProcessor::setAutoBlur(double sigma, bool allow_approximate){
+    // The algorithm is chosen by the planner when the images are processed
+    morphology = false;
+    median = false;
+    auto_blur = true;
+    auto_sigma = sigma;
+    planner.setAllowApproximate(allow_approximate);
+}
+
+void ImageProcessor::setMorphology(MorphologyOp op, int radius_x, int radius_y){
+    // Replaces the blur in processImagesWithOpenCL() and processImagesWithCPU(), each GPU taking its half
+    morphology = true;
+    median = false;
+    auto_blur = false;
+    morphology_op = op;
+    morphology_radius[0] = radius_x;
+    morphology_radius[1] = radius_y;
+}
+
+void ImageProcessor::setMedian(int radius){
+    // Replaces the blur in processImagesWithOpenCL() and processImagesWithCPU(), the GPUs sharing the images
+    median = true;
+    morphology = false;
+    auto_blur = false;
+    median_radius = radius;
+    for (int gpu = 0; gpu < 2; gpu++) {
+        medians[gpu].setRadius(radius);
+    }
+}
+
+void ImageProcessor::setCustomKernel(const std::vector<float>& weights, int kernel_width, int kernel_height){
+    morphology = false;
+    median = false;
+    for (int gpu = 0; gpu < 2; gpu++) {
+        processors[gpu].setCustomKernel(weights, kernel_width, kernel_height);
+    }
+    cpu_processor.setCustomKernel(weights, kernel_width, kernel_height);
+}
+
+cl_uint ImageProcessor::initializeDevices() {
+    // One processor per GPU found, two at most
     cl_platform_id platform;
     cl_device_id devices[2];
-    cl_uint num_devices;
+    cl_uint num_devices = 0;
 
     clGetPlatformIDs(1, &platform, NULL);
     clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 2, devices, &num_devices);
+    if (num_devices == 0) {
+        fprintf(stderr, "No OpenCL GPU found\n");
+        exit(EXIT_FAILURE);
+    }
+    num_devices = std::min(num_devices, static_cast<cl_uint>(2));
 
-    
-    for (int i = 0; i < 2; i++) {
+    for (cl_uint i = 0; i < num_devices; i++) {
         processors[i].initializeOpenCL(devices[i]);
         processors[i].printDeviceInfo();
     }
+    return num_devices;
+}
+
+GlobalMetrics ImageProcessor::processImagesWithOpenCL() {
+    GlobalMetrics global_metrics = {};
+
+    cl_uint num_devices = initializeDevices();
+    if (num_devices == 1) {
+        // A single device takes the whole image instead of its half
+        processors[0].setRegion(0, 0, width, height);
+    }
 
     all_output_data.resize(all_images_data.size());
+
+    // Launch configuration of each device: from the tuning database, or
+    // benchmarked on the first image and saved for the next runs
+    tuning_database.load();
+    for (cl_uint gpu = 0; gpu < num_devices; gpu++) {
+        TuningEntry tuning = processors[gpu].autoTune(all_images_data.data(), all_output_data.data(),
+                                                      width, height, tuning_database);
+        std::cout << "GPU" << gpu << " kernel path: "
+                  << GaussianBlurProcessor::kernelPathName(static_cast<KernelPath>(tuning.kernel_path))
+                  << ", local size: " << tuning.local_size[0] << "x" << tuning.local_size[1] << std::endl;
+        if (auto_blur) {
+            std::cout << "GPU" << gpu << " ";
+            BlurPlanner::printPlan(planner.plan(processors[gpu], auto_sigma, width, height, 1,
+                                                all_images_data.data()));
+        }
+    }
+    tuning_database.save();
+
+    auto accumulate = [&](int gpu, const ProcessingMetrics& metrics) {
+        #pragma omp critical
+        {
+            global_metrics.total_memory_transfer_time += metrics.memory_transfer_time;
+            global_metrics.total_kernel_execution_time += metrics.kernel_execution_time;
+            global_metrics.peak_memory_usage = std::max(global_metrics.peak_memory_usage, metrics.memory_used);
+            global_metrics.avg_gpu_occupancy[gpu] += metrics.gpu_occupancy;
+            global_metrics.approximation_rms_error = metrics.approximation_rms_error;
+            global_metrics.algorithm[gpu] = metrics.algorithm;
+            global_metrics.predicted_time[gpu] = metrics.predicted_time;
+        }
+    };
+
     auto start_time = std::chrono::high_resolution_clock::now();
 
-    for (int i = 0; i < NUM_IMAGES; i++) {
-        unsigned char* current_input = all_images_data.data() + (i * single_image_size);
-        unsigned char* current_output = all_output_data.data() + (i * single_image_size);
-
-        #pragma omp parallel for num_threads(2)
-        for (int gpu = 0; gpu < 2; gpu++) {
-            ProcessingMetrics metrics = processors[gpu].processImage(
-                current_input,
-                current_output,
-                width,
-                height
-            );
+    if (median) {
+        // Each device filters every num_devices-th image, MEDIAN_BATCH of them per transfer
+        for (cl_uint gpu = 0; gpu < num_devices; gpu++) {
+            medians[gpu].initializeOpenCL(processors[gpu]);
+        }
+        std::atomic<int> processed(0);
+        #pragma omp parallel for num_threads(num_devices)
+        for (int gpu = 0; gpu < static_cast<int>(num_devices); gpu++) {
+            std::vector<BatchImage> batch;
+            for (int i = gpu; i < NUM_IMAGES; i += num_devices) {
+                BatchImage image = {all_images_data.data() + (i * single_image_size),
+                                    all_output_data.data() + (i * single_image_size), width, height};
+                batch.push_back(image);
+                if (static_cast<int>(batch.size()) < MEDIAN_BATCH && i + static_cast<int>(num_devices) < NUM_IMAGES) {
+                    continue;
+                }
+                accumulate(gpu, medians[gpu].processBatch(batch));
+                int done = processed += static_cast<int>(batch.size());
+                batch.clear();
+                #pragma omp critical
+                std::cout << "Processed " << done << " images..." << std::endl;
+            }
+        }
+    } else {
+        for (int i = 0; i < NUM_IMAGES; i++) {
+            unsigned char* current_input = all_images_data.data() + (i * single_image_size);
+            unsigned char* current_output = all_output_data.data() + (i * single_image_size);
+
+            #pragma omp parallel for num_threads(num_devices)
+            for (int gpu = 0; gpu < static_cast<int>(num_devices); gpu++) {
+                accumulate(gpu, morphology
+                    ? processors[gpu].processMorphology(current_input, current_output, width, height, morphology_op,
+                                                        morphology_radius[0], morphology_radius[1])
+                    : processors[gpu].processImage(current_input, current_output, width, height));
+            }
+
+            if (i % 100 == 0) {
+                std::cout << "Processed " << i << " images..." << std::endl;
+            }
+        }
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    global_metrics.total_processing_time = 
+        std::chrono::duration<double>(end_time - start_time).count();
+    global_metrics.avg_time_per_image = global_metrics.total_processing_time / NUM_IMAGES;
+
+    for (cl_uint gpu = 0; gpu < num_devices; gpu++) {
+        global_metrics.avg_gpu_occupancy[gpu] /= NUM_IMAGES;
+    }
+    processors[0].clearRegion();
+
+    return global_metrics;
+}
+
+GlobalMetrics ImageProcessor::processLargeImageWithOpenCL(const char* filename, const char* output_filename) {
+    /*
+    Blur a single image larger than the device memory. It is cut in tiles
+    whose buffers, halo included, fit every device (see maxTilePixels()):
+    full-width bands when they can be tall enough, square tiles otherwise.
+    Each device pulls the next tile from a shared counter, so the faster one
+    takes more of them. Tiles read their halo from the neighbouring pixels
+    and stitch without seams.
+    */
+    GlobalMetrics global_metrics = {};
+    CImg<unsigned char> image(filename);
+    int image_width = image.width();
+    int image_height = image.height();
+    CImg<unsigned char> output(image_width, image_height, 1, 1, 0);
+
+    cl_uint num_devices = initializeDevices();
+    if (auto_blur) {
+        // Planned on a band of the image, the costs are per pixel
+        tuning_database.load();
+        for (cl_uint gpu = 0; gpu < num_devices; gpu++) {
+            std::cout << "GPU" << gpu << " ";
+            BlurPlanner::printPlan(planner.plan(processors[gpu], auto_sigma, image_width,
+                                                std::min(image_height, MIN_BAND_ROWS), 1, image.data()));
+        }
+        tuning_database.save();
+    }
+
+    // The planner may give each device its own algorithm, hence its own halo
+    size_t max_pixels = processors[0].maxTilePixels();
+    int halo = processors[0].tileHalo();
+    for (cl_uint gpu = 1; gpu < num_devices; gpu++) {
+        max_pixels = std::min(max_pixels, processors[gpu].maxTilePixels());
+        halo = std::max(halo, processors[gpu].tileHalo());
+    }
+
+    int tile_width, tile_height;
+    long band_rows = static_cast<long>(max_pixels / image_width) - 2 * halo;
+    if (band_rows >= MIN_BAND_ROWS || (border_mode == BORDER_WRAP && band_rows > 0)) {
+        int balanced = (image_height + TILES_PER_DEVICE * num_devices - 1) / (TILES_PER_DEVICE * num_devices);
+        tile_width = image_width;
+        tile_height = static_cast<int>(std::min(band_rows, static_cast<long>(std::max(balanced, 1))));
+    } else {
+        tile_width = tile_height = static_cast<int>(floor(sqrt(static_cast<double>(max_pixels)))) - 2 * halo;
+    }
+    if (tile_width < 1 || tile_height < 1 || (border_mode == BORDER_WRAP && tile_width < image_width)) {
+        fprintf(stderr, "Blur halo too large for the device memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int tiles_x = (image_width + tile_width - 1) / tile_width;
+    int tiles_y = (image_height + tile_height - 1) / tile_height;
+    int num_tiles = tiles_x * tiles_y;
+    std::cout << "Tiling " << image_width << "x" << image_height << " in " << num_tiles << " tiles of "
+              << tile_width << "x" << tile_height << " (halo " << halo << ")" << std::endl;
+
+    std::atomic<int> next_tile(0);
+    int tiles_done[2] = {0, 0};
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel num_threads(num_devices)
+    {
+        int gpu = omp_get_thread_num();
+        for (int tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+            int x = (tile % tiles_x) * tile_width;
+            int y = (tile / tiles_x) * tile_height;
+            processors[gpu].setRegion(x, y, std::min(tile_width, image_width - x),
+                                      std::min(tile_height, image_height - y));
+            ProcessingMetrics metrics = processors[gpu].processImage(image.data(), output.data(),
+                                                                     image_width, image_height);
+            tiles_done[gpu]++;
 
             #pragma omp critical
             {
@@ -64,8 +292,58 @@ GlobalMetrics ImageProcessor::processImagesWithOpenCL() {
                 global_metrics.total_kernel_execution_time += metrics.kernel_execution_time;
                 global_metrics.peak_memory_usage = std::max(global_metrics.peak_memory_usage, metrics.memory_used);
                 global_metrics.avg_gpu_occupancy[gpu] += metrics.gpu_occupancy;
+                global_metrics.approximation_rms_error = metrics.approximation_rms_error;
+                global_metrics.algorithm[gpu] = metrics.algorithm;
+                global_metrics.predicted_time[gpu] = metrics.predicted_time;
             }
         }
+        processors[gpu].clearRegion();
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    global_metrics.total_processing_time =
+        std::chrono::duration<double>(end_time - start_time).count();
+    global_metrics.avg_time_per_image = global_metrics.total_processing_time;
+
+    for (cl_uint gpu = 0; gpu < num_devices; gpu++) {
+        std::cout << "GPU" << gpu << " processed " << tiles_done[gpu] << " tiles" << std::endl;
+        if (tiles_done[gpu] > 0) global_metrics.avg_gpu_occupancy[gpu] /= tiles_done[gpu];
+    }
+
+    output.save(output_filename);
+    return global_metrics;
+}
+
+GlobalMetrics ImageProcessor::processImagesWithCPU(bool fixed_point) {
+    GlobalMetrics global_metrics = {};
+
+    cpu_processor.setFixedPoint(fixed_point);
+    if (fixed_point && !cpu_processor.fixedPointAvailable()) {
+        std::cout << "Fixed-point not available for this matrix, using float" << std::endl;
+    }
+
+    if (auto_blur) {
+        tuning_database.load();
+        BlurPlanner::printPlan(planner.plan(cpu_processor, auto_sigma, width, height, 1, all_images_data.data()));
+        tuning_database.save();
+    }
+
+    all_output_data.resize(all_images_data.size());
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < NUM_IMAGES; i++) {
+        const unsigned char* input = all_images_data.data() + (i * single_image_size);
+        unsigned char* output = all_output_data.data() + (i * single_image_size);
+        ProcessingMetrics metrics = morphology
+            ? cpu_processor.processMorphology(input, output, width, height, morphology_op,
+                                              morphology_radius[0], morphology_radius[1])
+            : median ? cpu_processor.processMedian(input, output, width, height, median_radius)
+            : cpu_processor.processImage(input, output, width, height);
+        global_metrics.total_kernel_execution_time += metrics.kernel_execution_time;
+        global_metrics.peak_memory_usage = std::max(global_metrics.peak_memory_usage, metrics.memory_used);
+        global_metrics.approximation_rms_error = metrics.approximation_rms_error;
+        global_metrics.algorithm[0] = global_metrics.algorithm[1] = metrics.algorithm;
+        global_metrics.predicted_time[0] = global_metrics.predicted_time[1] = metrics.predicted_time;
 
         if (i % 100 == 0) {
             std::cout << "Processed " << i << " images..." << std::endl;
@@ -73,15 +351,260 @@ GlobalMetrics ImageProcessor::processImagesWithOpenCL() {
     }
 
     auto end_time = std::chrono::high_resolution_clock::now();
-    global_metrics.total_processing_time = 
+    global_metrics.total_processing_time =
         std::chrono::duration<double>(end_time - start_time).count();
     global_metrics.avg_time_per_image = global_metrics.total_processing_time / NUM_IMAGES;
 
-    for (int gpu = 0; gpu < 2; gpu++) {
-        global_metrics.avg_gpu_occupancy[gpu] /= NUM_IMAGES;
+    return global_metrics;
+}
+
+int ImageProcessor::compareEngines(const char* filename, double sigma) {
+    /*
+    Runs the engines on one image on the GPU and on the host and checks how
+    far apart they are, returning the number of checks that fail. The
+    tolerance is 0 where both engines compute in integers, 1 LSB where float
+    sums may be ordered or contracted differently, the documented bound for
+    the fixed-point path. The blur is the separable one at sigma, operations
+    without a host twin are compared with the host blur they compute. The
+    files of the tiled and streamed blurs are written to the current
+    directory.
+    */
+    int failures = 0;
+    CImg<unsigned char> image(filename);
+    int image_width = image.width();
+    int image_height = image.height();
+    size_t pixels = static_cast<size_t>(image_width) * image_height;
+    const unsigned char* input = image.data();
+    std::vector<unsigned char> gpu_output(pixels), cpu_output(pixels);
+
+    setBlur(sigma, BLUR_SEPARABLE);
+    cpu_processor.processImage(input, cpu_output.data(), image_width, image_height);
+
+    // The tiled blur initializes the devices
+    processLargeImageWithOpenCL(filename, "compare_tiled.pgm");
+    CImg<unsigned char> tiled("compare_tiled.pgm");
+    failures += !checkDifference("Tiled blur", tiled.data(), cpu_output.data(), pixels, 1);
+
+    StreamBlurProcessor stream(sigma);
+    stream.setBorderMode(border_mode, border_constant);
+    stream.processFile(filename, "compare_streamed.pgm");
+    CImg<unsigned char> streamed("compare_streamed.pgm");
+    failures += !checkDifference("Streamed blur", streamed.data(), cpu_output.data(), pixels, 0);
+
+    // The other operations run on the first device, on the whole image rather than its half
+    GaussianBlurProcessor& gpu = processors[0];
+    gpu.setRegion(0, 0, image_width, image_height);
+
+    // A disc in the middle of the image, the rest must stay untouched
+    std::vector<unsigned char> mask(pixels), expected(pixels);
+    int radius = std::min(image_width, image_height) / 3;
+    for (int y = 0; y < image_height; y++) {
+        for (int x = 0; x < image_width; x++) {
+            size_t i = static_cast<size_t>(y) * image_width + x;
+            int dx = x - image_width / 2, dy = y - image_height / 2;
+            mask[i] = (dx * dx + dy * dy <= radius * radius);
+            expected[i] = mask[i] ? cpu_output[i] : input[i];
+        }
     }
+    gpu.processMask(input, gpu_output.data(), image_width, image_height, mask.data());
+    failures += !checkDifference("Masked blur", gpu_output.data(), expected.data(), pixels, 1);
 
-    return global_metrics;
+    std::vector<unsigned char> reference(pixels);
+    for (int algorithm = 0; algorithm < BLUR_ALGORITHM_COUNT; algorithm++) {
+        setBlur(sigma, static_cast<BlurAlgorithm>(algorithm));
+        gpu.processImage(input, gpu_output.data(), image_width, image_height);
+        cpu_processor.processImage(input, reference.data(), image_width, image_height);
+        std::string name = std::string(BlurPlanner::algorithmName(static_cast<BlurAlgorithm>(algorithm))) + " blur";
+        failures += !checkDifference(name.c_str(), gpu_output.data(), reference.data(), pixels, 1);
+    }
+
+    // The 3 x 3 matrix of sigma 1 has a fixed-point variant, within its bound of the float path
+    setBlur(1.0, BLUR_DIRECT);
+    if (gpu.fixedPointAvailable()) {
+        KernelPath path = gpu.getKernelPath();
+        gpu.setKernelPath(PATH_FIXED);
+        gpu.processImage(input, gpu_output.data(), image_width, image_height);
+        gpu.setKernelPath(path);
+        cpu_processor.processImage(input, reference.data(), image_width, image_height);
+        failures += !checkDifference("Fixed-point direct blur", gpu_output.data(), reference.data(), pixels,
+                                     gpu.fixedPointErrorBound());
+    }
+    setBlur(sigma, BLUR_SEPARABLE);
+
+    // The batch runs the direct blur, on the image and two crops of other sizes
+    CImg<unsigned char> crops[2] = {image.get_crop(0, 0, 0, 0, image_width / 2 - 1, image_height / 3 - 1, 0, 0),
+                                    image.get_crop(0, 0, 0, 0, image_width / 3, image_height / 2, 0, 0)};
+    std::vector<unsigned char> crop_outputs[2];
+    std::vector<BatchImage> batch(1);
+    batch[0].input = input;
+    batch[0].output = gpu_output.data();
+    batch[0].width = image_width;
+    batch[0].height = image_height;
+    for (int c = 0; c < 2; c++) {
+        crop_outputs[c].resize(crops[c].size());
+        BatchImage crop = {crops[c].data(), crop_outputs[c].data(), crops[c].width(), crops[c].height()};
+        batch.push_back(crop);
+    }
+    gpu.processBatch(batch);
+    cpu_processor.setAlgorithm(BLUR_DIRECT);
+    for (size_t b = 0; b < batch.size(); b++) {
+        size_t size = static_cast<size_t>(batch[b].width) * batch[b].height;
+        std::vector<unsigned char> batch_reference(size);
+        cpu_processor.processImage(batch[b].input, batch_reference.data(), batch[b].width, batch[b].height);
+        failures += !checkDifference("Batched direct blur", batch[b].output, batch_reference.data(), size, 1);
+    }
+    cpu_processor.setAlgorithm(BLUR_SEPARABLE);
+
+    std::vector<unsigned char> gpu_pyramid, cpu_pyramid;
+    std::vector<PyramidLevel> levels;
+    gpu.buildPyramid(input, image_width, image_height, 4, gpu_pyramid, levels);
+    cpu_processor.buildPyramid(input, image_width, image_height, 4, cpu_pyramid, levels);
+    failures += !checkDifference("Pyramid", gpu_pyramid.data(), cpu_pyramid.data(), cpu_pyramid.size(), 1);
+
+    // The levels are blurred from the previous one, the host blurs the image at every sigma
+    std::vector<double> sigmas;
+    for (int i = 0; i < 3; i++) sigmas.push_back(sigma * (1 << i));
+    std::vector<unsigned char> scale_space;
+    gpu.processScaleSpace(input, image_width, image_height, sigmas, scale_space);
+    for (size_t i = 0; i < sigmas.size(); i++) {
+        cpu_processor.setSigma(sigmas[i]);
+        cpu_processor.processImage(input, reference.data(), image_width, image_height);
+        failures += !checkDifference("Scale-space level", scale_space.data() + i * pixels, reference.data(),
+                                     pixels, 1);
+    }
+    cpu_processor.setSigma(sigma);
+
+    // Unsharp mask built as a graph, in the queue of the first device
+    FilterGraph graph;
+    graph.initializeOpenCL(gpu);
+    graph.setBorderMode(border_mode, border_constant);
+    int source = graph.input();
+    graph.setOutput(graph.unsharp(source, graph.blur(source, sigma), 1.0f));
+    graph.run(input, gpu_output.data(), image_width, image_height);
+    UnsharpMask unsharp = {1.0f, 0.0f};
+    cpu_processor.processUnsharp(input, cpu_output.data(), image_width, image_height, unsharp);
+    failures += !checkDifference("Filter graph", gpu_output.data(), cpu_output.data(), pixels, 1);
+
+    unsharp.amount = 1.5f;
+    unsharp.threshold = 4.0f;
+    gpu.processUnsharp(input, gpu_output.data(), image_width, image_height, unsharp);
+    cpu_processor.processUnsharp(input, cpu_output.data(), image_width, image_height, unsharp);
+    // A difference within an ulp of the threshold may sharpen a pixel on one engine only
+    failures += !checkDifference("Unsharp mask", gpu_output.data(), cpu_output.data(), pixels, 1, 0.0001);
+
+    gpu.detectEdges(input, gpu_output.data(), image_width, image_height, 20.0f, 50.0f);
+    cpu_processor.detectEdges(input, cpu_output.data(), image_width, image_height, 20.0f, 50.0f);
+    // Gradients within an ulp of a threshold may get another label (see detectEdges())
+    failures += !checkDifference("Canny edges", gpu_output.data(), cpu_output.data(), pixels, 0, 0.001);
+
+    gpu.processBilateral(input, gpu_output.data(), image_width, image_height, 3.0, 20.0);
+    cpu_processor.processBilateral(input, cpu_output.data(), image_width, image_height, 3.0, 20.0);
+    failures += !checkDifference("Bilateral filter", gpu_output.data(), cpu_output.data(), pixels, 1);
+
+    // The median engine runs the batch of the blur, in the queue of the first device
+    MedianFilter median_filter;
+    median_filter.initializeOpenCL(gpu);
+    median_filter.setBorderMode(border_mode, border_constant);
+    median_filter.setRadius(2);
+    median_filter.processBatch(batch);
+    for (size_t b = 0; b < batch.size(); b++) {
+        size_t size = static_cast<size_t>(batch[b].width) * batch[b].height;
+        std::vector<unsigned char> batch_reference(size);
+        cpu_processor.processMedian(batch[b].input, batch_reference.data(), batch[b].width, batch[b].height, 2);
+        failures += !checkDifference("Median filter", batch[b].output, batch_reference.data(), size, 0);
+    }
+
+    const char* morphology_names[4] = {"Erosion", "Dilation", "Opening", "Closing"};
+    for (int op = MORPH_ERODE; op <= MORPH_CLOSE; op++) {
+        gpu.processMorphology(input, gpu_output.data(), image_width, image_height,
+                              static_cast<MorphologyOp>(op), 3, 1);
+        cpu_processor.processMorphology(input, cpu_output.data(), image_width, image_height,
+                                        static_cast<MorphologyOp>(op), 3, 1);
+        failures += !checkDifference(morphology_names[op], gpu_output.data(), cpu_output.data(), pixels, 0);
+    }
+
+    std::vector<cl_uint> gpu_sums, cpu_sums;
+    std::vector<cl_ulong> gpu_squares, cpu_squares;
+    gpu.summedAreaTable(input, image_width, image_height, gpu_sums, &gpu_squares);
+    cpu_processor.summedAreaTable(input, image_width, image_height, cpu_sums, &cpu_squares);
+    size_t differing = 0;
+    for (size_t i = 0; i < cpu_sums.size(); i++) {
+        differing += (gpu_sums[i] != cpu_sums[i]) + (gpu_squares[i] != cpu_squares[i]);
+    }
+    std::cout << "Summed-area tables: " << differing << " of " << 2 * cpu_sums.size() << " values differ, tolerance 0: "
+              << (differing == 0 ? "OK" : "FAILED") << std::endl;
+    failures += (differing != 0);
+
+    const char* statistic_names[3] = {"Box mean", "Local standard deviation", "Local contrast"};
+    for (int statistic = STAT_MEAN; statistic <= STAT_CONTRAST; statistic++) {
+        gpu.processLocalStatistic(input, gpu_output.data(), image_width, image_height,
+                                  static_cast<LocalStatistic>(statistic), 4, 4);
+        cpu_processor.processLocalStatistic(input, cpu_output.data(), image_width, image_height,
+                                            static_cast<LocalStatistic>(statistic), 4, 4);
+        failures += !checkDifference(statistic_names[statistic], gpu_output.data(), cpu_output.data(),
+                                     pixels, 1);
+    }
+
+    gpu.processNLMeans(input, gpu_output.data(), image_width, image_height, 1, 10.0);
+    cpu_processor.processNLMeans(input, cpu_output.data(), image_width, image_height, 1, 10.0);
+    failures += !checkDifference("NL-means", gpu_output.data(), cpu_output.data(), pixels, 1);
+    /*
+    Against the plugin itself. It measures the deviation of its pre-selection
+    on random noise where nlmeansPreselection() computes it exactly, so the
+    neighbours at the threshold change from one of its runs to the next
+    (with the exact deviation the results are the same): up to 2% of the
+    values may be off by more than 1.
+    */
+    CImg<unsigned char> plugin = CImg<unsigned char>(input, image_width, image_height).get_nlmeans(1, -1, 3, 10.0);
+    failures += !checkDifference("NL-means vs CImg", gpu_output.data(), plugin.data(), pixels, 1, 0.02);
+
+    // The grey image stands for an 8-bit mosaic, any data being a valid one
+    std::vector<unsigned char> gpu_rgb(3 * pixels), cpu_rgb(3 * pixels);
+    const char* demosaic_names[2] = {"Bilinear demosaic", "Edge-aware demosaic"};
+    for (int method = DEMOSAIC_BILINEAR; method <= DEMOSAIC_EDGE_AWARE; method++) {
+        gpu.processBayer(input, 8, gpu_rgb.data(), image_width, image_height, BAYER_RGGB,
+                         static_cast<DemosaicMethod>(method));
+        cpu_processor.processBayer(input, 8, cpu_rgb.data(), image_width, image_height, BAYER_RGGB,
+                                   static_cast<DemosaicMethod>(method));
+        failures += !checkDifference(demosaic_names[method], gpu_rgb.data(), cpu_rgb.data(),
+                                     cpu_rgb.size(), 1);
+    }
+
+    // A reduction and an enlargement
+    std::vector<PyramidLevel> sizes(2);
+    sizes[0].width = std::max(image_width / 3, 1);
+    sizes[0].height = std::max(image_height / 3, 1);
+    sizes[1].width = image_width * 3 / 2;
+    sizes[1].height = image_height * 3 / 2;
+    std::vector<unsigned char> gpu_resized, cpu_resized;
+    gpu.processResize(input, image_width, image_height, sizes, gpu_resized);
+    cpu_processor.processResize(input, image_width, image_height, sizes, cpu_resized);
+    failures += !checkDifference("Resize", gpu_resized.data(), cpu_resized.data(), cpu_resized.size(), 1);
+
+    gpu.clearRegion();
+    std::cout << failures << " check(s) failed" << std::endl;
+    return failures;
+}
+
+bool ImageProcessor::checkDifference(const char* operation, const unsigned char* gpu, const unsigned char* cpu,
+                                     size_t size, int tolerance, double outliers) {
+    // At most a fraction outliers of the values may be further apart than tolerance
+    int max_difference = 0;
+    size_t differing = 0, beyond = 0;
+    double total = 0;
+    for (size_t i = 0; i < size; i++) {
+        int difference = std::abs(static_cast<int>(gpu[i]) - static_cast<int>(cpu[i]));
+        max_difference = std::max(max_difference, difference);
+        differing += (difference != 0);
+        beyond += (difference > tolerance);
+        total += difference;
+    }
+    bool passed = beyond <= outliers * size;
+    std::cout << operation << ": max difference " << max_difference << ", mean " << (size ? total / size : 0)
+              << ", " << differing << " of " << size << " values differ, tolerance " << tolerance;
+    if (outliers > 0) std::cout << " (" << beyond << " beyond)";
+    std::cout << ": " << (passed ? "OK" : "FAILED") << std::endl;
+    return passed;
 }
 
 void ImageProcessor::printMetrics(const GlobalMetrics& metrics) {
@@ -93,6 +616,17 @@ void ImageProcessor::printMetrics(const GlobalMetrics& metrics) {
     std::cout << "Peak memory usage: " << (metrics.peak_memory_usage / (1024*1024)) << " MB" << std::endl;
     std::cout << "Average GPU occupancy: GPU0: " << metrics.avg_gpu_occupancy[0] 
               << "%, GPU1: " << metrics.avg_gpu_occupancy[1] << "%" << std::endl;
+    for (int gpu = 0; gpu < 2; gpu++) {
+        std::cout << "Algorithm " << gpu << ": " << BlurPlanner::algorithmName(static_cast<BlurAlgorithm>(metrics.algorithm[gpu]));
+        if (metrics.predicted_time[gpu] > 0) {
+            std::cout << " (predicted " << metrics.predicted_time[gpu] << " s per image)";
+        }
+        std::cout << std::endl;
+    }
+    if (metrics.approximation_rms_error > 0) {
+        std::cout << "Approximation RMS error: " << (metrics.approximation_rms_error * 100)
+                  << "% of the Gaussian peak" << std::endl;
+    }
 }
 
 
@@ -1,8 +1,16 @@
 #include "../include/image_processor.h"
+#include <cstring>
 
-int main() {
+int main(int argc, char** argv) {
     ImageProcessor img_process;
 
+    // exec --compare [image]: the GPU engines against their host twins
+    if (argc > 1 && strcmp(argv[1], "--compare") == 0) {
+        img_process.setBorderMode(BORDER_MIRROR);
+        int failures = img_process.compareEngines(argc > 2 ? argv[2] : "image/image.jpg", 2.0);
+        return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     img_process.loadAndReplicateImage("image/image.jpg");
 
     GlobalMetrics metrics = img_process.processImagesWithOpenCL();
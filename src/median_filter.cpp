@@ -0,0 +1,160 @@
+#include "../include/median_filter.h"
+#include <algorithm>
+#include <chrono>
+
+MedianFilter::MedianFilter()
+    : context(NULL), commands(NULL), device(NULL), program(NULL), median_kernel(NULL), pool_buffer_size(0),
+      radius(1), border_mode(BORDER_CLAMP), border_constant(0) {}
+
+MedianFilter::~MedianFilter(){
+    releaseOpenCL();
+}
+
+void MedianFilter::releaseOpenCL(){
+    for (size_t i = 0; i < pool.size(); i++) clReleaseMemObject(pool[i]);
+    pool.clear();
+    pool_buffer_size = 0;
+    if (median_kernel) clReleaseKernel(median_kernel);
+    if (program) clReleaseProgram(program);
+    if (commands) clReleaseCommandQueue(commands);
+    if (context) clReleaseContext(context);
+    median_kernel = NULL;
+    program = NULL;
+    commands = NULL;
+    context = NULL;
+}
+
+void MedianFilter::initializeOpenCL(const GaussianBlurProcessor& processor) {
+    // Shares the context, queue and program of the processor, retained for the lifetime of the filter
+    releaseOpenCL();
+    device = processor.getDevice();
+    context = processor.getContext();
+    commands = processor.getCommandQueue();
+    program = processor.getProgram();
+    clRetainContext(context);
+    clRetainCommandQueue(commands);
+    clRetainProgram(program);
+
+    cl_int err;
+    median_kernel = clCreateKernel(program, "median_filter", &err);
+    GaussianBlurProcessor::check_error(err, "Creating median kernel");
+}
+
+void MedianFilter::setBorderMode(BorderMode mode, unsigned char constant_value){
+    border_mode = (mode == BORDER_COPY) ? BORDER_CLAMP : mode;
+    border_constant = constant_value;
+}
+
+void MedianFilter::setRadius(int radius){
+    if (radius < 1) {
+        fprintf(stderr, "The median radius must be at least 1\n");
+        exit(EXIT_FAILURE);
+    }
+    this->radius = radius;
+}
+
+ProcessingMetrics MedianFilter::processImage(const unsigned char* input_data, unsigned char* output_data,
+                                             int width, int height){
+    std::vector<BatchImage> images(1);
+    images[0].input = input_data;
+    images[0].output = output_data;
+    images[0].width = width;
+    images[0].height = height;
+    return processBatch(images);
+}
+
+ProcessingMetrics MedianFilter::processBatch(const std::vector<BatchImage>& images){
+    /*
+    The images are packed one after the other on the host, uploaded in one
+    write, filtered by one median_filter launch each (3x3 and 5x5 windows
+    through sorting networks, larger ones bit by bit) and read back in one
+    read. Both buffers come from the pool.
+    */
+    ProcessingMetrics metrics = {};
+    std::vector<size_t> offsets(images.size());
+    size_t total_pixels = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+        offsets[i] = total_pixels;
+        total_pixels += static_cast<size_t>(images[i].width) * images[i].height;
+    }
+    if (total_pixels == 0) return metrics;     // only empty images, nothing to allocate
+    if (total_pixels > 0x7fffffff) {
+        fprintf(stderr, "Batch too large for one launch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    cl_int err;
+    if (pool_buffer_size < total_pixels) {
+        for (size_t i = 0; i < pool.size(); i++) clReleaseMemObject(pool[i]);
+        pool.clear();
+        pool_buffer_size = total_pixels;
+    }
+    while (pool.size() < MEDIAN_POOL_BUFFERS) {
+        pool.push_back(clCreateBuffer(context, CL_MEM_READ_WRITE, pool_buffer_size, NULL, &err));
+        GaussianBlurProcessor::check_error(err, "Creating median buffer");
+    }
+    metrics.memory_used = MEDIAN_POOL_BUFFERS * pool_buffer_size;
+
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    std::vector<unsigned char> packed(total_pixels);
+    for (size_t i = 0; i < images.size(); i++) {
+        std::copy(images[i].input, images[i].input + static_cast<size_t>(images[i].width) * images[i].height,
+                  packed.data() + offsets[i]);
+    }
+
+    cl_event write_event, read_event;
+    std::vector<cl_event> kernel_events;
+    err = clEnqueueWriteBuffer(commands, pool[0], CL_FALSE, 0, total_pixels, packed.data(), 0, NULL, &write_event);
+    GaussianBlurProcessor::check_error(err, "Writing input buffer");
+
+    int mode_value = border_mode;
+    err = clSetKernelArg(median_kernel, 0, sizeof(cl_mem), &pool[0]);
+    err |= clSetKernelArg(median_kernel, 1, sizeof(cl_mem), &pool[1]);
+    err |= clSetKernelArg(median_kernel, 5, sizeof(int), &radius);
+    err |= clSetKernelArg(median_kernel, 6, sizeof(int), &mode_value);
+    err |= clSetKernelArg(median_kernel, 7, sizeof(cl_uchar), &border_constant);
+    GaussianBlurProcessor::check_error(err, "Setting median kernel arguments");
+
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].width == 0 || images[i].height == 0) continue;
+        int offset = static_cast<int>(offsets[i]);
+        err = clSetKernelArg(median_kernel, 2, sizeof(int), &offset);
+        err |= clSetKernelArg(median_kernel, 3, sizeof(int), &images[i].width);
+        err |= clSetKernelArg(median_kernel, 4, sizeof(int), &images[i].height);
+        GaussianBlurProcessor::check_error(err, "Setting median kernel arguments");
+
+        size_t global_size[2] = {static_cast<size_t>(images[i].width), static_cast<size_t>(images[i].height)};
+        cl_event event;
+        err = clEnqueueNDRangeKernel(commands, median_kernel, 2, NULL, global_size, NULL, 1, &write_event, &event);
+        GaussianBlurProcessor::check_error(err, "Enqueuing median kernel");
+        kernel_events.push_back(event);
+    }
+
+    // The packed input is not needed anymore, the results come back in its place
+    err = clEnqueueReadBuffer(commands, pool[1], CL_TRUE, 0, total_pixels, packed.data(),
+                              kernel_events.size(), kernel_events.data(), &read_event);
+    GaussianBlurProcessor::check_error(err, "Reading output buffer");
+
+    for (size_t i = 0; i < images.size(); i++) {
+        const unsigned char* src = packed.data() + offsets[i];
+        std::copy(src, src + static_cast<size_t>(images[i].width) * images[i].height, images[i].output);
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+
+    metrics.memory_transfer_time = GaussianBlurProcessor::getEventExecutionTime(write_event) +
+                                   GaussianBlurProcessor::getEventExecutionTime(read_event);
+    for (size_t i = 0; i < kernel_events.size(); i++) {
+        metrics.kernel_execution_time += GaussianBlurProcessor::getEventExecutionTime(kernel_events[i]);
+        clReleaseEvent(kernel_events[i]);
+    }
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.overhead_time = metrics.total_processing_time -
+                          (metrics.memory_transfer_time + metrics.kernel_execution_time);
+
+    clReleaseEvent(write_event);
+    clReleaseEvent(read_event);
+
+    return metrics;
+}
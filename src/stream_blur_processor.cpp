@@ -0,0 +1,282 @@
+#include "../include/stream_blur_processor.h"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <memory>
+#include <omp.h>
+extern "C" {
+#include <jpeglib.h>
+}
+
+#define STREAM_JPEG_QUALITY 100     // same default as CImg::save_jpeg()
+
+static bool hasExtension(const char* filename, const char* const* extensions) {
+    const char* dot = strrchr(filename, '.');
+    if (!dot) return false;
+    for (int i = 0; extensions[i]; i++) {
+        if (strcasecmp(dot + 1, extensions[i]) == 0) return true;
+    }
+    return false;
+}
+
+static FILE* openFile(const char* filename, const char* mode) {
+    FILE* file = fopen(filename, mode);
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    return file;
+}
+
+// Binary PGM (P5) or PPM (P6) with 8-bit samples
+class PNMReader : public ScanlineReader {
+    public:
+        PNMReader(const char* filename) {
+            file = openFile(filename, "rb");
+            char magic[3] = {0, 0, 0};
+            int max_value = 0;
+            if (fscanf(file, "%2s", magic) != 1 || (strcmp(magic, "P5") != 0 && strcmp(magic, "P6") != 0) ||
+                !readValue(image_width) || !readValue(image_height) || !readValue(max_value) || max_value > 255) {
+                fprintf(stderr, "%s is not an 8-bit binary PGM/PPM file\n", filename);
+                exit(EXIT_FAILURE);
+            }
+            fgetc(file);    // single whitespace before the samples
+            channels = (magic[1] == '6') ? 3 : 1;
+            samples.resize(static_cast<size_t>(image_width) * channels);
+        }
+        ~PNMReader() { fclose(file); }
+
+        void readRow(unsigned char* row) {
+            if (fread(samples.data(), 1, samples.size(), file) != samples.size()) {
+                fprintf(stderr, "Unexpected end of PGM/PPM file\n");
+                exit(EXIT_FAILURE);
+            }
+            for (int x = 0; x < image_width; x++) row[x] = samples[x * channels];
+        }
+
+    private:
+        FILE* file;
+        int channels;
+        std::vector<unsigned char> samples;
+
+        bool readValue(int& value) {
+            // Numbers of the header, comments run to the end of the line
+            int c;
+            while ((c = fgetc(file)) != EOF) {
+                if (c == '#') {
+                    while ((c = fgetc(file)) != EOF && c != '\n') {}
+                } else if (!isspace(c)) {
+                    ungetc(c, file);
+                    return fscanf(file, "%d", &value) == 1;
+                }
+            }
+            return false;
+        }
+};
+
+class PGMWriter : public ScanlineWriter {
+    public:
+        PGMWriter(const char* filename, int width, int height) : width(width) {
+            file = openFile(filename, "wb");
+            fprintf(file, "P5\n%d %d\n255\n", width, height);
+        }
+        ~PGMWriter() { fclose(file); }
+
+        void writeRow(const unsigned char* row) {
+            if (fwrite(row, 1, width, file) != static_cast<size_t>(width)) {
+                fprintf(stderr, "Writing PGM file failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+    private:
+        FILE* file;
+        int width;
+};
+
+// libjpeg decoder, one scanline at a time (errors exit through jpeg_std_error)
+class JPEGReader : public ScanlineReader {
+    public:
+        JPEGReader(const char* filename) {
+            file = openFile(filename, "rb");
+            info.err = jpeg_std_error(&error_manager);
+            jpeg_create_decompress(&info);
+            jpeg_stdio_src(&info, file);
+            jpeg_read_header(&info, TRUE);
+            jpeg_start_decompress(&info);
+            image_width = info.output_width;
+            image_height = info.output_height;
+            samples.resize(static_cast<size_t>(image_width) * info.output_components);
+        }
+        ~JPEGReader() {
+            jpeg_abort_decompress(&info);
+            jpeg_destroy_decompress(&info);
+            fclose(file);
+        }
+
+        void readRow(unsigned char* row) {
+            JSAMPROW scanline = samples.data();
+            jpeg_read_scanlines(&info, &scanline, 1);
+            const int channels = info.output_components;
+            for (int x = 0; x < image_width; x++) row[x] = samples[x * channels];
+        }
+
+    private:
+        FILE* file;
+        jpeg_decompress_struct info;
+        jpeg_error_mgr error_manager;
+        std::vector<unsigned char> samples;
+};
+
+class JPEGWriter : public ScanlineWriter {
+    public:
+        JPEGWriter(const char* filename, int width, int height) {
+            file = openFile(filename, "wb");
+            info.err = jpeg_std_error(&error_manager);
+            jpeg_create_compress(&info);
+            jpeg_stdio_dest(&info, file);
+            info.image_width = width;
+            info.image_height = height;
+            info.input_components = 1;
+            info.in_color_space = JCS_GRAYSCALE;
+            jpeg_set_defaults(&info);
+            jpeg_set_quality(&info, STREAM_JPEG_QUALITY, TRUE);
+            jpeg_start_compress(&info, TRUE);
+        }
+        ~JPEGWriter() {
+            jpeg_finish_compress(&info);
+            jpeg_destroy_compress(&info);
+            fclose(file);
+        }
+
+        void writeRow(const unsigned char* row) {
+            JSAMPROW scanline = const_cast<unsigned char*>(row);
+            jpeg_write_scanlines(&info, &scanline, 1);
+        }
+
+    private:
+        FILE* file;
+        jpeg_compress_struct info;
+        jpeg_error_mgr error_manager;
+};
+
+static const char* const JPEG_EXTENSIONS[] = {"jpg", "jpeg", NULL};
+static const char* const PNM_EXTENSIONS[] = {"pgm", "ppm", "pnm", NULL};
+
+ScanlineReader* ScanlineReader::open(const char* filename){
+    if (hasExtension(filename, JPEG_EXTENSIONS)) return new JPEGReader(filename);
+    if (hasExtension(filename, PNM_EXTENSIONS)) return new PNMReader(filename);
+    fprintf(stderr, "%s: streaming needs a JPEG or PGM/PPM file\n", filename);
+    exit(EXIT_FAILURE);
+}
+
+ScanlineWriter* ScanlineWriter::open(const char* filename, int width, int height){
+    if (hasExtension(filename, JPEG_EXTENSIONS)) return new JPEGWriter(filename, width, height);
+    if (hasExtension(filename, PNM_EXTENSIONS)) return new PGMWriter(filename, width, height);
+    fprintf(stderr, "%s: streaming needs a JPEG or PGM output file\n", filename);
+    exit(EXIT_FAILURE);
+}
+
+StreamBlurProcessor::StreamBlurProcessor(double sigma){
+    setSigma(sigma);
+    border_mode = BORDER_COPY;
+    border_constant = 0;
+}
+
+void StreamBlurProcessor::setSigma(double sigma){
+    this->sigma = sigma;
+    line = GaussianBlurProcessor::create_separable_kernel(sigma);
+}
+
+void StreamBlurProcessor::setBorderMode(BorderMode mode, unsigned char constant_value){
+    border_mode = mode;
+    border_constant = constant_value;
+}
+
+ProcessingMetrics StreamBlurProcessor::processFile(const char* input_filename, const char* output_filename){
+    std::unique_ptr<ScanlineReader> reader(ScanlineReader::open(input_filename));
+    std::unique_ptr<ScanlineWriter> writer(ScanlineWriter::open(output_filename, reader->width(), reader->height()));
+    return processStream(*reader, *writer);
+}
+
+void StreamBlurProcessor::blurRow(const unsigned char* input, float* output, int width) const {
+    // Horizontal pass of one row, the columns outside it follow the border mode (copy as clamp)
+    const BorderMode mode = (border_mode == BORDER_COPY) ? BORDER_CLAMP : border_mode;
+    const int radius = static_cast<int>(line.size() / 2);
+
+    #pragma omp parallel for schedule(static)
+    for (int x = 0; x < width; x++) {
+        float sum = 0.0f;
+        if (x >= radius && x < width - radius) {
+            const unsigned char* in = input + x - radius;
+            for (int k = 0; k <= 2 * radius; k++) sum += line[k] * in[k];
+        } else {
+            for (int k = -radius; k <= radius; k++) {
+                int column = GaussianBlurProcessor::remapCoordinate(x + k, width, mode);
+                sum += line[k + radius] * ((column < 0) ? border_constant : input[column]);
+            }
+        }
+        output[x] = sum;
+    }
+}
+
+ProcessingMetrics StreamBlurProcessor::processStream(ScanlineReader& reader, ScanlineWriter& writer){
+    /*
+    Row y is written as soon as row y + r is read. The window is a ring of
+    2r + 1 rows indexed by row % (2r + 1): clamp, mirror and constant only
+    reach rows already read and not yet overwritten. Wrap would need the
+    bottom of the image at the top, vertically it is handled as clamp (like
+    copy), the rows are wrapped.
+    */
+    ProcessingMetrics metrics = {};
+    const int width = reader.width();
+    const int height = reader.height();
+    const int radius = static_cast<int>(line.size() / 2);
+    const int window_rows = 2 * radius + 1;
+    const BorderMode mode = (border_mode == BORDER_COPY || border_mode == BORDER_WRAP) ? BORDER_CLAMP : border_mode;
+
+    std::vector<float> window(static_cast<size_t>(window_rows) * width);
+    std::vector<float> constant_row(width, static_cast<float>(border_constant));
+    std::vector<unsigned char> input_row(width), output_row(width);
+    std::vector<const float*> rows(window_rows);
+    metrics.memory_used = (window.size() + constant_row.size()) * sizeof(float) + 2 * width;
+
+    double io_time = 0;
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+
+    int rows_read = 0;
+    for (int y = 0; y < height; y++) {
+        for (int last = std::min(y + radius, height - 1); rows_read <= last; rows_read++) {
+            auto io_start = std::chrono::high_resolution_clock::now();
+            reader.readRow(input_row.data());
+            io_time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - io_start).count();
+            blurRow(input_row.data(), window.data() + static_cast<size_t>(rows_read % window_rows) * width, width);
+        }
+
+        for (int k = -radius; k <= radius; k++) {
+            int row = GaussianBlurProcessor::remapCoordinate(y + k, height, mode);
+            rows[k + radius] = (row < 0) ? constant_row.data()
+                                         : window.data() + static_cast<size_t>(row % window_rows) * width;
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int x = 0; x < width; x++) {
+            float sum = 0.0f;
+            for (int k = 0; k < window_rows; k++) sum += line[k] * rows[k][x];
+            output_row[x] = static_cast<unsigned char>(std::min(std::max(sum + 0.5f, 0.0f), 255.0f));
+        }
+
+        auto io_start = std::chrono::high_resolution_clock::now();
+        writer.writeRow(output_row.data());
+        io_time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - io_start).count();
+    }
+
+    auto cpu_end = std::chrono::high_resolution_clock::now();
+    metrics.total_processing_time = std::chrono::duration<double>(cpu_end - cpu_start).count();
+    metrics.memory_transfer_time = io_time;
+    metrics.kernel_execution_time = metrics.total_processing_time - io_time;
+    metrics.algorithm = BLUR_SEPARABLE;
+    return metrics;
+}
@@ -0,0 +1,99 @@
+#include "../include/tuning_database.h"
+#include <fstream>
+#include <sstream>
+
+TuningDatabase::TuningDatabase(const char* filename, const char* cost_filename)
+    : filename(filename), cost_filename(cost_filename) {}
+
+std::string TuningDatabase::makeKey(const std::string& device, const std::string& size_class){
+    return device + '\t' + size_class;
+}
+
+std::string TuningDatabase::sizeClass(int width, int height){
+    /*
+    Images are grouped by the next power of two of each dimension, the best
+    configuration hardly changes inside such a class.
+    */
+    int w = 1, h = 1;
+    while (w < width) w <<= 1;
+    while (h < height) h <<= 1;
+
+    std::ostringstream out;
+    out << w << "x" << h;
+    return out.str();
+}
+
+bool TuningDatabase::load(){
+    std::string line;
+    std::ifstream cost_file(cost_filename.c_str());
+    while (cost_file && std::getline(cost_file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string device, algorithm;
+        CostEntry cost;
+        if (!std::getline(fields, device, '\t') || !std::getline(fields, algorithm, '\t')) continue;
+        if (!(fields >> cost.fixed >> cost.unit)) continue;
+
+        costs[makeKey(device, algorithm)] = cost;
+    }
+
+    std::ifstream file(filename.c_str());
+    if (!file) return false;
+
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string device, size_class, value;
+        TuningEntry entry;
+        if (!std::getline(fields, device, '\t') || !std::getline(fields, size_class, '\t')) continue;
+        if (!(fields >> entry.kernel_path >> entry.local_size[0] >> entry.local_size[1] >> entry.time)) continue;
+
+        entries[makeKey(device, size_class)] = entry;
+    }
+    return true;
+}
+
+bool TuningDatabase::save() const {
+    std::ofstream file(filename.c_str());
+    if (!file) return false;
+
+    file << "# device\tsize class\tkernel path\tlocal x\tlocal y\ttime (s)\n";
+    for (std::map<std::string, TuningEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        const TuningEntry& entry = it->second;
+        file << it->first << '\t' << entry.kernel_path << '\t' << entry.local_size[0] << '\t'
+             << entry.local_size[1] << '\t' << entry.time << '\n';
+    }
+
+    std::ofstream cost_file(cost_filename.c_str());
+    if (!cost_file) return false;
+
+    cost_file << "# device\talgorithm\tfixed (s/byte)\tunit (s/byte/work)\n";
+    for (std::map<std::string, CostEntry>::const_iterator it = costs.begin(); it != costs.end(); ++it) {
+        cost_file << it->first << '\t' << it->second.fixed << '\t' << it->second.unit << '\n';
+    }
+    return true;
+}
+
+bool TuningDatabase::lookup(const std::string& device, const std::string& size_class, TuningEntry& entry) const {
+    std::map<std::string, TuningEntry>::const_iterator it = entries.find(makeKey(device, size_class));
+    if (it == entries.end()) return false;
+    entry = it->second;
+    return true;
+}
+
+void TuningDatabase::store(const std::string& device, const std::string& size_class, const TuningEntry& entry){
+    entries[makeKey(device, size_class)] = entry;
+}
+
+bool TuningDatabase::lookupCost(const std::string& device, const std::string& algorithm, CostEntry& cost) const {
+    std::map<std::string, CostEntry>::const_iterator it = costs.find(makeKey(device, algorithm));
+    if (it == costs.end()) return false;
+    cost = it->second;
+    return true;
+}
+
+void TuningDatabase::storeCost(const std::string& device, const std::string& algorithm, const CostEntry& cost){
+    costs[makeKey(device, algorithm)] = cost;
+}